@@ -8,8 +8,14 @@
 #include "font_awesome_symbols.h"
 #include "assets/lang_config.h"
 #include "mcp_server.h"
+#include "connection_manager.h"
+#include "message_dispatcher.h"
+#include "boot_profiler.h"
+#include "settings.h"
+#include "task_registry.h"
 
 #include <cstring>
+#include <future>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
@@ -103,42 +109,7 @@ void Application::CheckNewVersion(Ota& ota) {
         retry_delay = 10; // 重置重试延迟时间
 
         if (ota.HasNewVersion()) {
-            Alert(Lang::Strings::OTA_UPGRADE, Lang::Strings::UPGRADING, "happy", Lang::Sounds::P3_UPGRADE);
-
-            vTaskDelay(pdMS_TO_TICKS(3000));
-
-            SetDeviceState(kDeviceStateUpgrading);
-            
-            display->SetIcon(FONT_AWESOME_DOWNLOAD);
-            std::string message = std::string(Lang::Strings::NEW_VERSION) + ota.GetFirmwareVersion();
-            display->SetChatMessage("system", message.c_str());
-
-            board.SetPowerSaveMode(false);
-            audio_service_.Stop();
-            vTaskDelay(pdMS_TO_TICKS(1000));
-
-            bool upgrade_success = ota.StartUpgrade([display](int progress, size_t speed) {
-                char buffer[64];
-                snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
-                display->SetChatMessage("system", buffer);
-            });
-
-            if (!upgrade_success) {
-                // Upgrade failed, restart audio service and continue running
-                ESP_LOGE(TAG, "Firmware upgrade failed, restarting audio service and continuing operation...");
-                audio_service_.Start(); // Restart audio service
-                board.SetPowerSaveMode(true); // Restore power save mode
-                Alert(Lang::Strings::ERROR, Lang::Strings::UPGRADE_FAILED, "sad", Lang::Sounds::P3_EXCLAMATION);
-                vTaskDelay(pdMS_TO_TICKS(3000));
-                // Continue to normal operation (don't break, just fall through)
-            } else {
-                // Upgrade success, reboot immediately
-                ESP_LOGI(TAG, "Firmware upgrade successful, rebooting...");
-                display->SetChatMessage("system", "Upgrade successful, rebooting...");
-                vTaskDelay(pdMS_TO_TICKS(1000)); // Brief pause to show message
-                Reboot();
-                return; // This line will never be reached after reboot
-            }
+            UpgradeFirmware(ota);
         }
 
         // No new version, mark the current version as valid
@@ -174,6 +145,115 @@ void Application::CheckNewVersion(Ota& ota) {
     }
 }
 
+bool Application::UpgradeFirmware(Ota& ota) {
+    auto& board = Board::GetInstance();
+    auto display = board.GetDisplay();
+    Alert(Lang::Strings::OTA_UPGRADE, Lang::Strings::UPGRADING, "happy", Lang::Sounds::P3_UPGRADE);
+
+    vTaskDelay(pdMS_TO_TICKS(3000));
+
+    SetDeviceState(kDeviceStateUpgrading);
+    
+    display->SetIcon(FONT_AWESOME_DOWNLOAD);
+    std::string message = std::string(Lang::Strings::NEW_VERSION) + ota.GetFirmwareVersion();
+    display->SetChatMessage("system", message.c_str());
+
+    board.SetPowerSaveMode(false);
+    audio_service_.Stop();
+    // Settings written in the last seconds must not wait for the flush timer while the flash is busy with the image
+    SettingsStore::GetInstance().Flush();
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    bool upgrade_success = ota.StartUpgrade([display](int progress, size_t speed) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
+        display->SetChatMessage("system", buffer);
+    });
+
+    if (!upgrade_success) {
+        // Upgrade failed, restart audio service and continue running
+        ESP_LOGE(TAG, "Firmware upgrade failed, restarting audio service and continuing operation...");
+        audio_service_.Start(); // Restart audio service
+        board.SetPowerSaveMode(true); // Restore power save mode
+        Alert(Lang::Strings::ERROR, Lang::Strings::UPGRADE_FAILED, "sad", Lang::Sounds::P3_EXCLAMATION);
+        vTaskDelay(pdMS_TO_TICKS(3000));
+        // Continue to normal operation
+    } else {
+        // Upgrade success, reboot immediately
+        ESP_LOGI(TAG, "Firmware upgrade successful, rebooting...");
+        display->SetChatMessage("system", "Upgrade successful, rebooting...");
+        vTaskDelay(pdMS_TO_TICKS(1000)); // Brief pause to show message
+        Reboot();
+        return true; // This line will never be reached after reboot
+    }
+    return false;
+}
+
+void Application::StartBackgroundVersionCheck() {
+    TaskRegistry::GetInstance().Create("check_new_version", [](void* arg) {
+        Application* app = (Application*)arg;
+        app->BackgroundVersionCheck();
+        app->check_new_version_task_handle_ = nullptr;
+        vTaskDelete(NULL);
+    }, this, &check_new_version_task_handle_);
+}
+
+/*
+ * Runs after a boot with the cached OTA config. CheckVersion updates the cache, so a changed
+ * protocol config takes effect at the next boot, and an activation request or a new version
+ * clears it so that the next boot does the full check.
+ */
+void Application::BackgroundVersionCheck() {
+    const int MAX_RETRY = 5;
+    int retry_delay = 10;
+
+    auto ota = std::make_shared<Ota>();
+    for (int retry_count = 0; !ota->CheckVersion(); retry_count++) {
+        if (retry_count + 1 >= MAX_RETRY) {
+            ESP_LOGE(TAG, "Background version check failed");
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(retry_delay * 1000));
+        retry_delay *= 2;
+    }
+    has_server_time_ = ota->HasServerTime();
+
+    if (ota->HasActivationCode() || ota->HasActivationChallenge()) {
+        ESP_LOGW(TAG, "The server requires activation, it will be shown at the next boot");
+        return;
+    }
+    if (!ota->HasNewVersion()) {
+        ota->MarkCurrentVersionValid();
+        return;
+    }
+
+    // Do not interrupt a conversation, wait until the device is idle
+    while (!CanEnterSleepMode()) {
+        vTaskDelay(pdMS_TO_TICKS(5000));
+    }
+    // The main loop only claims the idle state, so that a wake word cannot start a conversation.
+    // The download runs on this task and the main loop keeps serving events meanwhile.
+    auto claimed = std::make_shared<std::promise<bool>>();
+    auto claimed_future = claimed->get_future();
+    Schedule([this, claimed]() {
+        if (device_state_ != kDeviceStateIdle) {
+            claimed->set_value(false);
+            return;
+        }
+        SetDeviceState(kDeviceStateUpgrading);
+        claimed->set_value(true);
+    });
+    if (!claimed_future.get()) {
+        ESP_LOGW(TAG, "Device is busy, the upgrade is retried at the next boot");
+        return;
+    }
+    if (!UpgradeFirmware(*ota)) {
+        Schedule([this]() {
+            SetDeviceState(kDeviceStateIdle);
+        });
+    }
+}
+
 void Application::ShowActivationCode(const std::string& code, const std::string& message) {
     struct digit_sound {
         char digit;
@@ -206,6 +286,8 @@ void Application::ShowActivationCode(const std::string& code, const std::string&
 
 void Application::Alert(const char* status, const char* message, const char* emotion, const std::string_view& sound) {
     ESP_LOGW(TAG, "Alert %s: %s [%s]", status, message, emotion);
+    // Draw a pending state transition first, so that it does not overwrite the alert
+    state_presenter_.Flush();
     auto display = Board::GetInstance().GetDisplay();
     display->SetStatus(status);
     display->SetEmotion(emotion);
@@ -217,6 +299,7 @@ void Application::Alert(const char* status, const char* message, const char* emo
 
 void Application::DismissAlert() {
     if (device_state_ == kDeviceStateIdle) {
+        state_presenter_.Flush();
         auto display = Board::GetInstance().GetDisplay();
         display->SetStatus(Lang::Strings::STANDBY);
         display->SetEmotion("neutral");
@@ -325,15 +408,21 @@ void Application::StopListening() {
 }
 
 void Application::Start() {
+    auto& boot_profiler = BootProfiler::GetInstance();
+    boot_profiler.Begin(kBootPhaseBoard);
     auto& board = Board::GetInstance();
+    boot_profiler.End(kBootPhaseBoard);
+    state_presenter_.Start();
     SetDeviceState(kDeviceStateStarting);
 
     /* Setup the display */
     auto display = board.GetDisplay();
 
     /* Setup the audio service */
+    boot_profiler.Begin(kBootPhaseCodec);
     auto codec = board.GetAudioCodec();
     audio_service_.Initialize(codec);
+    boot_profiler.End(kBootPhaseCodec);
     audio_service_.Start();
 
     AudioServiceCallbacks callbacks;
@@ -351,15 +440,30 @@ void Application::Start() {
     /* Start the clock timer to update the status bar */
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
 
+    // The wake word model is needed once idle, load it while the network is coming up
+    audio_service_.PreloadWakeWord();
+
     /* Wait for the network to be ready */
+    boot_profiler.Begin(kBootPhaseNetwork);
     board.StartNetwork();
+    boot_profiler.End(kBootPhaseNetwork);
 
     // Update the status bar immediately to show the network state
     display->UpdateStatusBar(true);
 
-    // Check for new firmware version or get the MQTT broker address
+    // Check for new firmware version or get the MQTT broker address.
+    // If the last check of this firmware left a cached config, start the protocol right away
+    // and check for a new version in the background.
     Ota ota;
-    CheckNewVersion(ota);
+    bool cached_config = false;
+#if CONFIG_USE_CACHED_OTA_CONFIG
+    cached_config = ota.LoadCachedConfig();
+#endif
+    if (cached_config) {
+        ESP_LOGI(TAG, "Using the cached OTA config, checking for a new version in the background");
+    } else {
+        CheckNewVersion(ota);
+    }
 
     // Initialize the protocol
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
@@ -380,6 +484,9 @@ void Application::Start() {
         last_error_message_ = message;
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
+    protocol_->OnControlQueued([this]() {
+        xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_CONTROL);
+    });
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
@@ -400,100 +507,23 @@ void Application::Start() {
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
-                        SetDeviceState(kDeviceStateSpeaking);
-                    }
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
-                }
-            }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
-                McpServer::GetInstance().ParseMessage(payload);
-            }
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
-                    // Do a reboot if user requests a OTA update
-                    Schedule([this]() {
-                        Reboot();
-                    });
-                } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
-                }
-            }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::P3_VIBRATION);
-            } else {
-                ESP_LOGW(TAG, "Alert command requires status, message and emotion");
-            }
-#if CONFIG_RECEIVE_CUSTOM_MESSAGE
-        } else if (strcmp(type->valuestring, "custom") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
-            if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
-                    display->SetChatMessage("system", payload_str.c_str());
-                });
-            } else {
-                ESP_LOGW(TAG, "Invalid custom message format: missing payload");
-            }
-#endif
-        } else {
-            ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
-        }
+    RegisterMessageHandlers();
+    protocol_->OnIncomingJson([](const cJSON* root) {
+        MessageDispatcher::GetInstance().Dispatch(root);
     });
+    boot_profiler.Begin(kBootPhaseProtocol);
     bool protocol_started = protocol_->Start();
+    boot_profiler.End(kBootPhaseProtocol);
+    connection_supervisor_ = std::make_unique<ConnectionSupervisor>(protocol_.get());
 
     SetDeviceState(kDeviceStateIdle);
+    boot_profiler.Mark(kBootPhaseReady);
+    ESP_LOGI(TAG, "Ready in %lld ms (%s)", esp_timer_get_time() / 1000, cached_config ? "cached config" : "version checked");
 
     has_server_time_ = ota.HasServerTime();
+    if (cached_config) {
+        StartBackgroundVersionCheck();
+    }
     if (protocol_started) {
         std::string message = std::string(Lang::Strings::VERSION) + ota.GetCurrentVersion();
         display->ShowNotification(message.c_str());
@@ -509,26 +539,155 @@ void Application::Start() {
     MainEventLoop();
 }
 
+void Application::RegisterMessageHandlers() {
+    auto& dispatcher = MessageDispatcher::GetInstance();
+    auto display = Board::GetInstance().GetDisplay();
+
+    dispatcher.Register("tts", [this, display](const cJSON* root) {
+        auto state = cJSON_GetObjectItem(root, "state");
+        if (!cJSON_IsString(state)) {
+            return;
+        }
+        // The hash picks the case, the string compare rules out a collision like the type table does
+        switch (MessageTypeHash(state->valuestring)) {
+        case MessageTypeHash("start"):
+            if (strcmp(state->valuestring, "start") != 0) {
+                break;
+            }
+            Schedule([this]() {
+                aborted_ = false;
+                if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
+                    SetDeviceState(kDeviceStateSpeaking);
+                }
+            });
+            break;
+        case MessageTypeHash("stop"):
+            if (strcmp(state->valuestring, "stop") != 0) {
+                break;
+            }
+            Schedule([this]() {
+                if (device_state_ == kDeviceStateSpeaking) {
+                    if (listening_mode_ == kListeningModeManualStop) {
+                        SetDeviceState(kDeviceStateIdle);
+                    } else {
+                        SetDeviceState(kDeviceStateListening);
+                    }
+                }
+            });
+            break;
+        case MessageTypeHash("sentence_start"): {
+            if (strcmp(state->valuestring, "sentence_start") != 0) {
+                break;
+            }
+            auto text = cJSON_GetObjectItem(root, "text");
+            if (cJSON_IsString(text)) {
+                ESP_LOGI(TAG, "<< %s", text->valuestring);
+                Schedule([this, display, message = std::string(text->valuestring)]() {
+                    display->SetChatMessage("assistant", message.c_str());
+                });
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    });
+
+    dispatcher.Register("stt", [this, display](const cJSON* root) {
+        auto text = cJSON_GetObjectItem(root, "text");
+        if (cJSON_IsString(text)) {
+            ESP_LOGI(TAG, ">> %s", text->valuestring);
+            Schedule([this, display, message = std::string(text->valuestring)]() {
+                display->SetChatMessage("user", message.c_str());
+            });
+        }
+    });
+
+    dispatcher.Register("llm", [this, display](const cJSON* root) {
+        auto emotion = cJSON_GetObjectItem(root, "emotion");
+        if (cJSON_IsString(emotion)) {
+            Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
+                state_presenter_.Flush();
+                display->SetEmotion(emotion_str.c_str());
+            });
+        }
+    });
+
+    dispatcher.Register("mcp", [](const cJSON* root) {
+        auto payload = cJSON_GetObjectItem(root, "payload");
+        // An array is a JSON-RPC batch
+        if (cJSON_IsObject(payload) || cJSON_IsArray(payload)) {
+            McpServer::GetInstance().ParseMessage(payload);
+        }
+    });
+
+    dispatcher.Register("system", [this](const cJSON* root) {
+        auto command = cJSON_GetObjectItem(root, "command");
+        if (cJSON_IsString(command)) {
+            ESP_LOGI(TAG, "System command: %s", command->valuestring);
+            if (strcmp(command->valuestring, "reboot") == 0) {
+                // Do a reboot if user requests a OTA update
+                Schedule([this]() {
+                    Reboot();
+                });
+            } else {
+                ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
+            }
+        }
+    });
+
+    dispatcher.Register("alert", [this](const cJSON* root) {
+        auto status = cJSON_GetObjectItem(root, "status");
+        auto message = cJSON_GetObjectItem(root, "message");
+        auto emotion = cJSON_GetObjectItem(root, "emotion");
+        if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
+            Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::P3_VIBRATION);
+        } else {
+            ESP_LOGW(TAG, "Alert command requires status, message and emotion");
+        }
+    });
+
+#if CONFIG_RECEIVE_CUSTOM_MESSAGE
+    dispatcher.Register("custom", [this, display](const cJSON* root) {
+        auto payload = cJSON_GetObjectItem(root, "payload");
+        ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
+        if (cJSON_IsObject(payload)) {
+            Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
+                display->SetChatMessage("system", payload_str.c_str());
+            });
+        } else {
+            ESP_LOGW(TAG, "Invalid custom message format: missing payload");
+        }
+    });
+#endif
+}
+
 void Application::OnClockTimer() {
+    auto start_time = esp_timer_get_time();
     clock_ticks_++;
 
     auto display = Board::GetInstance().GetDisplay();
     display->UpdateStatusBar();
 
+    if (connection_supervisor_) {
+        Schedule([this]() {
+            connection_supervisor_->Tick(device_state_ == kDeviceStateIdle);
+        });
+    }
+
     // Print the debug info every 10 seconds
     if (clock_ticks_ % 10 == 0) {
         // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
         // SystemInfo::PrintTaskList();
         SystemInfo::PrintHeapStats();
     }
+    event_loop_stats_.RecordDispatch(kMainEventTypeClockTick, esp_timer_get_time() - start_time);
 }
 
 // Add a async task to MainLoop
-void Application::Schedule(std::function<void()> callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
-    }
+void Application::Schedule(ScheduledTask&& callback, const char* file, int line) {
+    callback.SetOrigin(file, line, esp_timer_get_time());
+    main_tasks_.Push(std::move(callback));
     xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
 }
 
@@ -537,49 +696,91 @@ void Application::Schedule(std::function<void()> callback) {
 // they should use Schedule to call this function
 void Application::MainEventLoop() {
     // Raise the priority of the main event loop to avoid being interrupted by background tasks (which has priority 2)
-    vTaskPrioritySet(NULL, 3);
+    TaskRegistry::GetInstance().ApplyToCurrentTask("main");
 
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, MAIN_EVENT_SCHEDULE |
             MAIN_EVENT_SEND_AUDIO |
+            MAIN_EVENT_SEND_CONTROL |
             MAIN_EVENT_WAKE_WORD_DETECTED |
             MAIN_EVENT_VAD_CHANGE |
             MAIN_EVENT_ERROR, pdTRUE, pdFALSE, portMAX_DELAY);
         if (bits & MAIN_EVENT_ERROR) {
+            auto start_time = esp_timer_get_time();
             SetDeviceState(kDeviceStateIdle);
             Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
+            event_loop_stats_.RecordDispatch(kMainEventTypeError, esp_timer_get_time() - start_time);
+        }
+
+        if (bits & MAIN_EVENT_SEND_CONTROL) {
+            auto start_time = esp_timer_get_time();
+            protocol_->FlushControlMessages();
+            event_loop_stats_.RecordDispatch(kMainEventTypeSendControl, esp_timer_get_time() - start_time);
         }
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (!protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
-            }
+            auto start_time = esp_timer_get_time();
+            SendPendingAudio();
+            event_loop_stats_.RecordDispatch(kMainEventTypeSendAudio, esp_timer_get_time() - start_time);
         }
 
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
+            auto start_time = esp_timer_get_time();
             OnWakeWordDetected();
+            event_loop_stats_.RecordDispatch(kMainEventTypeWakeWord, esp_timer_get_time() - start_time);
         }
 
         if (bits & MAIN_EVENT_VAD_CHANGE) {
+            auto start_time = esp_timer_get_time();
             if (device_state_ == kDeviceStateListening) {
                 auto led = Board::GetInstance().GetLed();
                 led->OnStateChanged();
             }
+            event_loop_stats_.RecordDispatch(kMainEventTypeVadChange, esp_timer_get_time() - start_time);
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
+            ScheduledTask task;
+            int count = 0;
+            while (main_tasks_.Pop(task)) {
+                auto start_time = esp_timer_get_time();
+                event_loop_stats_.RecordQueueWait(start_time - task.queued_time_us());
                 task();
+                event_loop_stats_.RecordDispatch(kMainEventTypeSchedule, esp_timer_get_time() - start_time, task.file(), task.line());
+                if (++count >= SCHEDULE_QUEUE_SIZE) {
+                    // Let the other events run, continue on the next iteration
+                    xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
+                    break;
+                }
             }
         }
     }
 }
 
+// Control messages, wake word and scheduled tasks preempt the audio backlog,
+// so that an abort or MCP reply does not wait behind queued frames on a slow uplink
+void Application::SendPendingAudio() {
+    while (true) {
+        protocol_->FlushControlMessages();
+        if (xEventGroupGetBits(event_group_) & (MAIN_EVENT_SCHEDULE | MAIN_EVENT_WAKE_WORD_DETECTED)) {
+            // Resume sending after the preempting events are handled
+            xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_AUDIO);
+            return;
+        }
+
+        auto packet = audio_service_.PopPacketFromSendQueue();
+        if (!packet) {
+            return;
+        }
+        if (protocol_->ShouldDropAudio(audio_service_.GetSendQueueSize(), OPUS_FRAME_DURATION_MS)) {
+            continue;
+        }
+        if (!protocol_->SendAudio(std::move(packet))) {
+            return;
+        }
+    }
+}
+
 void Application::OnWakeWordDetected() {
     if (!protocol_) {
         return;
@@ -642,27 +843,16 @@ void Application::SetDeviceState(DeviceState state) {
     // Send the state change event
     DeviceStateEventManager::GetInstance().PostStateChangeEvent(previous_state, state);
 
-    auto& board = Board::GetInstance();
-    auto display = board.GetDisplay();
-    auto led = board.GetLed();
-    led->OnStateChanged();
+    // The LED and display are updated by the presenter task, only audio and protocol work is done here
+    state_presenter_.Post(state);
+
     switch (state) {
         case kDeviceStateUnknown:
         case kDeviceStateIdle:
-            display->SetStatus(Lang::Strings::STANDBY);
-            display->SetEmotion("neutral");
             audio_service_.EnableVoiceProcessing(false);
             audio_service_.EnableWakeWordDetection(true);
             break;
-        case kDeviceStateConnecting:
-            display->SetStatus(Lang::Strings::CONNECTING);
-            display->SetEmotion("neutral");
-            display->SetChatMessage("system", "");
-            break;
         case kDeviceStateListening:
-            display->SetStatus(Lang::Strings::LISTENING);
-            display->SetEmotion("neutral");
-
             // Make sure the audio processor is running
             if (!audio_service_.IsAudioProcessorRunning()) {
                 // Send the start listening command
@@ -672,8 +862,6 @@ void Application::SetDeviceState(DeviceState state) {
             }
             break;
         case kDeviceStateSpeaking:
-            display->SetStatus(Lang::Strings::SPEAKING);
-
             if (listening_mode_ != kListeningModeRealtime) {
                 audio_service_.EnableVoiceProcessing(false);
                 // Only AFE wake word can be detected in speaking mode
@@ -693,6 +881,7 @@ void Application::SetDeviceState(DeviceState state) {
 
 void Application::Reboot() {
     ESP_LOGI(TAG, "Rebooting...");
+    SettingsStore::GetInstance().Flush();
     esp_restart();
 }
 
@@ -735,11 +924,50 @@ bool Application::CanEnterSleepMode() {
 }
 
 void Application::SendMcpMessage(const std::string& payload) {
-    Schedule([this, payload]() {
-        if (protocol_) {
-            protocol_->SendMcpMessage(payload);
-        }
-    });
+    if (!protocol_) {
+        return;
+    }
+    // Bypass the schedule queue, the main loop sends it before the next audio frame
+    protocol_->QueueMcpMessage(payload);
+}
+
+std::string Application::GetEventLoopStatsJson() {
+    cJSON* root = event_loop_stats_.ToJson(main_tasks_.GetStats());
+    cJSON_AddItemToObject(root, "state_presentation", state_presenter_.ToJson());
+    cJSON_AddItemToObject(root, "state_listeners", DeviceStateEventManager::GetInstance().GetStatsJson());
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+void Application::ResetEventLoopStats() {
+    event_loop_stats_.Reset();
+    state_presenter_.ResetStats();
+}
+
+std::string Application::GetNetworkDiagnosticsJson() {
+    if (!protocol_) {
+        return "{}";
+    }
+
+    auto& outbound = protocol_->outbound_stats();
+    std::string json = "{";
+    json += "\"link\":" + protocol_->link_estimator().GetJson();
+    if (connection_supervisor_) {
+        json += ",\"connection\":" + connection_supervisor_->GetStatsJson();
+    }
+    json += ",\"outbound\":{";
+    json += "\"control_sent\":" + std::to_string(outbound.control_sent.load());
+    json += ",\"audio_dropped\":" + std::to_string(outbound.audio_dropped.load());
+    json += ",\"max_control_latency_ms\":" + std::to_string(outbound.max_control_latency_us.load() / 1000);
+    json += ",\"last_abort_latency_ms\":" + std::to_string(outbound.last_abort_latency_us.load() / 1000);
+    json += "}";
+    json += ",\"http\":" + ConnectionManager::GetInstance().GetStatsJson();
+    json += ",\"incoming\":" + MessageDispatcher::GetInstance().GetStatsJson();
+    json += "}";
+    return json;
 }
 
 void Application::SetAecMode(AecMode mode) {
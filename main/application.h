@@ -11,11 +11,16 @@
 #include <deque>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 #include "protocol.h"
+#include "connection_supervisor.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state_event.h"
+#include "schedule_queue.h"
+#include "state_presenter.h"
+#include "event_loop_stats.h"
 
 #define MAIN_EVENT_SCHEDULE (1 << 0)
 #define MAIN_EVENT_SEND_AUDIO (1 << 1)
@@ -23,6 +28,7 @@
 #define MAIN_EVENT_VAD_CHANGE (1 << 3)
 #define MAIN_EVENT_ERROR (1 << 4)
 #define MAIN_EVENT_CHECK_NEW_VERSION_DONE (1 << 5)
+#define MAIN_EVENT_SEND_CONTROL (1 << 6)
 
 enum AecMode {
     kAecOff,
@@ -43,7 +49,7 @@ public:
     void Start();
     DeviceState GetDeviceState() const { return device_state_; }
     bool IsVoiceDetected() const { return audio_service_.IsVoiceDetected(); }
-    void Schedule(std::function<void()> callback);
+    void Schedule(ScheduledTask&& callback, const char* file = __builtin_FILE(), int line = __builtin_LINE());
     void SetDeviceState(DeviceState state);
     void Alert(const char* status, const char* message, const char* emotion = "", const std::string_view& sound = "");
     void DismissAlert();
@@ -59,14 +65,20 @@ public:
     AecMode GetAecMode() const { return aec_mode_; }
     void PlaySound(const std::string_view& sound);
     AudioService& GetAudioService() { return audio_service_; }
+    std::string GetNetworkDiagnosticsJson();
+    EventLoopStats& GetEventLoopStats() { return event_loop_stats_; }
+    std::string GetEventLoopStatsJson();
+    void ResetEventLoopStats();
 
 private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    ScheduleQueue main_tasks_;
+    EventLoopStats event_loop_stats_;
+    StatePresenter state_presenter_;
     std::unique_ptr<Protocol> protocol_;
+    std::unique_ptr<ConnectionSupervisor> connection_supervisor_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
     volatile DeviceState device_state_ = kDeviceStateUnknown;
@@ -75,16 +87,21 @@ private:
     std::string last_error_message_;
     AudioService audio_service_;
 
-    bool has_server_time_ = false;
+    std::atomic<bool> has_server_time_{false};     // Also set by the background version check
     bool aborted_ = false;
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
     void MainEventLoop();
+    void SendPendingAudio();
     void OnWakeWordDetected();
     void CheckNewVersion(Ota& ota);
+    bool UpgradeFirmware(Ota& ota);
+    void StartBackgroundVersionCheck();
+    void BackgroundVersionCheck();
     void ShowActivationCode(const std::string& code, const std::string& message);
     void OnClockTimer();
+    void RegisterMessageHandlers();
     void SetListeningMode(ListeningMode mode);
 };
 
@@ -1,4 +1,6 @@
 #include "audio_service.h"
+#include "boot_profiler.h"
+#include "task_registry.h"
 #include <esp_log.h>
 
 #if CONFIG_USE_AUDIO_PROCESSOR
@@ -97,42 +99,29 @@ void AudioService::Start() {
 
     esp_timer_start_periodic(audio_power_timer_, 1000000);
 
-#if CONFIG_USE_AUDIO_PROCESSOR
-    /* Start the audio input task */
-    xTaskCreatePinnedToCore([](void* arg) {
-        AudioService* audio_service = (AudioService*)arg;
-        audio_service->AudioInputTask();
-        vTaskDelete(NULL);
-    }, "audio_input", 2048 * 3, this, 8, &audio_input_task_handle_, 1);
+    // Stack sizes, priorities and cores are in the task registry, they depend on CONFIG_USE_AUDIO_PROCESSOR
+    auto& task_registry = TaskRegistry::GetInstance();
 
-    /* Start the audio output task */
-    xTaskCreate([](void* arg) {
-        AudioService* audio_service = (AudioService*)arg;
-        audio_service->AudioOutputTask();
-        vTaskDelete(NULL);
-    }, "audio_output", 2048 * 2, this, 3, &audio_output_task_handle_);
-#else
     /* Start the audio input task */
-    xTaskCreate([](void* arg) {
+    task_registry.Create("audio_input", [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioInputTask();
         vTaskDelete(NULL);
-    }, "audio_input", 2048 * 2, this, 8, &audio_input_task_handle_);
+    }, this, &audio_input_task_handle_);
 
     /* Start the audio output task */
-    xTaskCreate([](void* arg) {
+    task_registry.Create("audio_output", [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioOutputTask();
         vTaskDelete(NULL);
-    }, "audio_output", 2048, this, 3, &audio_output_task_handle_);
-#endif
+    }, this, &audio_output_task_handle_);
 
     /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    task_registry.Create("opus_codec", [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->OpusCodecTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, this, &opus_codec_task_handle_);
 }
 
 void AudioService::Stop() {
@@ -450,6 +439,11 @@ std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
     return packet;
 }
 
+size_t AudioService::GetSendQueueSize() {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    return audio_send_queue_.size();
+}
+
 void AudioService::EncodeWakeWord() {
     if (wake_word_) {
         wake_word_->EncodeWakeWordData();
@@ -475,12 +469,8 @@ void AudioService::EnableWakeWordDetection(bool enable) {
 
     ESP_LOGD(TAG, "%s wake word detection", enable ? "Enabling" : "Disabling");
     if (enable) {
-        if (!wake_word_initialized_) {
-            if (!wake_word_->Initialize(codec_)) {
-                ESP_LOGE(TAG, "Failed to initialize wake word");
-                return;
-            }
-            wake_word_initialized_ = true;
+        if (!InitializeWakeWord()) {
+            return;
         }
         wake_word_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
@@ -490,12 +480,44 @@ void AudioService::EnableWakeWordDetection(bool enable) {
     }
 }
 
+void AudioService::PreloadWakeWord() {
+    if (!wake_word_) {
+        return;
+    }
+    TaskRegistry::GetInstance().Create("wake_word_preload", [](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->InitializeWakeWord();
+        vTaskDelete(NULL);
+    }, this);
+}
+
+bool AudioService::InitializeWakeWord() {
+    // Also taken by EnableWakeWordDetection, which waits for a preload in progress
+    std::lock_guard<std::mutex> lock(wake_word_mutex_);
+    if (wake_word_initialized_) {
+        return true;
+    }
+    auto& boot_profiler = BootProfiler::GetInstance();
+    boot_profiler.Begin(kBootPhaseWakeWord);
+    bool initialized = wake_word_->Initialize(codec_);
+    boot_profiler.End(kBootPhaseWakeWord);
+    if (!initialized) {
+        ESP_LOGE(TAG, "Failed to initialize wake word");
+        return false;
+    }
+    wake_word_initialized_ = true;
+    return true;
+}
+
 void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
+            auto& boot_profiler = BootProfiler::GetInstance();
+            boot_profiler.Begin(kBootPhaseAudioProcessor);
             audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
             audio_processor_initialized_ = true;
+            boot_profiler.End(kBootPhaseAudioProcessor);
         }
 
         /* We should make sure no audio is playing */
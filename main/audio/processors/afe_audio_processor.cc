@@ -1,4 +1,5 @@
 #include "afe_audio_processor.h"
+#include "task_registry.h"
 #include <esp_log.h>
 
 #define PROCESSOR_RUNNING 0x01
@@ -63,11 +64,11 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
     
-    xTaskCreate([](void* arg) {
+    TaskRegistry::GetInstance().Create("audio_communication", [](void* arg) {
         auto this_ = (AfeAudioProcessor*)arg;
         this_->AudioProcessorTask();
         vTaskDelete(NULL);
-    }, "audio_communication", 4096, this, 3, NULL);
+    }, this);
 }
 
 AfeAudioProcessor::~AfeAudioProcessor() {
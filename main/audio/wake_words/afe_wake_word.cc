@@ -1,5 +1,6 @@
 #include "afe_wake_word.h"
 #include "application.h"
+#include "task_registry.h"
 
 #include <esp_log.h>
 #include <model_path.h>
@@ -70,11 +71,11 @@ bool AfeWakeWord::Initialize(AudioCodec* codec) {
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
 
-    xTaskCreate([](void* arg) {
+    TaskRegistry::GetInstance().Create("audio_detection", [](void* arg) {
         auto this_ = (AfeWakeWord*)arg;
         this_->AudioDetectionTask();
         vTaskDelete(NULL);
-    }, "audio_detection", 4096, this, 3, nullptr);
+    }, this);
 
     return true;
 }
@@ -147,10 +148,7 @@ void AfeWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
 
 void AfeWakeWord::EncodeWakeWordData() {
     wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(4096 * 8, MALLOC_CAP_SPIRAM);
-    }
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
+    wake_word_encode_task_ = TaskRegistry::GetInstance().CreateStatic("encode_detect_packets", [](void* arg) {
         auto this_ = (AfeWakeWord*)arg;
         {
             auto start_time = esp_timer_get_time();
@@ -176,7 +174,7 @@ void AfeWakeWord::EncodeWakeWordData() {
             this_->wake_word_cv_.notify_all();
         }
         vTaskDelete(NULL);
-    }, "encode_detect_packets", 4096 * 8, this, 2, wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
+    }, this, &wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
 }
 
 bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
@@ -1,5 +1,9 @@
 #include "custom_wake_word.h"
 #include "application.h"
+#include "task_registry.h"
+#if CONFIG_USE_OFFLINE_COMMANDS
+#include "offline_commands.h"
+#endif
 
 #include <esp_log.h>
 #include <model_path.h>
@@ -67,6 +71,15 @@ bool CustomWakeWord::Initialize(AudioCodec* codec) {
     multinet_->set_det_threshold(multinet_model_data_, 0.5);
     esp_mn_commands_clear();
     esp_mn_commands_add(1, CONFIG_CUSTOM_WAKE_WORD);  // 添加自定义唤醒词作为命令词
+#if CONFIG_USE_OFFLINE_COMMANDS
+    // 离线命令词从 OFFLINE_COMMAND_ID_BASE 开始编号
+    auto& offline_commands = OfflineCommands::GetInstance().Load();
+    for (size_t i = 0; i < offline_commands.size(); i++) {
+        if (esp_mn_commands_add(OFFLINE_COMMAND_ID_BASE + i, offline_commands[i].phrase.c_str()) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to add offline command: %s", offline_commands[i].phrase.c_str());
+        }
+    }
+#endif
     esp_mn_commands_update();
     
     // 打印所有的命令词
@@ -93,11 +106,11 @@ bool CustomWakeWord::Initialize(AudioCodec* codec) {
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
 
-    xTaskCreate([](void* arg) {
+    TaskRegistry::GetInstance().Create("audio_detection", [](void* arg) {
         auto this_ = (CustomWakeWord*)arg;
         this_->AudioDetectionTask();
         vTaskDelete(NULL);
-    }, "audio_detection", 16384, this, 3, nullptr);
+    }, this);
 
     return true;
 }
@@ -189,6 +202,13 @@ void CustomWakeWord::AudioDetectionTask() {
                 multinet_->clean(multinet_model_data_);
                 ESP_LOGI(TAG, "Ready for next detection");
             }
+#if CONFIG_USE_OFFLINE_COMMANDS
+            else {
+                // 离线命令词在本地执行，不停止检测
+                OfflineCommands::GetInstance().Execute(mn_result->command_id[0], mn_result->prob[0]);
+                multinet_->clean(multinet_model_data_);
+            }
+#endif
         } else if (mn_state == ESP_MN_STATE_TIMEOUT) {
             // 超时，清理状态继续检测
             ESP_LOGD(TAG, "Command word detection timeout, cleaning state");
@@ -211,10 +231,7 @@ void CustomWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
 
 void CustomWakeWord::EncodeWakeWordData() {
     wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(4096 * 8, MALLOC_CAP_SPIRAM);
-    }
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
+    wake_word_encode_task_ = TaskRegistry::GetInstance().CreateStatic("encode_detect_packets", [](void* arg) {
         auto this_ = (CustomWakeWord*)arg;
         {
             auto start_time = esp_timer_get_time();
@@ -240,7 +257,7 @@ void CustomWakeWord::EncodeWakeWordData() {
             this_->wake_word_cv_.notify_all();
         }
         vTaskDelete(NULL);
-    }, "encode_detect_packets", 4096 * 8, this, 2, wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
+    }, this, &wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
 }
 
 bool CustomWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
@@ -9,6 +9,7 @@
 #include "lamp_controller.h"
 #include "led/single_led.h"
 #include "esp32_camera.h"
+#include "task_registry.h"
 
 #include <wifi_station.h>
 #include <esp_log.h>
@@ -102,7 +103,7 @@ private:
 
     // 启动图片循环显示任务
     void StartImageSlideshow() {
-        xTaskCreate(ImageSlideshowTask, "img_slideshow", 4096, this, 3, &image_task_handle_);
+        TaskRegistry::GetInstance().Create("img_slideshow", ImageSlideshowTask, this, &image_task_handle_);
         ESP_LOGI(TAG, "图片循环显示任务已启动");
     }
     
@@ -0,0 +1,167 @@
+#include "action_scheduler.h"
+#include "task_registry.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#define TAG "ActionScheduler"
+
+ActionScheduler::ActionScheduler(const char* task_name, Executor executor, std::function<void()> on_preempt)
+    : task_name_(task_name), executor_(std::move(executor)), on_preempt_(std::move(on_preempt)) {
+}
+
+ActionScheduler::~ActionScheduler() {
+    if (task_handle_ != nullptr) {
+        vTaskDelete(task_handle_);
+    }
+}
+
+bool ActionScheduler::SameAction(const RobotAction& a, const RobotAction& b) {
+    return a.type == b.type && a.speed == b.speed && a.direction == b.direction && a.amount == b.amount &&
+        a.priority == b.priority;
+}
+
+bool ActionScheduler::Enqueue(const RobotAction& action) {
+    bool preempt = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.enqueued++;
+
+        // Back to back duplicates, like a walk sent again while the first one is queued
+        if (!queue_.empty() && SameAction(queue_.back().action, action)) {
+            auto& last = queue_.back().action;
+            if (!action.merge_steps) {
+                stats_.merged++;
+                return true;
+            }
+            if (last.steps + action.steps <= ACTION_SCHEDULER_MAX_MERGED_STEPS) {
+                last.steps += action.steps;
+                stats_.merged++;
+                ESP_LOGI(TAG, "Action %d merged, %d steps", action.type, last.steps);
+                return true;
+            }
+        }
+
+        if (queue_.size() >= ACTION_SCHEDULER_MAX_BACKLOG) {
+            // The oldest of the lowest priority makes room, unless it is more important than this one
+            auto victim = queue_.begin();
+            for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+                if (it->action.priority < victim->action.priority) {
+                    victim = it;
+                }
+            }
+            if (victim->action.priority > action.priority) {
+                stats_.rejected++;
+                ESP_LOGW(TAG, "Backlog full, action %d rejected", action.type);
+                return false;
+            }
+            ESP_LOGW(TAG, "Backlog full, action %d dropped", victim->action.type);
+            queue_.erase(victim);
+            stats_.dropped++;
+        }
+
+        auto position = queue_.end();
+        for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+            if (it->action.priority < action.priority) {
+                position = it;
+                break;
+            }
+        }
+        queue_.insert(position, QueuedAction{ action, esp_timer_get_time() });
+
+        if (running_ && current_.action.priority < action.priority && !preempt_) {
+            preempt_ = true;
+            preempt = true;
+        }
+
+        if (task_handle_ == nullptr) {
+            TaskRegistry::GetInstance().Create(task_name_, [](void* arg) {
+                static_cast<ActionScheduler*>(arg)->Run();
+                vTaskDelete(NULL);
+            }, this, &task_handle_);
+        }
+    }
+    cv_.notify_all();
+
+    if (preempt) {
+        ESP_LOGI(TAG, "Action %d preempts the running one", action.type);
+        if (on_preempt_) {
+            on_preempt_();
+        }
+    }
+    return true;
+}
+
+void ActionScheduler::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.dropped += queue_.size();
+    queue_.clear();
+}
+
+void ActionScheduler::OnMotion() {
+    if (!motion_pending_.exchange(false)) {
+        return;
+    }
+    auto now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.first_motion.Add(now - current_.enqueue_time_us);
+}
+
+bool ActionScheduler::IsBusy() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return running_ || !queue_.empty();
+}
+
+void ActionScheduler::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return !queue_.empty(); });
+        current_ = queue_.front();
+        queue_.pop_front();
+        running_ = true;
+        preempt_ = false;
+        motion_pending_ = true;
+
+        auto start_time = esp_timer_get_time();
+        stats_.queue_wait.Add(start_time - current_.enqueue_time_us);
+        lock.unlock();
+
+        ESP_LOGI(TAG, "Action %d: %d steps, speed %d, direction %d, amount %d", current_.action.type,
+            current_.action.steps, current_.action.speed, current_.action.direction, current_.action.amount);
+        executor_(current_.action);
+
+        lock.lock();
+        stats_.run_time.Add(esp_timer_get_time() - start_time);
+        if (preempt_) {
+            stats_.preempted++;
+        } else {
+            stats_.completed++;
+        }
+        motion_pending_ = false;
+        preempt_ = false;
+        running_ = false;
+    }
+}
+
+std::string ActionScheduler::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "queued", queue_.size());
+    cJSON_AddBoolToObject(root, "running", running_);
+    cJSON_AddNumberToObject(root, "enqueued", stats_.enqueued);
+    cJSON_AddNumberToObject(root, "merged", stats_.merged);
+    cJSON_AddNumberToObject(root, "dropped", stats_.dropped);
+    cJSON_AddNumberToObject(root, "rejected", stats_.rejected);
+    cJSON_AddNumberToObject(root, "preempted", stats_.preempted);
+    cJSON_AddNumberToObject(root, "completed", stats_.completed);
+    cJSON_AddItemToObject(root, "queue_wait", stats_.queue_wait.ToJson());
+    cJSON_AddItemToObject(root, "first_motion", stats_.first_motion.ToJson());
+    cJSON_AddItemToObject(root, "run_time", stats_.run_time.ToJson());
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
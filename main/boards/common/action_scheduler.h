@@ -0,0 +1,105 @@
+#ifndef _ACTION_SCHEDULER_H_
+#define _ACTION_SCHEDULER_H_
+
+#include "event_loop_stats.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#define ACTION_SCHEDULER_MAX_BACKLOG 10         // Queued actions, not counting the running one
+#define ACTION_SCHEDULER_MAX_MERGED_STEPS 100
+
+enum ActionPriority {
+    kActionPriorityNormal = 0,
+    kActionPriorityHigh = 1,        // Stop and home: ahead of the queue, preempts normal actions
+};
+
+struct RobotAction {
+    int type = 0;
+    int steps = 1;
+    int speed = 0;
+    int direction = 0;
+    int amount = 0;
+    ActionPriority priority = kActionPriorityNormal;
+    // steps is a repeat count: an identical action queued last gets these steps
+    // added instead. Other identical actions queued last are dropped
+    bool merge_steps = false;
+};
+
+/*
+ * Runs the actions of a robot board one at a time on its action task, by
+ * priority then in order. Identical actions sent back to back are merged, and
+ * the backlog is bounded: when it is full the oldest action of the lowest
+ * priority makes room, or the new one is rejected if everything queued is more
+ * important.
+ *
+ * An action of higher priority than the running one asks it to stop; the
+ * movements poll ShouldPreempt() at keyframe boundaries, where the pose is
+ * stable, and return early.
+ *
+ * Timing is measured from Enqueue() to the start of the action and to the
+ * first servo movement, reported by the movements through OnMotion().
+ */
+class ActionScheduler {
+public:
+    using Executor = std::function<void(const RobotAction& action)>;
+
+    // on_preempt is called on the enqueuing task, for actions that do not poll
+    // ShouldPreempt()
+    ActionScheduler(const char* task_name, Executor executor, std::function<void()> on_preempt = nullptr);
+    ~ActionScheduler();
+    ActionScheduler(const ActionScheduler&) = delete;
+    ActionScheduler& operator=(const ActionScheduler&) = delete;
+
+    // Never blocks; false if the action was rejected
+    bool Enqueue(const RobotAction& action);
+    // Drops the queued actions, the running one goes on
+    void Clear();
+    bool ShouldPreempt() const { return preempt_; }
+    void OnMotion();
+    bool IsBusy();
+    std::string GetStatsJson();
+
+private:
+    struct QueuedAction {
+        RobotAction action;
+        int64_t enqueue_time_us;
+    };
+
+    struct SchedulerStats {
+        uint32_t enqueued = 0;
+        uint32_t merged = 0;            // Into the last queued action
+        uint32_t dropped = 0;           // To make room, or by Clear()
+        uint32_t rejected = 0;
+        uint32_t preempted = 0;
+        uint32_t completed = 0;
+        LatencyHistogram queue_wait;    // Enqueue until the action starts
+        LatencyHistogram first_motion;  // Enqueue until the first servo movement
+        LatencyHistogram run_time;
+    };
+
+    const char* task_name_;
+    Executor executor_;
+    std::function<void()> on_preempt_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<QueuedAction> queue_;        // Sorted by priority, then in order
+    bool running_ = false;
+    QueuedAction current_{};
+    std::atomic<bool> preempt_{false};
+    std::atomic<bool> motion_pending_{false};   // The running action has not moved a servo yet
+    SchedulerStats stats_;
+    TaskHandle_t task_handle_ = nullptr;    // Started by the first action
+
+    static bool SameAction(const RobotAction& a, const RobotAction& b);
+    void Run();
+};
+
+#endif // _ACTION_SCHEDULER_H_
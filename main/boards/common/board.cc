@@ -3,11 +3,14 @@
 #include "settings.h"
 #include "display/display.h"
 #include "assets/lang_config.h"
+#include "boot_profiler.h"
 
 #include <esp_log.h>
 #include <esp_ota_ops.h>
 #include <esp_chip_info.h>
 #include <esp_random.h>
+#include <esp_timer.h>
+#include <algorithm>
 
 #define TAG "Board"
 
@@ -66,50 +69,14 @@ Led* Board::GetLed() {
     return &led;
 }
 
-std::string Board::GetJson() {
-    /* 
-        {
-            "version": 2,
-            "flash_size": 4194304,
-            "psram_size": 0,
-            "minimum_free_heap_size": 123456,
-            "mac_address": "00:00:00:00:00:00",
-            "uuid": "00000000-0000-0000-0000-000000000000",
-            "chip_model_name": "esp32s3",
-            "chip_info": {
-                "model": 1,
-                "cores": 2,
-                "revision": 0,
-                "features": 0
-            },
-            "application": {
-                "name": "my-app",
-                "version": "1.0.0",
-                "compile_time": "2021-01-01T00:00:00Z"
-                "idf_version": "4.2-dev"
-                "elf_sha256": ""
-            },
-            "partition_table": [
-                "app": {
-                    "label": "app",
-                    "type": 1,
-                    "subtype": 2,
-                    "address": 0x10000,
-                    "size": 0x100000
-                }
-            ],
-            "ota": {
-                "label": "ota_0"
-            },
-            "board": {
-                ...
-            }
-        }
-    */
+void Board::BuildStaticJson() {
+    auto start_time = esp_timer_get_time();
+
     std::string json = R"({"version":2,"language":")" + std::string(Lang::CODE) + R"(",)";
     json += R"("flash_size":)" + std::to_string(SystemInfo::GetFlashSize()) + R"(,)";
-    json += R"("minimum_free_heap_size":")" + std::to_string(SystemInfo::GetMinimumFreeHeapSize()) + R"(",)";
-    json += R"("mac_address":")" + SystemInfo::GetMacAddress() + R"(",)";
+    static_json_head_ = std::move(json);
+
+    json = R"("mac_address":")" + SystemInfo::GetMacAddress() + R"(",)";
     json += R"("uuid":")" + uuid_ + R"(",)";
     json += R"("chip_model_name":")" + SystemInfo::GetChipModelName() + R"(",)";
 
@@ -154,9 +121,79 @@ std::string Board::GetJson() {
     json += R"("label":")" + std::string(ota_partition->label) + R"(")";
     json += R"(},)";
 
-    json += R"("board":)" + GetBoardJson();
+    // Phases of the previous boot, to spot boot time regressions across the fleet
+    json += R"("boot_timeline":)" + BootProfiler::GetInstance().GetTimelineJson(true) + R"(,)";
+    static_json_tail_ = std::move(json);
+
+    static_json_build_us_ = esp_timer_get_time() - start_time;
+}
+
+std::string Board::GetJson() {
+    /* 
+        {
+            "version": 2,
+            "flash_size": 4194304,
+            "psram_size": 0,
+            "minimum_free_heap_size": 123456,
+            "mac_address": "00:00:00:00:00:00",
+            "uuid": "00000000-0000-0000-0000-000000000000",
+            "chip_model_name": "esp32s3",
+            "chip_info": {
+                "model": 1,
+                "cores": 2,
+                "revision": 0,
+                "features": 0
+            },
+            "application": {
+                "name": "my-app",
+                "version": "1.0.0",
+                "compile_time": "2021-01-01T00:00:00Z"
+                "idf_version": "4.2-dev"
+                "elf_sha256": ""
+            },
+            "partition_table": [
+                "app": {
+                    "label": "app",
+                    "type": 1,
+                    "subtype": 2,
+                    "address": 0x10000,
+                    "size": 0x100000
+                }
+            ],
+            "ota": {
+                "label": "ota_0"
+            },
+            "board": {
+                ...
+            }
+        }
+    */
+    std::lock_guard<std::mutex> lock(json_mutex_);
+    auto start_time = esp_timer_get_time();
+    bool first_build = static_json_head_.empty();
+    if (first_build) {
+        BuildStaticJson();
+    }
+
+    // Only the free heap and the board section (network, modem) change between calls
+    std::string board_json = GetBoardJson();
+    std::string json;
+    json.reserve(std::max(last_json_size_, static_json_head_.size() + static_json_tail_.size() + board_json.size() + 64));
+    json += static_json_head_;
+    json += R"("minimum_free_heap_size":")" + std::to_string(SystemInfo::GetMinimumFreeHeapSize()) + R"(",)";
+    json += static_json_tail_;
+    json += R"("board":)" + board_json;
 
     // Close the JSON object
     json += R"(})";
+    last_json_size_ = json.size();
+
+    auto elapsed_us = esp_timer_get_time() - start_time;
+    if (first_build) {
+        ESP_LOGI(TAG, "Device descriptor: %u bytes in %lld us", json.size(), elapsed_us);
+    } else {
+        ESP_LOGI(TAG, "Device descriptor: %u bytes in %lld us, %u bytes cached, saved %lld us", json.size(), elapsed_us,
+            static_json_head_.size() + static_json_tail_.size(), static_json_build_us_);
+    }
     return json;
-}
\ No newline at end of file
+}
@@ -6,6 +6,7 @@
 #include <mqtt.h>
 #include <udp.h>
 #include <string>
+#include <mutex>
 #include <network_interface.h>
 
 #include "led/led.h"
@@ -27,6 +28,16 @@ protected:
     // 软件生成的设备唯一标识
     std::string uuid_;
 
+private:
+    // Parts of GetJson that do not change after boot, built on the first call
+    std::mutex json_mutex_;
+    std::string static_json_head_;
+    std::string static_json_tail_;
+    int64_t static_json_build_us_ = 0;
+    size_t last_json_size_ = 0;
+
+    void BuildStaticJson();
+
 public:
     static Board& GetInstance() {
         static Board* instance = static_cast<Board*>(create_board());
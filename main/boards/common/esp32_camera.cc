@@ -3,6 +3,8 @@
 #include "display.h"
 #include "board.h"
 #include "system_info.h"
+#include "connection_manager.h"
+#include "task_registry.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
@@ -196,6 +198,7 @@ std::string Esp32Camera::Explain(const std::string& question) {
     }
 
     // We spawn a thread to encode the image to JPEG
+    auto previous_pthread_cfg = TaskRegistry::GetInstance().ApplyPthreadConfig("jpeg_encoder");
     encoder_thread_ = std::thread([this, jpeg_queue]() {
         frame2jpg_cb(fb_, 80, [](void* arg, size_t index, const void* data, size_t len) -> unsigned int {
             auto jpeg_queue = (QueueHandle_t)arg;
@@ -208,21 +211,25 @@ std::string Esp32Camera::Explain(const std::string& question) {
             return len;
         }, jpeg_queue);
     });
+    // Threads started later by this tool worker keep their own config
+    esp_pthread_set_cfg(&previous_pthread_cfg);
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(3);
+    auto& connection_manager = ConnectionManager::GetInstance();
+    auto http = connection_manager.AcquireHttp(3, explain_url_, "explain");
     // 构造multipart/form-data请求体
     std::string boundary = "----ESP32_CAMERA_BOUNDARY";
 
     // 配置HTTP客户端，使用分块传输编码
-    http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    http->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
-    if (!explain_token_.empty()) {
-        http->SetHeader("Authorization", "Bearer " + explain_token_);
-    }
-    http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
-    http->SetHeader("Transfer-Encoding", "chunked");
-    if (!http->Open("POST", explain_url_)) {
+    auto setup_http = [this, &boundary](Http* http) {
+        http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+        http->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+        if (!explain_token_.empty()) {
+            http->SetHeader("Authorization", "Bearer " + explain_token_);
+        }
+        http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
+        http->SetHeader("Transfer-Encoding", "chunked");
+    };
+    if (!connection_manager.OpenHttp(http, 3, "POST", explain_url_, setup_http)) {
         ESP_LOGE(TAG, "Failed to connect to explain URL");
         // Clear the queue
         encoder_thread_.join();
@@ -292,7 +299,8 @@ std::string Esp32Camera::Explain(const std::string& question) {
     }
 
     std::string result = http->ReadAll();
-    http->Close();
+    // Keep the connection for the next photo within the same conversation
+    connection_manager.ReleaseHttp(3, explain_url_, "explain", std::move(http));
 
     // Get remain task stack size
     size_t remain_stack_size = uxTaskGetStackHighWaterMark(nullptr);
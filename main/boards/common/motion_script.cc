@@ -0,0 +1,358 @@
+#include "motion_script.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cJSON.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#define TAG "MotionScript"
+
+#define MOTION_MAX_SEGMENT_MS 60000
+
+// Words taken by each opcode, including the opcode
+static int InstructionSize(int opcode) {
+    switch (opcode) {
+        case kMotionMove: return 3;
+        case kMotionWait: return 2;
+        case kMotionLoop: return 2;
+        case kMotionEnd: return 1;
+        case kMotionOscillate: return 4;
+        default: return 0;
+    }
+}
+
+static void CheckRange(const char* what, int value, int min_value, int max_value) {
+    if (value < min_value || value > max_value) {
+        throw std::invalid_argument(std::string(what) + " out of range: " + std::to_string(value) +
+            " (" + std::to_string(min_value) + "-" + std::to_string(max_value) + ")");
+    }
+}
+
+MotionScriptPlayer::MotionScriptPlayer(int servo_count, ServoReader read, ServoWriter write)
+    : servo_count_(servo_count), read_(std::move(read)), write_(std::move(write)) {
+}
+
+MotionScriptPlayer::~MotionScriptPlayer() {
+    for (auto& slot : slots_) {
+        heap_caps_free(slot.words);
+    }
+}
+
+// Returns the duration of the longest track
+uint32_t MotionScriptPlayer::Validate(const std::vector<int>& program) {
+    if (program.size() < 2 || program.size() > MOTION_SCRIPT_MAX_WORDS) {
+        throw std::invalid_argument("Program must have 2 to " + std::to_string(MOTION_SCRIPT_MAX_WORDS) + " words");
+    }
+    if (program[0] != 1) {
+        throw std::invalid_argument("Unsupported program version: " + std::to_string(program[0]));
+    }
+    int track_count = program[1];
+    CheckRange("Track count", track_count, 1, servo_count_);
+
+    uint64_t longest_ms = 0;
+    uint32_t used_servos = 0;
+    size_t pos = 2;
+    for (int track = 0; track < track_count; track++) {
+        if (pos + 2 > program.size()) {
+            throw std::invalid_argument("Track " + std::to_string(track) + ": missing header");
+        }
+        int servo = program[pos];
+        CheckRange("Servo", servo, 0, servo_count_ - 1);
+        if (used_servos & (1u << servo)) {
+            throw std::invalid_argument("Servo " + std::to_string(servo) + " has more than one track");
+        }
+        used_servos |= 1u << servo;
+        int size = program[pos + 1];
+        pos += 2;
+        if (size < 0 || pos + size > program.size()) {
+            throw std::invalid_argument("Track " + std::to_string(track) + ": size beyond the program");
+        }
+
+        // Duration of each open loop body, [0] is the track itself
+        uint64_t duration_ms[MOTION_SCRIPT_MAX_LOOP_DEPTH + 1] = {};
+        int loop_count[MOTION_SCRIPT_MAX_LOOP_DEPTH + 1] = {};
+        int depth = 0;
+        size_t end = pos + size;
+        while (pos < end) {
+            int opcode = program[pos];
+            int length = InstructionSize(opcode);
+            if (length == 0) {
+                throw std::invalid_argument("Unknown opcode " + std::to_string(opcode) + " at word " + std::to_string(pos));
+            }
+            if (pos + length > end) {
+                throw std::invalid_argument("Truncated instruction at word " + std::to_string(pos));
+            }
+            const int* args = &program[pos + 1];
+            switch (opcode) {
+                case kMotionMove:
+                    CheckRange("Position", args[0], 0, 180);
+                    CheckRange("Move duration", args[1], 0, MOTION_MAX_SEGMENT_MS);
+                    duration_ms[depth] += args[1];
+                    break;
+                case kMotionWait:
+                    CheckRange("Wait duration", args[0], 0, MOTION_MAX_SEGMENT_MS);
+                    duration_ms[depth] += args[0];
+                    break;
+                case kMotionLoop:
+                    CheckRange("Loop count", args[0], 1, 100);
+                    if (depth == MOTION_SCRIPT_MAX_LOOP_DEPTH) {
+                        throw std::invalid_argument("Loops nested too deep");
+                    }
+                    depth++;
+                    duration_ms[depth] = 0;
+                    loop_count[depth] = args[0];
+                    break;
+                case kMotionEnd:
+                    if (depth == 0) {
+                        throw std::invalid_argument("END without LOOP at word " + std::to_string(pos));
+                    }
+                    if (duration_ms[depth] == 0) {
+                        // It would spin on the player task
+                        throw std::invalid_argument("Loop without duration at word " + std::to_string(pos));
+                    }
+                    duration_ms[depth - 1] += duration_ms[depth] * loop_count[depth];
+                    depth--;
+                    break;
+                case kMotionOscillate:
+                    CheckRange("Amplitude", args[0], 0, 90);
+                    CheckRange("Period", args[1], 100, 10000);
+                    CheckRange("Cycles", args[2], 1, 100);
+                    duration_ms[depth] += (uint64_t)args[1] * args[2];
+                    break;
+            }
+            pos += length;
+        }
+        if (depth != 0) {
+            throw std::invalid_argument("Track " + std::to_string(track) + ": LOOP without END");
+        }
+        longest_ms = std::max(longest_ms, duration_ms[0]);
+    }
+    if (pos != program.size()) {
+        throw std::invalid_argument("Extra words after the last track");
+    }
+    if (longest_ms > MOTION_SCRIPT_MAX_DURATION_MS) {
+        throw std::invalid_argument("Script is longer than " + std::to_string(MOTION_SCRIPT_MAX_DURATION_MS / 1000) + " s");
+    }
+    return longest_ms;
+}
+
+uint32_t MotionScriptPlayer::Upload(const std::string& name, const std::vector<int>& program) {
+    uint32_t duration_ms = Validate(program);
+
+    auto words = (int32_t*)heap_caps_malloc(program.size() * sizeof(int32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (words == nullptr) {
+        words = (int32_t*)heap_caps_malloc(program.size() * sizeof(int32_t), MALLOC_CAP_8BIT);
+        if (words == nullptr) {
+            throw std::runtime_error("Out of memory");
+        }
+    }
+    std::copy(program.begin(), program.end(), words);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The slot of the same name, or the one uploaded first
+    Slot* target = &slots_[0];
+    for (auto& slot : slots_) {
+        if (slot.id != 0 && slot.name == name) {
+            target = &slot;
+            break;
+        }
+        if (slot.id < target->id) {
+            target = &slot;
+        }
+    }
+    heap_caps_free(target->words);
+    target->id = next_id_++;
+    target->name = name;
+    target->words = words;
+    target->size = program.size();
+    target->duration_ms = duration_ms;
+    ESP_LOGI(TAG, "Uploaded %s: %u words, %lu ms", name.c_str(), program.size(), duration_ms);
+    return target->id;
+}
+
+uint32_t MotionScriptPlayer::Find(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& slot : slots_) {
+        if (slot.id != 0 && slot.name == name) {
+            return slot.id;
+        }
+    }
+    return 0;
+}
+
+void MotionScriptPlayer::Abort() {
+    if (playing_) {
+        abort_ = true;
+    }
+}
+
+bool MotionScriptPlayer::Play(uint32_t id, std::function<bool()> should_stop) {
+    // A copy, so the slot can be replaced while it plays
+    std::vector<int32_t> program;
+    std::string name;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& slot : slots_) {
+            if (slot.id == id) {
+                program.assign(slot.words, slot.words + slot.size);
+                name = slot.name;
+                break;
+            }
+        }
+    }
+    if (program.empty()) {
+        ESP_LOGW(TAG, "Script %lu was replaced before it was played", id);
+        return false;
+    }
+
+    struct LoopFrame {
+        size_t start;
+        int remaining;
+    };
+    struct Track {
+        int servo;
+        size_t pc;
+        size_t end;
+        LoopFrame loops[MOTION_SCRIPT_MAX_LOOP_DEPTH];
+        int depth = 0;
+        int opcode = kMotionWait;
+        int64_t start_ms = 0;       // Of the current segment, from the start of the script
+        int64_t end_ms = 0;
+        int from = 0;               // MOVE: start position, OSCILLATE: center
+        int to = 0;
+        int amplitude = 0;
+        int period_ms = 0;
+        int position = -1;          // Last written, -1 if the servo is not fitted
+        bool done = false;
+    };
+
+    // Validated on upload
+    std::vector<Track> tracks(program[1]);
+    size_t pos = 2;
+    for (auto& track : tracks) {
+        track.servo = program[pos];
+        track.pc = pos + 2;
+        track.end = track.pc + program[pos + 1];
+        track.position = read_(track.servo);
+        track.from = track.to = track.position;
+        pos = track.end;
+    }
+
+    // Starts the segments that are due, the next one starts where the previous one ended, not when it was noticed
+    auto advance = [&program](Track& track, int64_t now_ms) {
+        while (!track.done && now_ms >= track.end_ms) {
+            if (track.opcode == kMotionMove) {
+                track.from = track.to;
+            }
+            track.start_ms = track.end_ms;
+            if (track.pc >= track.end) {
+                track.done = true;
+                break;
+            }
+            const int32_t* instruction = &program[track.pc];
+            track.pc += InstructionSize(instruction[0]);
+            track.opcode = instruction[0];
+            switch (instruction[0]) {
+                case kMotionMove:
+                    track.to = instruction[1];
+                    track.end_ms = track.start_ms + instruction[2];
+                    break;
+                case kMotionWait:
+                    track.end_ms = track.start_ms + instruction[1];
+                    break;
+                case kMotionLoop:
+                    track.loops[track.depth++] = { track.pc, instruction[1] };
+                    break;
+                case kMotionEnd:
+                    if (--track.loops[track.depth - 1].remaining > 0) {
+                        track.pc = track.loops[track.depth - 1].start;
+                    } else {
+                        track.depth--;
+                    }
+                    break;
+                case kMotionOscillate:
+                    track.amplitude = instruction[1];
+                    track.period_ms = instruction[2];
+                    track.end_ms = track.start_ms + (int64_t)instruction[2] * instruction[3];
+                    break;
+            }
+        }
+    };
+
+    ESP_LOGI(TAG, "Playing %s", name.c_str());
+    playing_ = true;
+    abort_ = false;
+    auto start_us = esp_timer_get_time();
+    TickType_t last_wake = xTaskGetTickCount();
+    bool finished = false;
+    // should_stop also covers a stop that came before playing_ was set, which Abort() misses
+    while (!abort_ && !(should_stop && should_stop())) {
+        int64_t now_ms = (esp_timer_get_time() - start_us) / 1000;
+        finished = true;
+        for (auto& track : tracks) {
+            advance(track, now_ms);
+            if (track.done) {
+                continue;
+            }
+            finished = false;
+            if (track.position < 0) {
+                continue;
+            }
+
+            int position = track.from;
+            int64_t elapsed_ms = now_ms - track.start_ms;
+            if (track.opcode == kMotionMove && track.end_ms > track.start_ms) {
+                position = track.from + (track.to - track.from) * elapsed_ms / (track.end_ms - track.start_ms);
+            } else if (track.opcode == kMotionOscillate) {
+                position = track.from + std::lround(track.amplitude * std::sin(2 * M_PI * elapsed_ms / track.period_ms));
+                position = std::max(0, std::min(180, position));
+            }
+            if (position != track.position) {
+                write_(track.servo, position);
+                track.position = position;
+            }
+        }
+        if (finished) {
+            break;
+        }
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(MOTION_SCRIPT_TICK_MS));
+    }
+
+    // Land on the final positions of the tracks that ended
+    for (auto& track : tracks) {
+        if (track.done && track.position >= 0 && track.position != track.from) {
+            write_(track.servo, track.from);
+        }
+    }
+    playing_ = false;
+    abort_ = false;
+    ESP_LOGI(TAG, "%s %s", name.c_str(), finished ? "finished" : "aborted");
+    return finished;
+}
+
+std::string MotionScriptPlayer::GetListJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateArray();
+    for (auto& slot : slots_) {
+        if (slot.id == 0) {
+            continue;
+        }
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", slot.name.c_str());
+        cJSON_AddNumberToObject(item, "words", slot.size);
+        cJSON_AddNumberToObject(item, "duration_ms", slot.duration_ms);
+        cJSON_AddItemToArray(root, item);
+    }
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,90 @@
+#ifndef _MOTION_SCRIPT_H_
+#define _MOTION_SCRIPT_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define MOTION_SCRIPT_SLOTS 4               // Uploaded scripts kept, the oldest is replaced
+#define MOTION_SCRIPT_MAX_WORDS 1024
+#define MOTION_SCRIPT_MAX_LOOP_DEPTH 4
+#define MOTION_SCRIPT_MAX_DURATION_MS (5 * 60 * 1000)
+#define MOTION_SCRIPT_TICK_MS 20
+
+/*
+ * Choreographies uploaded once by the server and played on the device, so a
+ * dance does not take a round trip per move.
+ *
+ * A program is a list of integers:
+ *
+ *   version (1), track_count,
+ *   then for each track: servo, word_count, word_count words of instructions
+ *
+ * The tracks run in parallel, each driving one servo, all timed from the
+ * start of the script on the esp_timer clock, so they do not drift apart.
+ * Instructions:
+ *
+ *   1 MOVE position duration_ms        Linear move from the current position
+ *   2 WAIT duration_ms                 Hold the position
+ *   3 LOOP count                       Repeat up to the matching END, count 1-100
+ *   4 END
+ *   5 OSCILLATE amplitude period_ms cycles
+ *                                      Sine around the current position
+ *
+ * Positions are servo angles from 0 to 180.
+ */
+enum MotionOpcode {
+    kMotionMove = 1,
+    kMotionWait = 2,
+    kMotionLoop = 3,
+    kMotionEnd = 4,
+    kMotionOscillate = 5,
+};
+
+class MotionScriptPlayer {
+public:
+    using ServoReader = std::function<int(int servo)>;      // -1 if the servo is not fitted
+    using ServoWriter = std::function<void(int servo, int position)>;
+
+    MotionScriptPlayer(int servo_count, ServoReader read, ServoWriter write);
+    ~MotionScriptPlayer();
+    MotionScriptPlayer(const MotionScriptPlayer&) = delete;
+    MotionScriptPlayer& operator=(const MotionScriptPlayer&) = delete;
+
+    // Checks the program and stores it under the name, replacing the script of the same
+    // name or the oldest one. Returns the id to play it; throws std::invalid_argument
+    uint32_t Upload(const std::string& name, const std::vector<int>& program);
+    // 0 if there is no script with this name
+    uint32_t Find(const std::string& name);
+    // Runs on the calling task until the script ends, Abort() is called or should_stop returns
+    // true, polled every tick. False if it was not played to the end
+    bool Play(uint32_t id, std::function<bool()> should_stop = nullptr);
+    void Abort();
+    bool IsPlaying() const { return playing_; }
+    std::string GetListJson();
+
+private:
+    struct Slot {
+        uint32_t id = 0;
+        std::string name;
+        int32_t* words = nullptr;       // In PSRAM where present
+        size_t size = 0;
+        uint32_t duration_ms = 0;
+    };
+
+    int servo_count_;
+    ServoReader read_;
+    ServoWriter write_;
+    std::mutex mutex_;
+    Slot slots_[MOTION_SCRIPT_SLOTS];
+    uint32_t next_id_ = 1;
+    std::atomic<bool> playing_{false};
+    std::atomic<bool> abort_{false};
+
+    uint32_t Validate(const std::vector<int>& program);
+};
+
+#endif // _MOTION_SCRIPT_H_
@@ -1,5 +1,6 @@
 #include "power_save_timer.h"
 #include "application.h"
+#include "settings.h"
 
 #include <esp_log.h>
 
@@ -78,6 +79,8 @@ void PowerSaveTimer::PowerSaveCheck() {
         }
     }
     if (seconds_to_shutdown_ != -1 && ticks_ >= seconds_to_shutdown_ && on_shutdown_request_) {
+        // The boards power off or enter deep sleep here, neither runs the shutdown handlers
+        SettingsStore::GetInstance().Flush();
         on_shutdown_request_();
     }
 }
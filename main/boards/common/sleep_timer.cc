@@ -2,6 +2,7 @@
 #include "application.h"
 #include "board.h"
 #include "display.h"
+#include "settings.h"
 
 #include <esp_log.h>
 #include <esp_sleep.h>
@@ -99,6 +100,8 @@ void SleepTimer::CheckTimer() {
             on_enter_deep_sleep_mode_();
         }
 
+        // Deep sleep does not run the shutdown handlers
+        SettingsStore::GetInstance().Flush();
         esp_deep_sleep_start();
     }
 }
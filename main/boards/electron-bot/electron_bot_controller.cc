@@ -7,31 +7,24 @@
 
 #include <cstring>
 
+#include "action_scheduler.h"
 #include "application.h"
 #include "board.h"
 #include "config.h"
 #include "mcp_server.h"
+#include "motion_script.h"
 #include "movements.h"
 #include "sdkconfig.h"
 #include "settings.h"
 
 #define TAG "ElectronBotController"
 
-struct ElectronBotActionParams {
-    int action_type;
-    int steps;
-    int speed;
-    int direction;
-    int amount;
-};
-
 class ElectronBotController {
 private:
     Otto electron_bot_;
-    TaskHandle_t action_task_handle_ = nullptr;
-    QueueHandle_t action_queue_;
-    bool is_action_in_progress_ = false;
-
+    MotionScriptPlayer script_player_{SERVO_COUNT,
+                                      [this](int servo) { return electron_bot_.GetServoPosition(servo); },
+                                      [this](int servo, int position) { electron_bot_.MoveSingle(position, servo); }};
     enum ActionType {
         // 手部动作 1-12
         ACTION_HAND_LEFT_UP = 1,      // 举左手
@@ -60,60 +53,52 @@ private:
         ACTION_HEAD_NOD_REPEAT = 20,  // 连续点头
 
         // 系统动作 21
-        ACTION_HOME = 21  // 复位到初始位置
+        ACTION_HOME = 21,  // 复位到初始位置
+
+        // 动作脚本 22
+        ACTION_SCRIPT = 22  // amount: 脚本 id
     };
 
-    static void ActionTask(void* arg) {
-        ElectronBotController* controller = static_cast<ElectronBotController*>(arg);
-        ElectronBotActionParams params;
-        controller->electron_bot_.AttachServos();
-
-        while (true) {
-            if (xQueueReceive(controller->action_queue_, &params, pdMS_TO_TICKS(1000)) == pdTRUE) {
-                ESP_LOGI(TAG, "执行动作: %d", params.action_type);
-                controller->is_action_in_progress_ = true;  // 开始执行动作
-
-                // 执行相应的动作
-                if (params.action_type >= ACTION_HAND_LEFT_UP &&
-                    params.action_type <= ACTION_HAND_BOTH_FLAP) {
-                    // 手部动作
-                    controller->electron_bot_.HandAction(params.action_type, params.steps,
-                                                         params.amount, params.speed);
-                } else if (params.action_type >= ACTION_BODY_TURN_LEFT &&
-                           params.action_type <= ACTION_BODY_TURN_CENTER) {
-                    // 身体动作
-                    int body_direction = params.action_type - ACTION_BODY_TURN_LEFT + 1;
-                    controller->electron_bot_.BodyAction(body_direction, params.steps,
-                                                         params.amount, params.speed);
-                } else if (params.action_type >= ACTION_HEAD_UP &&
-                           params.action_type <= ACTION_HEAD_NOD_REPEAT) {
-                    // 头部动作
-                    int head_action = params.action_type - ACTION_HEAD_UP + 1;
-                    controller->electron_bot_.HeadAction(head_action, params.steps, params.amount,
-                                                         params.speed);
-                } else if (params.action_type == ACTION_HOME) {
-                    // 复位动作
-                    controller->electron_bot_.Home(true);
-                }
-                controller->is_action_in_progress_ = false;  // 动作执行完毕
-            }
-            vTaskDelay(pdMS_TO_TICKS(20));
+    ActionScheduler scheduler_{"electron_action",
+                               [this](const RobotAction& action) { ExecuteAction(action); }};
+
+    void ExecuteAction(const RobotAction& params) {
+        if (params.type >= ACTION_HAND_LEFT_UP && params.type <= ACTION_HAND_BOTH_FLAP) {
+            // 手部动作
+            electron_bot_.HandAction(params.type, params.steps, params.amount, params.speed);
+        } else if (params.type >= ACTION_BODY_TURN_LEFT && params.type <= ACTION_BODY_TURN_CENTER) {
+            // 身体动作
+            int body_direction = params.type - ACTION_BODY_TURN_LEFT + 1;
+            electron_bot_.BodyAction(body_direction, params.steps, params.amount, params.speed);
+        } else if (params.type >= ACTION_HEAD_UP && params.type <= ACTION_HEAD_NOD_REPEAT) {
+            // 头部动作
+            int head_action = params.type - ACTION_HEAD_UP + 1;
+            electron_bot_.HeadAction(head_action, params.steps, params.amount, params.speed);
+        } else if (params.type == ACTION_HOME) {
+            // 复位动作
+            electron_bot_.Home(true);
+        } else if (params.type == ACTION_SCRIPT) {
+            script_player_.Play(params.amount, [this]() { return scheduler_.ShouldPreempt(); });
         }
     }
 
-    void QueueAction(int action_type, int steps, int speed, int direction, int amount) {
+    void QueueAction(int action_type, int steps, int speed, int direction, int amount,
+                     ActionPriority priority = kActionPriorityNormal) {
         ESP_LOGI(TAG, "动作控制: 类型=%d, 步数=%d, 速度=%d, 方向=%d, 幅度=%d", action_type, steps,
                  speed, direction, amount);
 
-        ElectronBotActionParams params = {action_type, steps, speed, direction, amount};
-        xQueueSend(action_queue_, &params, portMAX_DELAY);
-        StartActionTaskIfNeeded();
-    }
-
-    void StartActionTaskIfNeeded() {
-        if (action_task_handle_ == nullptr) {
-            xTaskCreate(ActionTask, "electron_bot_action", 1024 * 4, this, configMAX_PRIORITIES - 1,
-                        &action_task_handle_);
+        RobotAction action;
+        action.type = action_type;
+        action.steps = steps;
+        action.speed = speed;
+        action.direction = direction;
+        action.amount = amount;
+        action.priority = priority;
+        // 挥手、拍打和连续点头的 steps 是重复次数，连续相同的请求合并为一个
+        action.merge_steps = (action_type >= ACTION_HAND_LEFT_WAVE && action_type <= ACTION_HAND_BOTH_FLAP) ||
+                             action_type == ACTION_HEAD_NOD_REPEAT;
+        if (!scheduler_.Enqueue(action)) {
+            throw std::runtime_error("Action backlog is full");
         }
     }
 
@@ -135,7 +120,9 @@ public:
                            Head_Pin);
 
         LoadTrimsFromNVS();
-        action_queue_ = xQueueCreate(10, sizeof(ElectronBotActionParams));
+        electron_bot_.AttachServos();
+        electron_bot_.SetPreemptCheck([this]() { return scheduler_.ShouldPreempt(); });
+        electron_bot_.SetMotionCallback([this]() { scheduler_.OnMotion(); });
 
         QueueAction(ACTION_HOME, 1, 1000, 0, 0);
 
@@ -247,18 +234,57 @@ public:
                            });
 
         // 系统工具
+        // 动作脚本：上传一次，在设备上按本地时钟播放，编舞时不需要每个动作都请求一次
+        mcp_server.AddTool(
+            "self.electron.upload_motion_script",
+            "上传动作脚本，之后用 self.electron.play_motion_script 播放，同名脚本会被替换，"
+            "最多保存 4 个。name: 脚本名称; program: 整数数组 [1, 轨道数, 每个轨道: 舵机编号, 指令字数, 指令...]，"
+            "各轨道并行执行。指令: 1,角度(0-180),时长ms=移动; 2,时长ms=保持; 3,次数=循环开始; 4=循环结束; "
+            "5,幅度,周期ms,次数=围绕当前角度摆动。舵机编号: 0=右臂俯仰, 1=右臂横滚, 2=左臂俯仰, 3=左臂横滚, 4=身体, 5=头部",
+            PropertyList({Property("name", kPropertyTypeString),
+                          Property::Array("program", kPropertyTypeInteger, 2, MOTION_SCRIPT_MAX_WORDS)}),
+            [this](const PropertyList& properties) -> ReturnValue {
+                script_player_.Upload(properties["name"].value<std::string>(),
+                                      properties["program"].value<std::vector<int>>());
+                return script_player_.GetListJson();
+            });
+
+        mcp_server.AddTool("self.electron.play_motion_script",
+                           "播放已上传的动作脚本，可以用 self.electron.stop 中止。name: 脚本名称",
+                           PropertyList({Property("name", kPropertyTypeString)}),
+                           [this](const PropertyList& properties) -> ReturnValue {
+                               auto name = properties["name"].value<std::string>();
+                               uint32_t id = script_player_.Find(name);
+                               if (id == 0) {
+                                   throw std::runtime_error("Unknown motion script: " + name);
+                               }
+                               QueueAction(ACTION_SCRIPT, 1, 0, 0, id);
+                               return true;
+                           });
+
+        mcp_server.AddTool("self.electron.list_motion_scripts", "获取已上传的动作脚本及其时长",
+                           PropertyList(), [this](const PropertyList& properties) -> ReturnValue {
+                               return script_player_.GetListJson();
+                           });
+
         mcp_server.AddTool("self.electron.stop", "立即停止", PropertyList(),
                            [this](const PropertyList& properties) -> ReturnValue {
-                               // 清空队列但保持任务常驻
-                               xQueueReset(action_queue_);
-                               is_action_in_progress_ = false;
-                               QueueAction(ACTION_HOME, 1, 1000, 0, 0);
+                               // 丢弃排队的动作，正在执行的动作在下一个关键帧停下
+                               scheduler_.Clear();
+                               QueueAction(ACTION_HOME, 1, 1000, 0, 0, kActionPriorityHigh);
                                return true;
                            });
 
         mcp_server.AddTool("self.electron.get_status", "获取机器人状态，返回 moving 或 idle",
                            PropertyList(), [this](const PropertyList& properties) -> ReturnValue {
-                               return is_action_in_progress_ ? "moving" : "idle";
+                               return scheduler_.IsBusy() ? "moving" : "idle";
+                           });
+
+        mcp_server.AddTool("self.electron.get_action_stats",
+                           "获取动作调度统计：排队、合并、丢弃、拒绝、被抢占和完成的动作数，"
+                           "以及从请求到开始执行、到舵机开始运动和执行时长的延迟分布(微秒)",
+                           PropertyList(), [this](const PropertyList& properties) -> ReturnValue {
+                               return scheduler_.GetStatsJson();
                            });
 
         // 单个舵机校准工具
@@ -268,7 +294,7 @@ public:
             "servo_type: 舵机类型(right_pitch:右臂旋转, right_roll:右臂推拉, left_pitch:左臂旋转, "
             "left_roll:左臂推拉, body:身体, head:头部); "
             "trim_value: 微调值(-30到30度)",
-            PropertyList({Property("servo_type", kPropertyTypeString, "right_pitch"),
+            PropertyList({Property::Enum("servo_type", {"right_pitch", "right_roll", "left_pitch", "left_roll", "body", "head"}, "right_pitch"),
                           Property("trim_value", kPropertyTypeInteger, 0, -30, 30)}),
             [this](const PropertyList& properties) -> ReturnValue {
                 std::string servo_type = properties["servo_type"].value<std::string>();
@@ -356,14 +382,6 @@ public:
 
         ESP_LOGI(TAG, "Electron Bot MCP工具注册完成");
     }
-
-    ~ElectronBotController() {
-        if (action_task_handle_ != nullptr) {
-            vTaskDelete(action_task_handle_);
-            action_task_handle_ = nullptr;
-        }
-        vQueueDelete(action_queue_);
-    }
 };
 
 static ElectronBotController* g_electron_controller = nullptr;
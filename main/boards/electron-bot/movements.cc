@@ -78,6 +78,7 @@ void Otto::SetTrims(int right_pitch, int right_roll, int left_pitch, int left_ro
 //-- BASIC MOTION FUNCTIONS -------------------------------------//
 ///////////////////////////////////////////////////////////////////
 void Otto::MoveServos(int time, int servo_target[]) {
+    NotifyMotion();
     if (GetRestState() == true) {
         SetRestState(false);
     }
@@ -141,13 +142,22 @@ void Otto::MoveSingle(int position, int servo_number) {
         SetRestState(false);
     }
 
+    NotifyMotion();
     if (servo_number >= 0 && servo_number < SERVO_COUNT && servo_pins_[servo_number] != -1) {
         servo_[servo_number].SetPosition(position);
     }
 }
 
+int Otto::GetServoPosition(int servo_number) {
+    if (servo_number < 0 || servo_number >= SERVO_COUNT || servo_pins_[servo_number] == -1) {
+        return -1;
+    }
+    return servo_[servo_number].GetPosition();
+}
+
 void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                            double phase_diff[SERVO_COUNT], float cycle = 1) {
+    NotifyMotion();
     for (int i = 0; i < SERVO_COUNT; i++) {
         if (servo_pins_[i] != -1) {
             servo_[i].SetO(offset[i]);
@@ -179,10 +189,16 @@ void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int peri
 
     int cycles = (int)steps;
 
-    //-- Execute complete cycles
-    if (cycles >= 1)
-        for (int i = 0; i < cycles; i++)
-            OscillateServos(amplitude, offset, period, phase_diff);
+    //-- Execute complete cycles, each one ends back at the offsets
+    for (int i = 0; i < cycles; i++) {
+        if (Preempted()) {
+            return;
+        }
+        OscillateServos(amplitude, offset, period, phase_diff);
+    }
+    if (Preempted()) {
+        return;
+    }
 
     //-- Execute the final not complete cycle
     OscillateServos(amplitude, offset, period, phase_diff, (float)steps - cycles);
@@ -261,7 +277,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
         case 7:  // 挥左手
             current_positions[LEFT_PITCH] = 150;
             MoveServos(period, current_positions);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !Preempted(); i++) {
                 current_positions[LEFT_PITCH] = 150 + (i % 2 == 0 ? -30 : 30);
                 MoveServos(period / 10, current_positions);
                 vTaskDelay(pdMS_TO_TICKS(period / 10));
@@ -273,7 +289,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
         case 8:  // 挥右手
             current_positions[RIGHT_PITCH] = 30;
             MoveServos(period, current_positions);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !Preempted(); i++) {
                 current_positions[RIGHT_PITCH] = 30 + (i % 2 == 0 ? 30 : -30);
                 MoveServos(period / 10, current_positions);
                 vTaskDelay(pdMS_TO_TICKS(period / 10));
@@ -286,7 +302,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
             current_positions[LEFT_PITCH] = 150;
             current_positions[RIGHT_PITCH] = 30;
             MoveServos(period, current_positions);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !Preempted(); i++) {
                 current_positions[LEFT_PITCH] = 150 + (i % 2 == 0 ? -30 : 30);
                 current_positions[RIGHT_PITCH] = 30 + (i % 2 == 0 ? 30 : -30);
                 MoveServos(period / 10, current_positions);
@@ -299,7 +315,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
         case 10:  // 拍打左手
             current_positions[LEFT_ROLL] = 20;
             MoveServos(period, current_positions);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !Preempted(); i++) {
                 current_positions[LEFT_ROLL] = 20 - amount;
                 MoveServos(period / 10, current_positions);
                 current_positions[LEFT_ROLL] = 20 + amount;
@@ -312,7 +328,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
         case 11:  // 拍打右手
             current_positions[RIGHT_ROLL] = 160;
             MoveServos(period, current_positions);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !Preempted(); i++) {
                 current_positions[RIGHT_ROLL] = 160 + amount;
                 MoveServos(period / 10, current_positions);
                 current_positions[RIGHT_ROLL] = 160 - amount;
@@ -326,7 +342,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
             current_positions[LEFT_ROLL] = 20;
             current_positions[RIGHT_ROLL] = 160;
             MoveServos(period, current_positions);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !Preempted(); i++) {
                 current_positions[LEFT_ROLL] = 20 - amount;
                 current_positions[RIGHT_ROLL] = 160 + amount;
                 MoveServos(period / 10, current_positions);
@@ -446,7 +462,7 @@ void Otto::HeadAction(int action, int times, int amount, int period) {
             break;
 
         case 5:  // 连续点头
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !Preempted(); i++) {
                 // 抬头
                 current_positions[HEAD] = head_center + amount;
                 MoveServos(period / 2, current_positions);
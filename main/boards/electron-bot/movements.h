@@ -8,6 +8,8 @@
 #include "freertos/task.h"
 #include "oscillator.h"
 
+#include <functional>
+
 //-- Constants
 #define FORWARD 1
 #define BACKWARD -1
@@ -48,6 +50,7 @@ public:
     //-- Predetermined Motion Functions
     void MoveServos(int time, int servo_target[]);
     void MoveSingle(int position, int servo_number);
+    int GetServoPosition(int servo_number);  // -1 if the servo is not connected
     void OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                          double phase_diff[SERVO_COUNT], float cycle);
 
@@ -69,6 +72,12 @@ public:
     void HeadAction(int action, int times = 1, int amount = 10, int period = 500);
     // action: 1=抬头, 2=低头, 3=点头, 4=回中心, 5=连续点头
 
+    //-- Action scheduler hooks
+    // Polled at keyframe boundaries, where the pose is stable; a repeating movement returns early when it is true
+    void SetPreemptCheck(std::function<bool()> check) { preempt_check_ = std::move(check); }
+    // Called before the servos are driven
+    void SetMotionCallback(std::function<void()> callback) { on_motion_ = std::move(callback); }
+
 private:
     Oscillator servo_[SERVO_COUNT];
 
@@ -84,6 +93,16 @@ private:
 
     void Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                  double phase_diff[SERVO_COUNT], float steps);
+
+    std::function<bool()> preempt_check_;
+    std::function<void()> on_motion_;
+
+    bool Preempted() { return preempt_check_ && preempt_check_(); }
+    void NotifyMotion() {
+        if (on_motion_) {
+            on_motion_();
+        }
+    }
 };
 
 #endif  // __MOVEMENTS_H__
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "application.h"
 #include "button.h"
 #include "config.h"
+#include "settings.h"
 #include "sdkconfig.h"
 
 #include <wifi_station.h>
@@ -102,6 +103,7 @@ private:
                 if ((now - last_key_press_time) < LONG_PRESS_TIMEOUT_US) {
                     ESP_LOGW(TAG, "Key button long pressed the second time within 5s, shutting down...");
                     led->SetSingleColor(0, {0, 0, 0});
+                    SettingsStore::GetInstance().Flush();
 
                     gpio_hold_dis(MCU_VCC_CTL);
                     gpio_set_level(MCU_VCC_CTL, 0);
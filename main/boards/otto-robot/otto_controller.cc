@@ -7,10 +7,12 @@
 
 #include <cstring>
 
+#include "action_scheduler.h"
 #include "application.h"
 #include "board.h"
 #include "config.h"
 #include "mcp_server.h"
+#include "motion_script.h"
 #include "otto_movements.h"
 #include "sdkconfig.h"
 #include "settings.h"
@@ -20,18 +22,10 @@
 class OttoController {
 private:
     Otto otto_;
-    TaskHandle_t action_task_handle_ = nullptr;
-    QueueHandle_t action_queue_;
+    MotionScriptPlayer script_player_{SERVO_COUNT,
+                                      [this](int servo) { return otto_.GetServoPosition(servo); },
+                                      [this](int servo, int position) { otto_.MoveSingle(position, servo); }};
     bool has_hands_ = false;
-    bool is_action_in_progress_ = false;
-
-    struct OttoActionParams {
-        int action_type;
-        int steps;
-        int speed;
-        int direction;
-        int amount;
-    };
 
     enum ActionType {
         ACTION_WALK = 1,
@@ -50,100 +44,84 @@ private:
         ACTION_HANDS_UP = 14,
         ACTION_HANDS_DOWN = 15,
         ACTION_HAND_WAVE = 16,
-        ACTION_HOME = 17
+        ACTION_HOME = 17,
+        ACTION_SCRIPT = 18  // amount: 脚本 id
     };
 
-    static void ActionTask(void* arg) {
-        OttoController* controller = static_cast<OttoController*>(arg);
-        OttoActionParams params;
-        controller->otto_.AttachServos();
-
-        while (true) {
-            if (xQueueReceive(controller->action_queue_, &params, pdMS_TO_TICKS(1000)) == pdTRUE) {
-                ESP_LOGI(TAG, "执行动作: %d", params.action_type);
-                controller->is_action_in_progress_ = true;
-
-                switch (params.action_type) {
-                    case ACTION_WALK:
-                        controller->otto_.Walk(params.steps, params.speed, params.direction,
-                                               params.amount);
-                        break;
-                    case ACTION_TURN:
-                        controller->otto_.Turn(params.steps, params.speed, params.direction,
-                                               params.amount);
-                        break;
-                    case ACTION_JUMP:
-                        controller->otto_.Jump(params.steps, params.speed);
-                        break;
-                    case ACTION_SWING:
-                        controller->otto_.Swing(params.steps, params.speed, params.amount);
-                        break;
-                    case ACTION_MOONWALK:
-                        controller->otto_.Moonwalker(params.steps, params.speed, params.amount,
-                                                     params.direction);
-                        break;
-                    case ACTION_BEND:
-                        controller->otto_.Bend(params.steps, params.speed, params.direction);
-                        break;
-                    case ACTION_SHAKE_LEG:
-                        controller->otto_.ShakeLeg(params.steps, params.speed, params.direction);
-                        break;
-                    case ACTION_UPDOWN:
-                        controller->otto_.UpDown(params.steps, params.speed, params.amount);
-                        break;
-                    case ACTION_TIPTOE_SWING:
-                        controller->otto_.TiptoeSwing(params.steps, params.speed, params.amount);
-                        break;
-                    case ACTION_JITTER:
-                        controller->otto_.Jitter(params.steps, params.speed, params.amount);
-                        break;
-                    case ACTION_ASCENDING_TURN:
-                        controller->otto_.AscendingTurn(params.steps, params.speed, params.amount);
-                        break;
-                    case ACTION_CRUSAITO:
-                        controller->otto_.Crusaito(params.steps, params.speed, params.amount,
-                                                   params.direction);
-                        break;
-                    case ACTION_FLAPPING:
-                        controller->otto_.Flapping(params.steps, params.speed, params.amount,
-                                                   params.direction);
-                        break;
-                    case ACTION_HANDS_UP:
-                        if (controller->has_hands_) {
-                            controller->otto_.HandsUp(params.speed, params.direction);
-                        }
-                        break;
-                    case ACTION_HANDS_DOWN:
-                        if (controller->has_hands_) {
-                            controller->otto_.HandsDown(params.speed, params.direction);
-                        }
-                        break;
-                    case ACTION_HAND_WAVE:
-                        if (controller->has_hands_) {
-                            controller->otto_.HandWave(params.speed, params.direction);
-                        }
-                        break;
-                    case ACTION_HOME:
-                        controller->otto_.Home(params.direction == 1);
-                        break;
+    ActionScheduler scheduler_{"otto_action",
+                               [this](const RobotAction& action) { ExecuteAction(action); }};
+
+    void ExecuteAction(const RobotAction& params) {
+        switch (params.type) {
+            case ACTION_WALK:
+                otto_.Walk(params.steps, params.speed, params.direction, params.amount);
+                break;
+            case ACTION_TURN:
+                otto_.Turn(params.steps, params.speed, params.direction, params.amount);
+                break;
+            case ACTION_JUMP:
+                otto_.Jump(params.steps, params.speed);
+                break;
+            case ACTION_SWING:
+                otto_.Swing(params.steps, params.speed, params.amount);
+                break;
+            case ACTION_MOONWALK:
+                otto_.Moonwalker(params.steps, params.speed, params.amount, params.direction);
+                break;
+            case ACTION_BEND:
+                otto_.Bend(params.steps, params.speed, params.direction);
+                break;
+            case ACTION_SHAKE_LEG:
+                otto_.ShakeLeg(params.steps, params.speed, params.direction);
+                break;
+            case ACTION_UPDOWN:
+                otto_.UpDown(params.steps, params.speed, params.amount);
+                break;
+            case ACTION_TIPTOE_SWING:
+                otto_.TiptoeSwing(params.steps, params.speed, params.amount);
+                break;
+            case ACTION_JITTER:
+                otto_.Jitter(params.steps, params.speed, params.amount);
+                break;
+            case ACTION_ASCENDING_TURN:
+                otto_.AscendingTurn(params.steps, params.speed, params.amount);
+                break;
+            case ACTION_CRUSAITO:
+                otto_.Crusaito(params.steps, params.speed, params.amount, params.direction);
+                break;
+            case ACTION_FLAPPING:
+                otto_.Flapping(params.steps, params.speed, params.amount, params.direction);
+                break;
+            case ACTION_HANDS_UP:
+                if (has_hands_) {
+                    otto_.HandsUp(params.speed, params.direction);
+                }
+                break;
+            case ACTION_HANDS_DOWN:
+                if (has_hands_) {
+                    otto_.HandsDown(params.speed, params.direction);
                 }
-                if (params.action_type != ACTION_HOME) {
-                    controller->otto_.Home(params.action_type < ACTION_HANDS_UP);
+                break;
+            case ACTION_HAND_WAVE:
+                if (has_hands_) {
+                    otto_.HandWave(params.speed, params.direction);
                 }
-                controller->is_action_in_progress_ = false;
-                vTaskDelay(pdMS_TO_TICKS(20));
-            }
+                break;
+            case ACTION_HOME:
+                otto_.Home(params.direction == 1);
+                break;
+            case ACTION_SCRIPT:
+                script_player_.Play(params.amount, [this]() { return scheduler_.ShouldPreempt(); });
+                break;
         }
-    }
-
-    void StartActionTaskIfNeeded() {
-        if (action_task_handle_ == nullptr) {
-            xTaskCreate(ActionTask, "otto_action", 1024 * 3, this, configMAX_PRIORITIES - 1,
-                        &action_task_handle_);
+        // 动作结束后复位；被抢占时跳过，抢占它的复位动作会紧接着执行，避免复位两次
+        if (params.type != ACTION_HOME && !scheduler_.ShouldPreempt()) {
+            otto_.Home(params.type < ACTION_HANDS_UP);
         }
     }
 
-    void QueueAction(int action_type, int steps, int speed, int direction, int amount) {
+    void QueueAction(int action_type, int steps, int speed, int direction, int amount,
+                     ActionPriority priority = kActionPriorityNormal) {
         // 检查手部动作
         if ((action_type >= ACTION_HANDS_UP && action_type <= ACTION_HAND_WAVE) && !has_hands_) {
             ESP_LOGW(TAG, "尝试执行手部动作，但机器人没有配置手部舵机");
@@ -153,9 +131,18 @@ private:
         ESP_LOGI(TAG, "动作控制: 类型=%d, 步数=%d, 速度=%d, 方向=%d, 幅度=%d", action_type, steps,
                  speed, direction, amount);
 
-        OttoActionParams params = {action_type, steps, speed, direction, amount};
-        xQueueSend(action_queue_, &params, portMAX_DELAY);
-        StartActionTaskIfNeeded();
+        RobotAction action;
+        action.type = action_type;
+        action.steps = steps;
+        action.speed = speed;
+        action.direction = direction;
+        action.amount = amount;
+        action.priority = priority;
+        // 步态动作的 steps 是重复次数，连续相同的请求合并为一个
+        action.merge_steps = action_type < ACTION_HANDS_UP;
+        if (!scheduler_.Enqueue(action)) {
+            throw std::runtime_error("Action backlog is full");
+        }
     }
 
     void LoadTrimsFromNVS() {
@@ -184,7 +171,9 @@ public:
 
         LoadTrimsFromNVS();
 
-        action_queue_ = xQueueCreate(10, sizeof(OttoActionParams));
+        otto_.AttachServos();
+        otto_.SetPreemptCheck([this]() { return scheduler_.ShouldPreempt(); });
+        otto_.SetMotionCallback([this]() { scheduler_.OnMotion(); });
 
         QueueAction(ACTION_HOME, 1, 1000, 1, 0);  // direction=1表示复位手部
 
@@ -313,6 +302,39 @@ public:
                                return true;
                            });
 
+        // 动作脚本：上传一次，在设备上按本地时钟播放，编舞时不需要每个动作都请求一次
+        mcp_server.AddTool(
+            "self.otto.upload_motion_script",
+            "上传动作脚本，之后用 self.otto.play_motion_script 播放，同名脚本会被替换，"
+            "最多保存 4 个。name: 脚本名称; program: 整数数组 [1, 轨道数, 每个轨道: 舵机编号, 指令字数, 指令...]，"
+            "各轨道并行执行。指令: 1,角度(0-180),时长ms=移动; 2,时长ms=保持; 3,次数=循环开始; 4=循环结束; "
+            "5,幅度,周期ms,次数=围绕当前角度摆动。舵机编号: 0=左腿, 1=右腿, 2=左脚, 3=右脚, 4=左手, 5=右手",
+            PropertyList({Property("name", kPropertyTypeString),
+                          Property::Array("program", kPropertyTypeInteger, 2, MOTION_SCRIPT_MAX_WORDS)}),
+            [this](const PropertyList& properties) -> ReturnValue {
+                script_player_.Upload(properties["name"].value<std::string>(),
+                                      properties["program"].value<std::vector<int>>());
+                return script_player_.GetListJson();
+            });
+
+        mcp_server.AddTool("self.otto.play_motion_script",
+                           "播放已上传的动作脚本，可以用 self.otto.stop 中止。name: 脚本名称",
+                           PropertyList({Property("name", kPropertyTypeString)}),
+                           [this](const PropertyList& properties) -> ReturnValue {
+                               auto name = properties["name"].value<std::string>();
+                               uint32_t id = script_player_.Find(name);
+                               if (id == 0) {
+                                   throw std::runtime_error("Unknown motion script: " + name);
+                               }
+                               QueueAction(ACTION_SCRIPT, 1, 0, 0, id);
+                               return true;
+                           });
+
+        mcp_server.AddTool("self.otto.list_motion_scripts", "获取已上传的动作脚本及其时长",
+                           PropertyList(), [this](const PropertyList& properties) -> ReturnValue {
+                               return script_player_.GetListJson();
+                           });
+
         // 手部动作（仅在有手部舵机时可用）
         if (has_hands_) {
             mcp_server.AddTool(
@@ -358,14 +380,9 @@ public:
         // 系统工具
         mcp_server.AddTool("self.otto.stop", "立即停止", PropertyList(),
                            [this](const PropertyList& properties) -> ReturnValue {
-                               if (action_task_handle_ != nullptr) {
-                                   vTaskDelete(action_task_handle_);
-                                   action_task_handle_ = nullptr;
-                               }
-                               is_action_in_progress_ = false;
-                               xQueueReset(action_queue_);
-
-                               QueueAction(ACTION_HOME, 1, 1000, 1, 0);
+                               // 丢弃排队的动作，正在执行的动作在下一个关键帧停下并复位
+                               scheduler_.Clear();
+                               QueueAction(ACTION_HOME, 1, 1000, 1, 0, kActionPriorityHigh);
                                return true;
                            });
 
@@ -374,7 +391,7 @@ public:
             "校准单个舵机位置。设置指定舵机的微调参数以调整Otto的初始站立姿态，设置将永久保存。"
             "servo_type: 舵机类型(left_leg/right_leg/left_foot/right_foot/left_hand/right_hand); "
             "trim_value: 微调值(-50到50度)",
-            PropertyList({Property("servo_type", kPropertyTypeString, "left_leg"),
+            PropertyList({Property::Enum("servo_type", {"left_leg", "right_leg", "left_foot", "right_foot", "left_hand", "right_hand"}, "left_leg"),
                           Property("trim_value", kPropertyTypeInteger, 0, -50, 50)}),
             [this](const PropertyList& properties) -> ReturnValue {
                 std::string servo_type = properties["servo_type"].value<std::string>();
@@ -454,7 +471,14 @@ public:
 
         mcp_server.AddTool("self.otto.get_status", "获取机器人状态，返回 moving 或 idle",
                            PropertyList(), [this](const PropertyList& properties) -> ReturnValue {
-                               return is_action_in_progress_ ? "moving" : "idle";
+                               return scheduler_.IsBusy() ? "moving" : "idle";
+                           });
+
+        mcp_server.AddTool("self.otto.get_action_stats",
+                           "获取动作调度统计：排队、合并、丢弃、拒绝、被抢占和完成的动作数，"
+                           "以及从请求到开始执行、到舵机开始运动和执行时长的延迟分布(微秒)",
+                           PropertyList(), [this](const PropertyList& properties) -> ReturnValue {
+                               return scheduler_.GetStatsJson();
                            });
 
         mcp_server.AddTool("self.battery.get_level", "获取机器人电池电量和充电状态", PropertyList(),
@@ -473,14 +497,6 @@ public:
 
         ESP_LOGI(TAG, "MCP工具注册完成");
     }
-
-    ~OttoController() {
-        if (action_task_handle_ != nullptr) {
-            vTaskDelete(action_task_handle_);
-            action_task_handle_ = nullptr;
-        }
-        vQueueDelete(action_queue_);
-    }
 };
 
 static OttoController* g_otto_controller = nullptr;
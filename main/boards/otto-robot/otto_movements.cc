@@ -87,6 +87,7 @@ void Otto::SetTrims(int left_leg, int right_leg, int left_foot, int right_foot,
 //-- BASIC MOTION FUNCTIONS -------------------------------------//
 ///////////////////////////////////////////////////////////////////
 void Otto::MoveServos(int time, int servo_target[]) {
+    NotifyMotion();
     if (GetRestState() == true) {
         SetRestState(false);
     }
@@ -150,13 +151,22 @@ void Otto::MoveSingle(int position, int servo_number) {
         SetRestState(false);
     }
 
+    NotifyMotion();
     if (servo_number >= 0 && servo_number < SERVO_COUNT && servo_pins_[servo_number] != -1) {
         servo_[servo_number].SetPosition(position);
     }
 }
 
+int Otto::GetServoPosition(int servo_number) {
+    if (servo_number < 0 || servo_number >= SERVO_COUNT || servo_pins_[servo_number] == -1) {
+        return -1;
+    }
+    return servo_[servo_number].GetPosition();
+}
+
 void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                            double phase_diff[SERVO_COUNT], float cycle = 1) {
+    NotifyMotion();
     for (int i = 0; i < SERVO_COUNT; i++) {
         if (servo_pins_[i] != -1) {
             servo_[i].SetO(offset[i]);
@@ -188,10 +198,16 @@ void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int peri
 
     int cycles = (int)steps;
 
-    //-- Execute complete cycles
-    if (cycles >= 1)
-        for (int i = 0; i < cycles; i++)
-            OscillateServos(amplitude, offset, period, phase_diff);
+    //-- Execute complete cycles, each one ends back at the offsets
+    for (int i = 0; i < cycles; i++) {
+        if (Preempted()) {
+            return;
+        }
+        OscillateServos(amplitude, offset, period, phase_diff);
+    }
+    if (Preempted()) {
+        return;
+    }
 
     //-- Execute the final not complete cycle
     OscillateServos(amplitude, offset, period, phase_diff, (float)steps - cycles);
@@ -363,7 +379,7 @@ void Otto::Bend(int steps, int period, int dir) {
     int T2 = 800;
 
     // Bend movement
-    for (int i = 0; i < steps; i++) {
+    for (int i = 0; i < steps && !Preempted(); i++) {
         MoveServos(T2 / 2, bend1);
         MoveServos(T2 / 2, bend2);
         vTaskDelay(pdMS_TO_TICKS(period * 0.8));
@@ -404,7 +420,7 @@ void Otto::ShakeLeg(int steps, int period, int dir) {
     period = period - T2;
     period = std::max(period, 200 * numberLegMoves);
 
-    for (int j = 0; j < steps; j++) {
+    for (int j = 0; j < steps && !Preempted(); j++) {
         // Bend movement
         MoveServos(T2 / 2, shake_leg1);
         MoveServos(T2 / 2, shake_leg2);
@@ -677,7 +693,7 @@ void Otto::HandWave(int period, int dir) {
     vTaskDelay(pdMS_TO_TICKS(300));
 
     // 左右摆动5次
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < 5 && !Preempted(); i++) {
         if (servo_index == LEFT_HAND) {
             current_positions[servo_index] = position - 30;
             MoveServos(period / 10, current_positions);
@@ -729,7 +745,7 @@ void Otto::HandWaveBoth(int period) {
     MoveServos(300, current_positions);
 
     // 左右摆动5次
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < 5 && !Preempted(); i++) {
         // 波浪向左
         current_positions[LEFT_HAND] = left_position - 30;
         current_positions[RIGHT_HAND] = right_position + 30;
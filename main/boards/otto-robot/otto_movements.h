@@ -8,6 +8,8 @@
 #include "freertos/task.h"
 #include "oscillator.h"
 
+#include <functional>
+
 //-- Constants
 #define FORWARD 1
 #define BACKWARD -1
@@ -49,6 +51,7 @@ public:
     //-- Predetermined Motion Functions
     void MoveServos(int time, int servo_target[]);
     void MoveSingle(int position, int servo_number);
+    int GetServoPosition(int servo_number);  // -1 if the servo is not connected
     void OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                          double phase_diff[SERVO_COUNT], float cycle);
 
@@ -85,6 +88,12 @@ public:
     void EnableServoLimit(int speed_limit_degree_per_sec = SERVO_LIMIT_DEFAULT);
     void DisableServoLimit();
 
+    //-- Action scheduler hooks
+    // Polled at keyframe boundaries, where the pose is stable; a repeating movement returns early when it is true
+    void SetPreemptCheck(std::function<bool()> check) { preempt_check_ = std::move(check); }
+    // Called before the servos are driven
+    void SetMotionCallback(std::function<void()> callback) { on_motion_ = std::move(callback); }
+
 private:
     Oscillator servo_[SERVO_COUNT];
 
@@ -100,6 +109,16 @@ private:
 
     void Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                  double phase_diff[SERVO_COUNT], float steps);
+
+    std::function<bool()> preempt_check_;
+    std::function<void()> on_motion_;
+
+    bool Preempted() { return preempt_check_ && preempt_check_(); }
+    void NotifyMotion() {
+        if (on_motion_) {
+            on_motion_();
+        }
+    }
 };
 
 #endif  // __OTTO_MOVEMENTS_H__
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "boot_profiler.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <cJSON.h>
+#include <cstddef>
+#include <cstring>
+
+#define TAG "BootProfiler"
+
+#define BOOT_HISTORY_MAGIC 0x424f4f54   // "BOOT"
+
+static const char* const PHASE_NAMES[] = {
+    "board",
+    "codec",
+    "audio_processor",
+    "wake_word",
+    "network",
+    "version_check",
+    "protocol",
+    "first_frame",
+    "ready",
+};
+static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == kBootPhaseCount, "Missing boot phase name");
+
+struct BootHistory {
+    uint32_t magic;
+    uint32_t head;      // Slot of the current boot
+    BootTimeline boots[BOOT_PROFILER_HISTORY];
+    uint32_t checksum;
+};
+
+// Kept across resets, validated with the magic and checksum because it is garbage after a power-on
+RTC_NOINIT_ATTR static BootHistory boot_history;
+
+static uint32_t Checksum(const BootHistory& history) {
+    auto words = reinterpret_cast<const uint32_t*>(&history);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < offsetof(BootHistory, checksum) / sizeof(uint32_t); i++) {
+        sum = (sum << 1 | sum >> 31) ^ words[i];
+    }
+    return sum;
+}
+
+static const char* ResetReasonName(uint32_t reason) {
+    switch (reason) {
+        case ESP_RST_POWERON: return "poweron";
+        case ESP_RST_EXT: return "external";
+        case ESP_RST_SW: return "software";
+        case ESP_RST_PANIC: return "panic";
+        case ESP_RST_INT_WDT: return "int_wdt";
+        case ESP_RST_TASK_WDT: return "task_wdt";
+        case ESP_RST_WDT: return "wdt";
+        case ESP_RST_DEEPSLEEP: return "deepsleep";
+        case ESP_RST_BROWNOUT: return "brownout";
+        default: return "other";
+    }
+}
+
+BootProfiler::BootProfiler() {
+    uint32_t boot_count = 0;
+    if (boot_history.magic == BOOT_HISTORY_MAGIC && boot_history.head < BOOT_PROFILER_HISTORY &&
+        boot_history.checksum == Checksum(boot_history)) {
+        boot_count = boot_history.boots[boot_history.head].boot_count;
+        boot_history.head = (boot_history.head + 1) % BOOT_PROFILER_HISTORY;
+        has_previous_ = true;
+    } else {
+        memset(&boot_history, 0, sizeof(boot_history));
+        boot_history.magic = BOOT_HISTORY_MAGIC;
+    }
+
+    auto& timeline = current();
+    timeline.boot_count = boot_count + 1;
+    timeline.reset_reason = esp_reset_reason();
+    for (int i = 0; i < kBootPhaseCount; i++) {
+        timeline.start_ms[i] = BOOT_PHASE_NOT_RECORDED;
+        timeline.end_ms[i] = BOOT_PHASE_NOT_RECORDED;
+    }
+    boot_history.checksum = Checksum(boot_history);
+}
+
+BootTimeline& BootProfiler::current() {
+    return boot_history.boots[boot_history.head];
+}
+
+void BootProfiler::Begin(BootPhase phase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& timeline = current();
+    if (timeline.start_ms[phase] != BOOT_PHASE_NOT_RECORDED) {
+        return;
+    }
+    timeline.start_ms[phase] = esp_timer_get_time() / 1000;
+    boot_history.checksum = Checksum(boot_history);
+}
+
+void BootProfiler::End(BootPhase phase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& timeline = current();
+    if (timeline.start_ms[phase] == BOOT_PHASE_NOT_RECORDED || timeline.end_ms[phase] != BOOT_PHASE_NOT_RECORDED) {
+        return;
+    }
+    timeline.end_ms[phase] = esp_timer_get_time() / 1000;
+    boot_history.checksum = Checksum(boot_history);
+    ESP_LOGI(TAG, "%s took %lu ms", PHASE_NAMES[phase], timeline.end_ms[phase] - timeline.start_ms[phase]);
+}
+
+void BootProfiler::Mark(BootPhase phase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& timeline = current();
+    if (timeline.start_ms[phase] != BOOT_PHASE_NOT_RECORDED) {
+        return;
+    }
+    timeline.start_ms[phase] = esp_timer_get_time() / 1000;
+    timeline.end_ms[phase] = timeline.start_ms[phase];
+    boot_history.checksum = Checksum(boot_history);
+    ESP_LOGI(TAG, "%s at %lu ms", PHASE_NAMES[phase], timeline.start_ms[phase]);
+}
+
+static cJSON* TimelineToJson(const BootTimeline& timeline) {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "boot_count", timeline.boot_count);
+    cJSON_AddStringToObject(json, "reset_reason", ResetReasonName(timeline.reset_reason));
+    cJSON* phases = cJSON_CreateObject();
+    for (int i = 0; i < kBootPhaseCount; i++) {
+        if (timeline.start_ms[i] == BOOT_PHASE_NOT_RECORDED) {
+            continue;
+        }
+        cJSON* phase = cJSON_CreateArray();
+        cJSON_AddItemToArray(phase, cJSON_CreateNumber(timeline.start_ms[i]));
+        if (timeline.end_ms[i] == BOOT_PHASE_NOT_RECORDED) {
+            cJSON_AddItemToArray(phase, cJSON_CreateNumber(-1));
+        } else {
+            cJSON_AddItemToArray(phase, cJSON_CreateNumber(timeline.end_ms[i] - timeline.start_ms[i]));
+        }
+        cJSON_AddItemToObject(phases, PHASE_NAMES[i], phase);
+    }
+    cJSON_AddItemToObject(json, "phases", phases);
+    return json;
+}
+
+static std::string PrintJson(cJSON* root) {
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+std::string BootProfiler::GetTimelineJson(bool previous) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!previous) {
+        return PrintJson(TimelineToJson(current()));
+    }
+    if (!has_previous_) {
+        return "null";
+    }
+    auto slot = (boot_history.head + BOOT_PROFILER_HISTORY - 1) % BOOT_PROFILER_HISTORY;
+    return PrintJson(TimelineToJson(boot_history.boots[slot]));
+}
+
+// The current boot followed by the older ones still in RTC memory
+std::string BootProfiler::GetJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateArray();
+    for (int i = 0; i < BOOT_PROFILER_HISTORY; i++) {
+        auto slot = (boot_history.head + BOOT_PROFILER_HISTORY - i) % BOOT_PROFILER_HISTORY;
+        auto& timeline = boot_history.boots[slot];
+        if (timeline.boot_count == 0 || (i > 0 && timeline.boot_count >= current().boot_count)) {
+            break;
+        }
+        cJSON_AddItemToArray(root, TimelineToJson(timeline));
+    }
+    return PrintJson(root);
+}
@@ -0,0 +1,66 @@
+#ifndef _BOOT_PROFILER_H_
+#define _BOOT_PROFILER_H_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#define BOOT_PROFILER_HISTORY 4                 // Boots kept in RTC memory, including the current one
+#define BOOT_PHASE_NOT_RECORDED 0xFFFFFFFF
+
+enum BootPhase {
+    kBootPhaseBoard,
+    kBootPhaseCodec,
+    kBootPhaseAudioProcessor,
+    kBootPhaseWakeWord,
+    kBootPhaseNetwork,
+    kBootPhaseVersionCheck,
+    kBootPhaseProtocol,
+    kBootPhaseFirstFrame,
+    kBootPhaseReady,
+    kBootPhaseCount
+};
+
+struct BootTimeline {
+    uint32_t boot_count;
+    uint32_t reset_reason;
+    uint32_t start_ms[kBootPhaseCount];
+    uint32_t end_ms[kBootPhaseCount];
+};
+
+/*
+ * Records when each boot phase starts and ends, in milliseconds since boot.
+ * Only the first occurrence of a phase is kept. The timelines live in RTC memory
+ * that is not initialized at startup, so after a reset (including a panic or a
+ * watchdog) the previous boot can still be reported; a power-on clears them.
+ */
+class BootProfiler {
+public:
+    static BootProfiler& GetInstance() {
+        static BootProfiler instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    BootProfiler(const BootProfiler&) = delete;
+    BootProfiler& operator=(const BootProfiler&) = delete;
+
+    void Begin(BootPhase phase);
+    void End(BootPhase phase);
+    // A phase without duration, such as the first display frame
+    void Mark(BootPhase phase);
+
+    // Phases as "name":[start_ms,duration_ms], the duration is -1 if the phase did not end
+    std::string GetTimelineJson(bool previous);
+    std::string GetJson();
+
+private:
+    BootProfiler();
+    ~BootProfiler() = default;
+
+    std::mutex mutex_;
+    bool has_previous_ = false;
+
+    BootTimeline& current();
+};
+
+#endif // _BOOT_PROFILER_H_
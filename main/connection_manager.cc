@@ -0,0 +1,221 @@
+#include "connection_manager.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+#include <strings.h>
+
+#define TAG "ConnectionManager"
+
+ConnectionManager::ConnectionManager() {
+    esp_timer_create_args_t purge_timer_args = {
+        .callback = [](void* arg) {
+            auto manager = (ConnectionManager*)arg;
+            std::lock_guard<std::mutex> lock(manager->mutex_);
+            manager->PurgeExpiredLocked(esp_timer_get_time());
+            if (!manager->idle_connections_.empty()) {
+                esp_timer_start_once(manager->purge_timer_, CONNECTION_KEEP_ALIVE_MS * 1000);
+            }
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "conn_purge_timer",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&purge_timer_args, &purge_timer_);
+}
+
+ConnectionManager::~ConnectionManager() {
+    if (purge_timer_ != nullptr) {
+        esp_timer_stop(purge_timer_);
+        esp_timer_delete(purge_timer_);
+    }
+}
+
+std::string ConnectionManager::GetHost(const std::string& url) {
+    size_t start = url.find("://");
+    start = (start == std::string::npos) ? 0 : start + 3;
+    size_t end = url.find('/', start);
+    if (end == std::string::npos) {
+        return url.substr(start);
+    }
+    return url.substr(start, end - start);
+}
+
+std::string ConnectionManager::GetPoolKey(int connect_id, const std::string& url, const std::string& purpose) {
+    return GetHost(url) + "#" + std::to_string(connect_id) + "#" + purpose;
+}
+
+void ConnectionManager::PurgeExpiredLocked(int64_t now_us) {
+    for (auto it = idle_connections_.begin(); it != idle_connections_.end();) {
+        auto& connections = it->second;
+        connections.remove_if([now_us](IdleConnection& connection) {
+            if (now_us - connection.released_at_us < CONNECTION_KEEP_ALIVE_MS * 1000LL) {
+                return false;
+            }
+            connection.http->Close();
+            return true;
+        });
+        if (connections.empty()) {
+            it = idle_connections_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::unique_ptr<Http> ConnectionManager::AcquireHttp(int connect_id, const std::string& url, const std::string& purpose) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        PurgeExpiredLocked(esp_timer_get_time());
+
+        auto it = idle_connections_.find(GetPoolKey(connect_id, url, purpose));
+        if (it != idle_connections_.end() && !it->second.empty()) {
+            auto http = std::move(it->second.back().http);
+            it->second.pop_back();
+            pending_reuse_.insert(http.get());
+            return http;
+        }
+    }
+
+    auto network = Board::GetInstance().GetNetwork();
+    return network->CreateHttp(connect_id);
+}
+
+bool ConnectionManager::OpenHttp(std::unique_ptr<Http>& http, int connect_id, const std::string& method,
+    const std::string& url, const HttpSetup& setup) {
+    bool reused = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reused = pending_reuse_.erase(http.get()) > 0;
+    }
+
+    setup(http.get());
+    auto start_time = esp_timer_get_time();
+    bool success = http->Open(method, url);
+    if (!success && reused) {
+        ESP_LOGW(TAG, "Pooled connection to %s was closed, opening a new one", GetHost(url).c_str());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_[GetHost(url)].stale_retries++;
+        }
+        http->Close();
+        http = Board::GetInstance().GetNetwork()->CreateHttp(connect_id);
+        reused = false;
+        setup(http.get());
+        start_time = esp_timer_get_time();
+        success = http->Open(method, url);
+    }
+    RecordConnect(GetHost(url), esp_timer_get_time() - start_time, reused, success);
+    return success;
+}
+
+void ConnectionManager::ReleaseHttp(int connect_id, const std::string& url, const std::string& purpose, std::unique_ptr<Http> http) {
+    if (http == nullptr) {
+        return;
+    }
+
+    // Only keep the connection if the server did not ask to close it
+    auto connection = http->GetResponseHeader("Connection");
+    if (strcasecmp(connection.c_str(), "close") == 0) {
+        http->Close();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_reuse_.erase(http.get());
+    auto& connections = idle_connections_[GetPoolKey(connect_id, url, purpose)];
+    if (connections.size() >= CONNECTION_MAX_IDLE_PER_HOST) {
+        connections.front().http->Close();
+        connections.pop_front();
+    }
+    connections.push_back(IdleConnection{std::move(http), esp_timer_get_time()});
+
+    // Idle connections hold a TLS context in SRAM, release them once the keep-alive expires
+    if (!esp_timer_is_active(purge_timer_)) {
+        esp_timer_start_once(purge_timer_, CONNECTION_KEEP_ALIVE_MS * 1000);
+    }
+}
+
+std::unique_ptr<WebSocket> ConnectionManager::CreateWebSocket(int connect_id) {
+    auto network = Board::GetInstance().GetNetwork();
+    return network->CreateWebSocket(connect_id);
+}
+
+bool ConnectionManager::ConnectWebSocket(WebSocket* websocket, const std::string& url) {
+    // A websocket carries a whole session, so it is never pooled, only measured
+    auto start_time = esp_timer_get_time();
+    bool success = websocket->Connect(url.c_str());
+    RecordConnect(GetHost(url), esp_timer_get_time() - start_time, false, success);
+    return success;
+}
+
+void ConnectionManager::CloseIdleConnections() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [key, connections] : idle_connections_) {
+        for (auto& connection : connections) {
+            connection.http->Close();
+        }
+    }
+    idle_connections_.clear();
+    pending_reuse_.clear();
+}
+
+void ConnectionManager::RecordConnect(const std::string& host, int64_t elapsed_us, bool reused, bool success) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = stats_[host];
+    if (!success) {
+        stats.failed_connections++;
+        return;
+    }
+
+    if (reused && stats.full_handshakes > 0 && elapsed_us * 2 >= stats.full_handshake_us / stats.full_handshakes) {
+        // The client connected again under the hood, nothing was saved
+        stats.pooled_reconnects++;
+        reused = false;
+    }
+    if (reused) {
+        stats.reused_connections++;
+        stats.reused_open_us += elapsed_us;
+        if (stats.full_handshakes > 0) {
+            int64_t average_handshake_us = stats.full_handshake_us / stats.full_handshakes;
+            if (average_handshake_us > elapsed_us) {
+                stats.saved_us += average_handshake_us - elapsed_us;
+            }
+        }
+    } else {
+        stats.full_handshakes++;
+        stats.full_handshake_us += elapsed_us;
+    }
+    ESP_LOGI(TAG, "%s %s in %lld ms (handshakes: %lu, reused: %lu, saved: %lld ms)", host.c_str(),
+        reused ? "reused connection" : "connected", elapsed_us / 1000, stats.full_handshakes,
+        stats.reused_connections, stats.saved_us / 1000);
+}
+
+std::string ConnectionManager::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateArray();
+    for (const auto& [host, stats] : stats_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "host", host.c_str());
+        cJSON_AddNumberToObject(item, "full_handshakes", stats.full_handshakes);
+        cJSON_AddNumberToObject(item, "reused_connections", stats.reused_connections);
+        cJSON_AddNumberToObject(item, "failed_connections", stats.failed_connections);
+        cJSON_AddNumberToObject(item, "pooled_reconnects", stats.pooled_reconnects);
+        cJSON_AddNumberToObject(item, "stale_retries", stats.stale_retries);
+        if (stats.full_handshakes > 0) {
+            cJSON_AddNumberToObject(item, "avg_handshake_ms", stats.full_handshake_us / stats.full_handshakes / 1000);
+        }
+        if (stats.reused_connections > 0) {
+            cJSON_AddNumberToObject(item, "avg_reused_open_ms", stats.reused_open_us / stats.reused_connections / 1000);
+        }
+        cJSON_AddNumberToObject(item, "saved_ms", stats.saved_us / 1000);
+        cJSON_AddItemToArray(root, item);
+    }
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,89 @@
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <http.h>
+#include <web_socket.h>
+#include <esp_timer.h>
+
+#include <string>
+#include <map>
+#include <list>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#define CONNECTION_KEEP_ALIVE_MS 30000
+#define CONNECTION_MAX_IDLE_PER_HOST 2
+
+struct HostConnectionStats {
+    uint32_t full_handshakes = 0;
+    uint32_t reused_connections = 0;
+    uint32_t failed_connections = 0;
+    uint32_t pooled_reconnects = 0;  // Pooled connections that still took a full handshake to open
+    uint32_t stale_retries = 0;      // Pooled connections closed by the server, opened again on a new one
+    int64_t full_handshake_us = 0;   // Accumulated time spent in full handshakes
+    int64_t reused_open_us = 0;      // Accumulated time spent opening reused connections
+    int64_t saved_us = 0;            // Estimated time saved by reusing connections
+};
+
+/*
+ * Keeps idle HTTP connections per host for a bounded time so that the next
+ * request to the same host (OTA check -> activation -> upgrade) can skip the
+ * TCP + TLS handshake, and measures every connection setup.
+ *
+ * A pooled connection is keyed by host and connect_id, because the ML307
+ * modem binds the connect_id to a socket slot, and by purpose, because the
+ * headers set by a caller stay on the Http and cannot be cleared.
+ *
+ * Whether the HTTP client keeps its socket between requests is up to the
+ * network implementation. A pooled connection that opens about as slowly as
+ * a full handshake is counted as a handshake, not as a reuse, so the savings
+ * reported are only the ones measured.
+ */
+class ConnectionManager {
+public:
+    static ConnectionManager& GetInstance() {
+        static ConnectionManager instance;
+        return instance;
+    }
+    ConnectionManager(const ConnectionManager&) = delete;
+    ConnectionManager& operator=(const ConnectionManager&) = delete;
+
+    using HttpSetup = std::function<void(Http* http)>;
+
+    std::unique_ptr<Http> AcquireHttp(int connect_id, const std::string& url, const std::string& purpose);
+    // setup sets the headers and the content before opening. A pooled connection that fails to open was
+    // likely closed by the server: it is replaced by a new one, set up again and opened once more
+    bool OpenHttp(std::unique_ptr<Http>& http, int connect_id, const std::string& method, const std::string& url,
+        const HttpSetup& setup);
+    void ReleaseHttp(int connect_id, const std::string& url, const std::string& purpose, std::unique_ptr<Http> http);
+
+    std::unique_ptr<WebSocket> CreateWebSocket(int connect_id);
+    bool ConnectWebSocket(WebSocket* websocket, const std::string& url);
+
+    void CloseIdleConnections();
+    std::string GetStatsJson();
+
+private:
+    ConnectionManager();
+    ~ConnectionManager();
+
+    struct IdleConnection {
+        std::unique_ptr<Http> http;
+        int64_t released_at_us;
+    };
+
+    std::mutex mutex_;
+    esp_timer_handle_t purge_timer_ = nullptr;
+    std::map<std::string, std::list<IdleConnection>> idle_connections_;
+    std::set<const Http*> pending_reuse_;
+    std::map<std::string, HostConnectionStats> stats_;
+
+    static std::string GetHost(const std::string& url);
+    static std::string GetPoolKey(int connect_id, const std::string& url, const std::string& purpose);
+    void PurgeExpiredLocked(int64_t now_us);
+    void RecordConnect(const std::string& host, int64_t elapsed_us, bool reused, bool success);
+};
+
+#endif // CONNECTION_MANAGER_H
@@ -1,5 +1,14 @@
 #include "device_state_event.h"
 
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+
+#define TAG "StateEvent"
+
+// Wait at most this long for room in the default event loop queue, so a stuck loop cannot block SetDeviceState
+#define STATE_EVENT_POST_TIMEOUT_MS 50
+
 ESP_EVENT_DEFINE_BASE(XIAOZHI_STATE_EVENTS);
 
 DeviceStateEventManager& DeviceStateEventManager::GetInstance() {
@@ -7,9 +16,56 @@ DeviceStateEventManager& DeviceStateEventManager::GetInstance() {
     return instance;
 }
 
-void DeviceStateEventManager::RegisterStateChangeCallback(std::function<void(DeviceState, DeviceState)> callback) {
+int DeviceStateEventManager::RegisterStateChangeCallback(StateChangeCallback callback, StateDelivery delivery, const char* name) {
+    auto subscriber = std::make_shared<Subscriber>();
+    subscriber->name = name;
+    subscriber->delivery = delivery;
+    subscriber->callback = std::move(callback);
+
     std::lock_guard<std::mutex> lock(mutex_);
-    callbacks_.push_back(callback);
+    int handle = next_handle_++;
+    subscriber->handle = handle;
+    auto list = std::make_shared<SubscriberList>(*GetSubscribers());
+    list->push_back(std::move(subscriber));
+    std::atomic_store(&subscribers_, std::shared_ptr<const SubscriberList>(std::move(list)));
+    return handle;
+}
+
+void DeviceStateEventManager::UnregisterStateChangeCallback(int handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto list = std::make_shared<SubscriberList>(*GetSubscribers());
+    auto it = std::find_if(list->begin(), list->end(), [handle](const auto& subscriber) {
+        return subscriber->handle == handle;
+    });
+    if (it == list->end()) {
+        ESP_LOGW(TAG, "Unknown state change subscriber %d", handle);
+        return;
+    }
+    // An event already being delivered may still hold the old list
+    (*it)->active = false;
+    list->erase(it);
+    std::atomic_store(&subscribers_, std::shared_ptr<const SubscriberList>(std::move(list)));
+}
+
+std::shared_ptr<const DeviceStateEventManager::SubscriberList> DeviceStateEventManager::GetSubscribers() const {
+    return std::atomic_load(&subscribers_);
+}
+
+void DeviceStateEventManager::Deliver(const SubscriberList& subscribers, StateDelivery delivery, const device_state_event_data_t& data) {
+    for (const auto& subscriber : subscribers) {
+        if (subscriber->delivery != delivery || !subscriber->active) {
+            continue;
+        }
+        auto start_time = esp_timer_get_time();
+        subscriber->callback(data.previous_state, data.current_state);
+        uint32_t elapsed_us = esp_timer_get_time() - start_time;
+
+        subscriber->calls.fetch_add(1, std::memory_order_relaxed);
+        subscriber->total_us.fetch_add(elapsed_us, std::memory_order_relaxed);
+        uint32_t max_us = subscriber->max_us.load(std::memory_order_relaxed);
+        while (elapsed_us > max_us && !subscriber->max_us.compare_exchange_weak(max_us, elapsed_us, std::memory_order_relaxed)) {
+        }
+    }
 }
 
 void DeviceStateEventManager::PostStateChangeEvent(DeviceState previous_state, DeviceState current_state) {
@@ -17,12 +73,42 @@ void DeviceStateEventManager::PostStateChangeEvent(DeviceState previous_state, D
         .previous_state = previous_state,
         .current_state = current_state
     };
-    esp_event_post(XIAOZHI_STATE_EVENTS, XIAOZHI_STATE_CHANGED_EVENT, &event_data, sizeof(event_data), portMAX_DELAY);
+    posted_.fetch_add(1, std::memory_order_relaxed);
+
+    Deliver(*GetSubscribers(), kStateDeliveryInline, event_data);
+
+    // Also posted without queued subscribers, for handlers registered on XIAOZHI_STATE_EVENTS directly
+    if (esp_event_post(XIAOZHI_STATE_EVENTS, XIAOZHI_STATE_CHANGED_EVENT, &event_data, sizeof(event_data),
+            pdMS_TO_TICKS(STATE_EVENT_POST_TIMEOUT_MS)) != ESP_OK) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "Event loop busy, state change event dropped");
+    }
 }
 
-std::vector<std::function<void(DeviceState, DeviceState)>> DeviceStateEventManager::GetCallbacks() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return callbacks_;
+cJSON* DeviceStateEventManager::GetStatsJson() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "posted", posted_.load(std::memory_order_relaxed));
+    cJSON_AddNumberToObject(root, "dropped", dropped_.load(std::memory_order_relaxed));
+
+    cJSON* listeners = cJSON_CreateArray();
+    for (const auto& subscriber : *GetSubscribers()) {
+        cJSON* listener = cJSON_CreateObject();
+        if (subscriber->name != nullptr) {
+            cJSON_AddStringToObject(listener, "name", subscriber->name);
+        } else {
+            cJSON_AddNumberToObject(listener, "handle", subscriber->handle);
+        }
+        cJSON_AddStringToObject(listener, "delivery", subscriber->delivery == kStateDeliveryInline ? "inline" : "queued");
+        uint32_t calls = subscriber->calls.load(std::memory_order_relaxed);
+        cJSON_AddNumberToObject(listener, "calls", calls);
+        if (calls > 0) {
+            cJSON_AddNumberToObject(listener, "avg_us", subscriber->total_us.load(std::memory_order_relaxed) / calls);
+            cJSON_AddNumberToObject(listener, "max_us", subscriber->max_us.load(std::memory_order_relaxed));
+        }
+        cJSON_AddItemToArray(listeners, listener);
+    }
+    cJSON_AddItemToObject(root, "listeners", listeners);
+    return root;
 }
 
 DeviceStateEventManager::DeviceStateEventManager() {
@@ -31,16 +117,14 @@ DeviceStateEventManager::DeviceStateEventManager() {
         ESP_ERROR_CHECK(err);
     }
 
-    ESP_ERROR_CHECK(esp_event_handler_register(XIAOZHI_STATE_EVENTS, XIAOZHI_STATE_CHANGED_EVENT, 
+    ESP_ERROR_CHECK(esp_event_handler_register(XIAOZHI_STATE_EVENTS, XIAOZHI_STATE_CHANGED_EVENT,
         [](void* handler_args, esp_event_base_t base, int32_t id, void* event_data) {
             auto* data = static_cast<device_state_event_data_t*>(event_data);
-            auto& manager = DeviceStateEventManager::GetInstance();
-            for (const auto& callback : manager.GetCallbacks()) {
-                callback(data->previous_state, data->current_state);
-            }
+            auto subscribers = DeviceStateEventManager::GetInstance().GetSubscribers();
+            Deliver(*subscribers, kStateDeliveryQueued, *data);
         }, nullptr));
 }
 
 DeviceStateEventManager::~DeviceStateEventManager() {
     esp_event_handler_unregister(XIAOZHI_STATE_EVENTS, XIAOZHI_STATE_CHANGED_EVENT, nullptr);
-}
\ No newline at end of file
+}
@@ -2,7 +2,10 @@
 #define _DEVICE_STATE_EVENT_H_
 
 #include <esp_event.h>
+#include <cJSON.h>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <vector>
 #include <mutex>
 #include "device_state.h"
@@ -18,22 +21,56 @@ struct device_state_event_data_t {
     DeviceState current_state;
 };
 
+enum StateDelivery {
+    kStateDeliveryQueued,   // Called on the default event loop task, the state change does not wait for it
+    kStateDeliveryInline,   // Called by SetDeviceState on the main loop, must be short and must not block
+};
+
+/*
+ * Subscribers are kept in an immutable list that is replaced on every change
+ * (copy-on-write), so delivery only takes a reference to the current list and
+ * calls the callbacks without holding the lock. A callback may register or
+ * unregister subscribers; the change applies from the next event.
+ */
 class DeviceStateEventManager {
 public:
+    using StateChangeCallback = std::function<void(DeviceState, DeviceState)>;
+
     static DeviceStateEventManager& GetInstance();
     DeviceStateEventManager(const DeviceStateEventManager&) = delete;
     DeviceStateEventManager& operator=(const DeviceStateEventManager&) = delete;
 
-    void RegisterStateChangeCallback(std::function<void(DeviceState, DeviceState)> callback);
+    // Returns a handle for UnregisterStateChangeCallback. The name, if any, must stay valid
+    int RegisterStateChangeCallback(StateChangeCallback callback, StateDelivery delivery = kStateDeliveryQueued,
+        const char* name = nullptr);
+    void UnregisterStateChangeCallback(int handle);
     void PostStateChangeEvent(DeviceState previous_state, DeviceState current_state);
-    std::vector<std::function<void(DeviceState, DeviceState)>> GetCallbacks();
+    cJSON* GetStatsJson();
 
 private:
     DeviceStateEventManager();
     ~DeviceStateEventManager();
 
-    std::vector<std::function<void(DeviceState, DeviceState)>> callbacks_;
-    std::mutex mutex_;
+    struct Subscriber {
+        int handle;
+        const char* name;
+        StateDelivery delivery;
+        StateChangeCallback callback;
+        std::atomic<bool> active{true};
+        std::atomic<uint32_t> calls{0};
+        std::atomic<uint32_t> total_us{0};
+        std::atomic<uint32_t> max_us{0};
+    };
+    using SubscriberList = std::vector<std::shared_ptr<Subscriber>>;
+
+    std::mutex mutex_;      // Serializes writers only
+    std::shared_ptr<const SubscriberList> subscribers_ = std::make_shared<const SubscriberList>();
+    int next_handle_ = 1;
+    std::atomic<uint32_t> posted_{0};
+    std::atomic<uint32_t> dropped_{0};
+
+    std::shared_ptr<const SubscriberList> GetSubscribers() const;
+    static void Deliver(const SubscriberList& subscribers, StateDelivery delivery, const device_state_event_data_t& data);
 };
 
-#endif // _DEVICE_STATE_EVENT_H_ 
\ No newline at end of file
+#endif // _DEVICE_STATE_EVENT_H_
@@ -7,6 +7,7 @@
 #include "display.h"
 #include "board.h"
 #include "application.h"
+#include "boot_profiler.h"
 #include "font_awesome_symbols.h"
 #include "audio_codec.h"
 #include "settings.h"
@@ -429,4 +430,11 @@ void Display::DrawImageOnCanvas(int x, int y, int width, int height, const uint8
     lv_obj_move_foreground(chat_message_label_);
     
     // ESP_LOGI("Display", "Image drawn on canvas at x=%d, y=%d, w=%d, h=%d", x, y, width, height);
-}
\ No newline at end of file
+}
+
+void Display::TrackFirstFrame() {
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        // Later refreshes are ignored by the profiler
+        BootProfiler::GetInstance().Mark(kBootPhaseFirstFrame);
+    }, LV_EVENT_REFR_READY, nullptr);
+}
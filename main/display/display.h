@@ -78,6 +78,8 @@ protected:
     virtual void Unlock() = 0;
 
     virtual void Update();
+    // Record the first refresh of display_ in the boot timeline
+    void TrackFirstFrame();
 };
 
 
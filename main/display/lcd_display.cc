@@ -10,7 +10,7 @@
 #include "assets/lang_config.h"
 #include <cstring>
 #include "settings.h"
-#include "mcp_server.h"
+#include "robot_link.h"
 #include "lvgl.h" 
 #include "board.h"
 
@@ -142,6 +142,8 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         return;
     }
 
+    TrackFirstFrame();
+
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
     }
@@ -204,6 +206,8 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         ESP_LOGE(TAG, "Failed to add RGB display");
         return;
     }
+
+    TrackFirstFrame();
     
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
@@ -263,6 +267,8 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
         return;
     }
 
+    TrackFirstFrame();
+
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
     }
@@ -886,30 +892,30 @@ void LcdDisplay::SetEmotion(const char* emotion) {
     if (it != emotions.end()) {
         // lv_label_set_text(emotion_label_, it->icon);
         if(!strcmp(it->text, "happy")  ) {
-           send_uart_data('a');
+           RobotLink::GetInstance().Send('a');
            ESP_LOGW(TAG, "send a happy");
         } else if(!strcmp(it->text, "laughing")) {
-            send_uart_data('a');
+            RobotLink::GetInstance().Send('a');
             ESP_LOGW(TAG, "send a laughing");
         } else if(!strcmp(it->text, "relaxed") ) {
-             send_uart_data('6');
+             RobotLink::GetInstance().Send('6');
              ESP_LOGD(TAG, "send 6 relaxed");
         } else if(!strcmp(it->text, "funny") || !strcmp(it->text, "loving") ||  !strcmp(it->text, "kissy")) {
-            send_uart_data('a');
-            send_uart_data('c');
+            RobotLink::GetInstance().Send('a');
+            RobotLink::GetInstance().Send('c');
             ESP_LOGD(TAG, "send a,c funny,loving,kissy");
         } else if(!strcmp(it->text, "sad") || !strcmp(it->text, "crying") || !strcmp(it->text, "embarrassed") || !strcmp(it->text, "shocked") || !strcmp(it->text, "confused")) {
-            send_uart_data('5');
-            send_uart_data('d');
+            RobotLink::GetInstance().Send('5');
+            RobotLink::GetInstance().Send('d');
             ESP_LOGD(TAG, "send 5,d sad,crying,crying,shocked,confused");
         } else if(!strcmp(it->text, "surprised") || !strcmp(it->text, "thinking") || !strcmp(it->text, "c") || !strcmp(it->text, "delicious") || !strcmp(it->text, "silly")) {
-            send_uart_data('a');
-            send_uart_data('b');
-            send_uart_data('c');
+            RobotLink::GetInstance().Send('a');
+            RobotLink::GetInstance().Send('b');
+            RobotLink::GetInstance().Send('c');
             ESP_LOGD(TAG, "send a,b,c surprised,thinking,thinking,delicious");
         } else if(!strcmp(it->text, "angry") ) {
-            send_uart_data('5');
-            send_uart_data('d');
+            RobotLink::GetInstance().Send('5');
+            RobotLink::GetInstance().Send('d');
              ESP_LOGD(TAG, "send 5,d angry");
         } 
     } 
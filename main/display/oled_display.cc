@@ -57,6 +57,8 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
         return;
     }
 
+    TrackFirstFrame();
+
     if (height_ == 64) {
         SetupUI_128x64();
     } else {
@@ -0,0 +1,117 @@
+#include "event_loop_stats.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "EventLoop"
+
+static const char* const EVENT_TYPE_NAMES[] = {
+    "schedule",
+    "send_audio",
+    "send_control",
+    "wake_word",
+    "vad_change",
+    "error",
+    "clock_tick",
+};
+static_assert(sizeof(EVENT_TYPE_NAMES) / sizeof(EVENT_TYPE_NAMES[0]) == kMainEventTypeCount, "Missing event type name");
+
+// Upper bounds of the histogram buckets in microseconds, the last bucket is unbounded
+static const int64_t BUCKET_LIMITS_US[EVENT_LOOP_HISTOGRAM_BUCKETS - 1] = {
+    100, 1000, 5000, 10000, 50000, 100000, 500000
+};
+
+void LatencyHistogram::Add(int64_t elapsed_us) {
+    count++;
+    total_us += elapsed_us;
+    max_us = std::max(max_us, elapsed_us);
+    int bucket = 0;
+    while (bucket < EVENT_LOOP_HISTOGRAM_BUCKETS - 1 && elapsed_us >= BUCKET_LIMITS_US[bucket]) {
+        bucket++;
+    }
+    buckets[bucket]++;
+}
+
+void EventLoopStats::RecordDispatch(MainEventType type, int64_t elapsed_us, const char* file, int line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dispatch_[type].Add(elapsed_us);
+
+    if (elapsed_us < slow_threshold_ms_ * 1000LL) {
+        return;
+    }
+    slow_handlers_++;
+    last_slow_handler_us_ = elapsed_us;
+    if (file != nullptr) {
+        auto basename = strrchr(file, '/');
+        last_slow_handler_ = std::string(basename ? basename + 1 : file) + ":" + std::to_string(line);
+    } else {
+        last_slow_handler_ = EVENT_TYPE_NAMES[type];
+    }
+    ESP_LOGW(TAG, "Slow %s handler: %lld ms (%s)", EVENT_TYPE_NAMES[type], elapsed_us / 1000, last_slow_handler_.c_str());
+}
+
+void EventLoopStats::RecordQueueWait(int64_t wait_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_wait_.Add(wait_us);
+}
+
+void EventLoopStats::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& histogram : dispatch_) {
+        histogram = LatencyHistogram();
+    }
+    queue_wait_ = LatencyHistogram();
+    slow_handlers_ = 0;
+    last_slow_handler_.clear();
+    last_slow_handler_us_ = 0;
+}
+
+cJSON* LatencyHistogram::ToJson() const {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "count", count);
+    if (count > 0) {
+        cJSON_AddNumberToObject(json, "avg_us", total_us / count);
+        cJSON_AddNumberToObject(json, "max_us", max_us);
+    }
+    cJSON* bucket_array = cJSON_CreateArray();
+    for (int i = 0; i < EVENT_LOOP_HISTOGRAM_BUCKETS; i++) {
+        cJSON_AddItemToArray(bucket_array, cJSON_CreateNumber(buckets[i]));
+    }
+    cJSON_AddItemToObject(json, "buckets", bucket_array);
+    return json;
+}
+
+cJSON* EventLoopStats::ToJson(const ScheduleQueueStats& queue_stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+
+    cJSON* bounds = cJSON_CreateArray();
+    for (auto limit_us : BUCKET_LIMITS_US) {
+        cJSON_AddItemToArray(bounds, cJSON_CreateNumber(limit_us));
+    }
+    cJSON_AddItemToObject(root, "bucket_bounds_us", bounds);
+
+    cJSON* events = cJSON_CreateObject();
+    for (int i = 0; i < kMainEventTypeCount; i++) {
+        cJSON_AddItemToObject(events, EVENT_TYPE_NAMES[i], dispatch_[i].ToJson());
+    }
+    cJSON_AddItemToObject(root, "events", events);
+    cJSON_AddItemToObject(root, "schedule_wait", queue_wait_.ToJson());
+
+    cJSON* queue = cJSON_CreateObject();
+    cJSON_AddNumberToObject(queue, "pushed", queue_stats.pushed);
+    cJSON_AddNumberToObject(queue, "overflowed", queue_stats.overflowed);
+    cJSON_AddNumberToObject(queue, "heap_allocated", queue_stats.heap_allocated);
+    cJSON_AddNumberToObject(queue, "max_depth", queue_stats.max_depth);
+    cJSON_AddItemToObject(root, "schedule_queue", queue);
+
+    cJSON_AddNumberToObject(root, "slow_threshold_ms", slow_threshold_ms_);
+    cJSON_AddNumberToObject(root, "slow_handlers", slow_handlers_);
+    if (!last_slow_handler_.empty()) {
+        cJSON_AddStringToObject(root, "last_slow_handler", last_slow_handler_.c_str());
+        cJSON_AddNumberToObject(root, "last_slow_handler_ms", last_slow_handler_us_ / 1000);
+    }
+    return root;
+}
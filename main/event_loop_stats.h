@@ -0,0 +1,61 @@
+#ifndef _EVENT_LOOP_STATS_H_
+#define _EVENT_LOOP_STATS_H_
+
+#include "schedule_queue.h"
+
+#include <cJSON.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#define EVENT_LOOP_HISTOGRAM_BUCKETS 8
+#define EVENT_LOOP_SLOW_HANDLER_MS 50
+
+enum MainEventType {
+    kMainEventTypeSchedule,     // Counted per scheduled task
+    kMainEventTypeSendAudio,
+    kMainEventTypeSendControl,
+    kMainEventTypeWakeWord,
+    kMainEventTypeVadChange,
+    kMainEventTypeError,
+    kMainEventTypeClockTick,
+    kMainEventTypeCount
+};
+
+struct LatencyHistogram {
+    uint32_t count = 0;
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+    uint32_t buckets[EVENT_LOOP_HISTOGRAM_BUCKETS] = {};
+
+    void Add(int64_t elapsed_us);
+    cJSON* ToJson() const;
+};
+
+/*
+ * Dispatch counters and execution time histograms of the main event loop,
+ * plus how long scheduled tasks wait in the queue before they run.
+ * A handler slower than the threshold is logged with the Schedule callsite,
+ * since a blocked handler also holds up the audio uplink.
+ */
+class EventLoopStats {
+public:
+    void RecordDispatch(MainEventType type, int64_t elapsed_us, const char* file = nullptr, int line = 0);
+    void RecordQueueWait(int64_t wait_us);
+
+    void SetSlowThresholdMs(int threshold_ms) { slow_threshold_ms_ = threshold_ms; }
+    int slow_threshold_ms() const { return slow_threshold_ms_; }
+    void Reset();
+    cJSON* ToJson(const ScheduleQueueStats& queue_stats);
+
+private:
+    std::mutex mutex_;
+    LatencyHistogram dispatch_[kMainEventTypeCount];
+    LatencyHistogram queue_wait_;
+    uint32_t slow_handlers_ = 0;
+    std::string last_slow_handler_;
+    int64_t last_slow_handler_us_ = 0;
+    std::atomic<int> slow_threshold_ms_{EVENT_LOOP_SLOW_HANDLER_MS};
+};
+
+#endif // _EVENT_LOOP_STATS_H_
@@ -0,0 +1,178 @@
+#include "mcp_loopback.h"
+#include "mcp_server.h"
+#include "application.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <cJSON.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#define TAG "McpLoopback"
+
+// ReplyResult and ReplyError start every response like this
+static const char RESPONSE_PREFIX[] = "{\"jsonrpc\":\"2.0\",\"id\":";
+
+McpLoopback::McpLoopback() {
+    McpServer::GetInstance().SetTransport([this](const std::string& payload) {
+        OnMessage(payload);
+    });
+}
+
+McpLoopback::~McpLoopback() {
+    McpServer::GetInstance().SetTransport(nullptr);
+}
+
+void McpLoopback::OnMessage(const std::string& payload) {
+    auto now = esp_timer_get_time();
+    // Only the id is read here, so the response is not parsed within the measured time
+    int id = -1;
+    if (payload.compare(0, sizeof(RESPONSE_PREFIX) - 1, RESPONSE_PREFIX) == 0) {
+        id = atoi(payload.c_str() + sizeof(RESPONSE_PREFIX) - 1);
+    }
+    if (id < MCP_LOOPBACK_ID_BASE) {
+        Application::GetInstance().SendMcpMessage(payload);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    responses_[id] = Response{ payload, now };
+    min_free_heap_ = std::min(min_free_heap_, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    cv_.notify_all();
+}
+
+std::string McpLoopback::Call(const std::string& method, const std::string& params) {
+    return CallWithStats(method, method, params);
+}
+
+std::string McpLoopback::CallWithStats(const std::string& stats_name, const std::string& method, const std::string& params) {
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+    }
+    std::string request = "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) + ",\"method\":\"" + method + "\"";
+    if (!params.empty()) {
+        request += ",\"params\":" + params;
+    }
+    request += "}";
+
+    auto& stats = stats_[stats_name];
+    auto start_time = esp_timer_get_time();
+    cJSON* json = cJSON_Parse(request.c_str());
+    auto parsed_time = esp_timer_get_time();
+    if (json == nullptr) {
+        ESP_LOGE(TAG, "Failed to parse request: %s", request.c_str());
+        stats.errors++;
+        return "";
+    }
+    stats.parse.Add(parsed_time - start_time);
+    McpServer::GetInstance().ParseMessage(json);
+    cJSON_Delete(json);
+
+    Response response;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool answered = cv_.wait_for(lock, std::chrono::milliseconds(MCP_LOOPBACK_CALL_TIMEOUT_MS), [this, id]() {
+            return responses_.find(id) != responses_.end();
+        });
+        if (!answered) {
+            ESP_LOGW(TAG, "%s: No response in %d ms", stats_name.c_str(), MCP_LOOPBACK_CALL_TIMEOUT_MS);
+            stats.timeouts++;
+            return "";
+        }
+        response = std::move(responses_[id]);
+        responses_.erase(id);
+    }
+    stats.dispatch.Add(response.time_us - parsed_time);
+    stats.response_bytes = response.payload.size();
+    return response.payload;
+}
+
+std::string McpLoopback::RunBenchmark(const std::vector<std::string>& tools, int iterations, bool use_cache) {
+    auto& server = McpServer::GetInstance();
+    stats_.clear();
+    auto free_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    min_free_heap_ = free_before;
+    int requests = 0;
+    int tool_count = 0;
+
+    auto start_time = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        CallWithStats("initialize", "initialize", "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{}}");
+        requests++;
+
+        // Every page of tools/list, the cursor is taken from the previous response
+        std::string cursor;
+        int listed = 0;
+        do {
+            auto payload = CallWithStats("tools/list", "tools/list", cursor.empty() ? "" : "{\"cursor\":\"" + cursor + "\"}");
+            requests++;
+            cursor.clear();
+            cJSON* response = cJSON_Parse(payload.c_str());
+            auto result = cJSON_GetObjectItem(response, "result");
+            if (cJSON_IsObject(result)) {
+                listed += cJSON_GetArraySize(cJSON_GetObjectItem(result, "tools"));
+                auto next_cursor = cJSON_GetObjectItem(result, "nextCursor");
+                if (cJSON_IsString(next_cursor)) {
+                    cursor = next_cursor->valuestring;
+                }
+            } else {
+                stats_["tools/list"].errors++;
+            }
+            cJSON_Delete(response);
+        } while (!cursor.empty());
+        tool_count = listed;
+
+        for (const auto& tool : tools) {
+            if (!use_cache) {
+                server.InvalidateToolCache();
+            }
+            auto payload = CallWithStats(tool, "tools/call", "{\"name\":\"" + tool + "\",\"arguments\":{}}");
+            requests++;
+            cJSON* response = cJSON_Parse(payload.c_str());
+            auto result = cJSON_GetObjectItem(response, "result");
+            if (!cJSON_IsObject(result) || cJSON_IsTrue(cJSON_GetObjectItem(result, "isError"))) {
+                stats_[tool].errors++;
+            }
+            cJSON_Delete(response);
+        }
+    }
+    auto elapsed_us = esp_timer_get_time() - start_time;
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "iterations", iterations);
+    cJSON_AddNumberToObject(root, "tools", tool_count);
+    cJSON_AddNumberToObject(root, "requests", requests);
+    cJSON_AddNumberToObject(root, "elapsed_ms", elapsed_us / 1000);
+    if (elapsed_us > 0) {
+        cJSON_AddNumberToObject(root, "requests_per_second", (int)(requests * 1000000LL / elapsed_us));
+    }
+
+    cJSON* heap = cJSON_CreateObject();
+    cJSON_AddNumberToObject(heap, "free_before", free_before);
+    cJSON_AddNumberToObject(heap, "min_free", min_free_heap_);
+    cJSON_AddNumberToObject(heap, "free_after", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    cJSON_AddItemToObject(root, "heap", heap);
+
+    cJSON* methods = cJSON_CreateObject();
+    for (const auto& [name, stats] : stats_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddItemToObject(item, "parse", stats.parse.ToJson());
+        cJSON_AddItemToObject(item, "dispatch", stats.dispatch.ToJson());
+        cJSON_AddNumberToObject(item, "timeouts", stats.timeouts);
+        cJSON_AddNumberToObject(item, "errors", stats.errors);
+        cJSON_AddNumberToObject(item, "response_bytes", stats.response_bytes);
+        cJSON_AddItemToObject(methods, name.c_str(), item);
+    }
+    cJSON_AddItemToObject(root, "methods", methods);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    ESP_LOGI(TAG, "Benchmark: %d requests in %lld ms", requests, elapsed_us / 1000);
+    return json;
+}
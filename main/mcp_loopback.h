@@ -0,0 +1,65 @@
+#ifndef _MCP_LOOPBACK_H_
+#define _MCP_LOOPBACK_H_
+
+#include "event_loop_stats.h"
+
+#include <cstdint>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define MCP_LOOPBACK_ID_BASE 0x40000000     // Responses with a lower id go to the server as usual
+#define MCP_LOOPBACK_CALL_TIMEOUT_MS 10000
+
+/*
+ * Drives McpServer with scripted requests on the device, without a server
+ * session. While it exists it is the transport of the server: responses to
+ * its own requests are kept, everything else is passed on to the protocol.
+ *
+ * RunBenchmark() measures the parse and dispatch time of initialize and
+ * tools/list, the end to end latency of tools/call per tool and the heap
+ * used meanwhile, to track regressions as tools are added.
+ * Tools that need the large worker class cannot be called from the benchmark,
+ * which runs on it; they time out.
+ */
+class McpLoopback {
+public:
+    McpLoopback();
+    ~McpLoopback();
+    McpLoopback(const McpLoopback&) = delete;
+    McpLoopback& operator=(const McpLoopback&) = delete;
+
+    // Sends a request with the given method and params (JSON, may be empty) and
+    // waits for the response; empty on timeout
+    std::string Call(const std::string& method, const std::string& params);
+
+    std::string RunBenchmark(const std::vector<std::string>& tools, int iterations, bool use_cache);
+
+private:
+    struct MethodStats {
+        LatencyHistogram parse;         // cJSON_Parse of the request
+        LatencyHistogram dispatch;      // ParseMessage until the response reached the transport
+        uint32_t timeouts = 0;
+        uint32_t errors = 0;
+        size_t response_bytes = 0;      // Of the last response
+    };
+
+    struct Response {
+        std::string payload;
+        int64_t time_us = 0;        // When it reached the transport
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<int, Response> responses_;
+    int next_id_ = MCP_LOOPBACK_ID_BASE;
+    size_t min_free_heap_ = 0;
+    std::map<std::string, MethodStats> stats_;
+
+    void OnMessage(const std::string& payload);
+    std::string CallWithStats(const std::string& stats_name, const std::string& method, const std::string& params);
+};
+
+#endif // _MCP_LOOPBACK_H_
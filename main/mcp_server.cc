@@ -3,38 +3,245 @@
 #include <esp_app_desc.h>
 #include <algorithm>
 #include <cstring>
-#include <esp_pthread.h>
-#include "driver/uart.h"
 #include "application.h"
+#include "boot_profiler.h"
+#include "settings.h"
+#include "task_registry.h"
 #include "display.h"
+#include "device_state_event.h"
+#if CONFIG_USE_MCP_LOOPBACK_BENCHMARK
+#include "mcp_loopback.h"
+#endif
 #include "board.h"
+#include "robot_link.h"
+#if CONFIG_USE_OFFLINE_COMMANDS
+#include "offline_commands.h"
+#endif
 
 #define TAG "MCP"
-#define UART_NUM UART_NUM_2
-#define TX_PIN GPIO_NUM_46
-#define BAUD_RATE 115200
-#define DEFAULT_TOOLCALL_STACK_SIZE 6144
-
-void uart_initialize() {
-    const uart_config_t uart_config = {
-        .baud_rate = BAUD_RATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
-    };
-    uart_driver_install(UART_NUM, 1024 * 2, 0, 0, NULL, 0);
-    uart_param_config(UART_NUM, &uart_config);
-    uart_set_pin(UART_NUM, TX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+
+Property Property::Enum(const std::string& name, const std::vector<std::string>& values) {
+    Property property(name, kPropertyTypeString);
+    property.enum_values_ = values;
+    return property;
+}
+
+Property Property::Enum(const std::string& name, const std::vector<std::string>& values, const std::string& default_value) {
+    if (std::find(values.begin(), values.end(), default_value) == values.end()) {
+        throw std::invalid_argument("Default value must be one of the enum values");
+    }
+    Property property(name, kPropertyTypeString, default_value);
+    property.enum_values_ = values;
+    return property;
+}
+
+Property Property::Array(const std::string& name, PropertyType item_type, int min_items, int max_items) {
+    if (item_type != kPropertyTypeInteger && item_type != kPropertyTypeNumber && item_type != kPropertyTypeString) {
+        throw std::invalid_argument("Array items must be integers, numbers or strings");
+    }
+    Property property(name, kPropertyTypeArray);
+    property.item_type_ = item_type;
+    if (min_items > 0) {
+        property.min_value_ = min_items;
+    }
+    if (max_items >= 0) {
+        property.max_value_ = max_items;
+    }
+    return property;
+}
+
+Property Property::Object(const std::string& name, const PropertyList& properties) {
+    Property property(name, kPropertyTypeObject);
+    property.schema_ = std::make_shared<const PropertyList>(properties);
+    return property;
+}
+
+template<typename T>
+static std::vector<T> ParseArrayItems(const std::string& name, const cJSON* argument, bool (*is_type)(const cJSON*),
+    T (*get)(const cJSON*)) {
+    std::vector<T> items;
+    items.reserve(cJSON_GetArraySize(argument));
+    const cJSON* item;
+    cJSON_ArrayForEach(item, argument) {
+        if (!is_type(item)) {
+            throw std::invalid_argument("Invalid item type in array: " + name);
+        }
+        items.push_back(get(item));
+    }
+    return items;
+}
+
+bool Property::Parse(const cJSON* argument) {
+    switch (type_) {
+        case kPropertyTypeBoolean:
+            if (!cJSON_IsBool(argument)) {
+                return false;
+            }
+            set_value<bool>(argument->valueint == 1);
+            return true;
+        case kPropertyTypeInteger:
+            if (!cJSON_IsNumber(argument)) {
+                return false;
+            }
+            set_value<int>(argument->valueint);
+            return true;
+        case kPropertyTypeNumber:
+            if (!cJSON_IsNumber(argument)) {
+                return false;
+            }
+            set_value<double>(argument->valuedouble);
+            return true;
+        case kPropertyTypeString:
+            if (!cJSON_IsString(argument)) {
+                return false;
+            }
+            if (!enum_values_.empty() &&
+                std::find(enum_values_.begin(), enum_values_.end(), argument->valuestring) == enum_values_.end()) {
+                throw std::invalid_argument("Invalid value for " + name_ + ": " + argument->valuestring);
+            }
+            set_value<std::string>(argument->valuestring);
+            return true;
+        case kPropertyTypeArray: {
+            if (!cJSON_IsArray(argument)) {
+                return false;
+            }
+            int size = cJSON_GetArraySize(argument);
+            if ((min_value_.has_value() && size < min_value_.value()) || (max_value_.has_value() && size > max_value_.value())) {
+                throw std::invalid_argument("Invalid number of items in array: " + name_);
+            }
+            if (item_type_ == kPropertyTypeInteger) {
+                value_ = ParseArrayItems<int>(name_, argument, [](const cJSON* item) -> bool { return cJSON_IsNumber(item); },
+                    [](const cJSON* item) { return item->valueint; });
+            } else if (item_type_ == kPropertyTypeNumber) {
+                value_ = ParseArrayItems<double>(name_, argument, [](const cJSON* item) -> bool { return cJSON_IsNumber(item); },
+                    [](const cJSON* item) { return item->valuedouble; });
+            } else {
+                value_ = ParseArrayItems<std::string>(name_, argument, [](const cJSON* item) -> bool { return cJSON_IsString(item); },
+                    [](const cJSON* item) { return std::string(item->valuestring); });
+            }
+            return true;
+        }
+        case kPropertyTypeObject: {
+            if (!cJSON_IsObject(argument)) {
+                return false;
+            }
+            auto properties = std::make_shared<PropertyList>(*schema_);
+            properties->Parse(argument);
+            value_ = std::shared_ptr<const PropertyList>(std::move(properties));
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* PropertyTypeName(PropertyType type) {
+    switch (type) {
+        case kPropertyTypeBoolean: return "boolean";
+        case kPropertyTypeInteger: return "integer";
+        case kPropertyTypeString: return "string";
+        case kPropertyTypeNumber: return "number";
+        case kPropertyTypeArray: return "array";
+        case kPropertyTypeObject: return "object";
+    }
+    return "string";
 }
 
-void send_uart_data(char command) {
-    uart_write_bytes(UART_NUM, &command, 1);
-/*     ESP_LOGI(TAG, "发送命令: %c", command); */
+cJSON* Property::ToJsonSchema() const {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", PropertyTypeName(type_));
+
+    if (type_ == kPropertyTypeBoolean) {
+        if (has_default_value_) {
+            cJSON_AddBoolToObject(json, "default", value<bool>());
+        }
+    } else if (type_ == kPropertyTypeInteger || type_ == kPropertyTypeNumber) {
+        if (has_default_value_) {
+            cJSON_AddNumberToObject(json, "default", type_ == kPropertyTypeInteger ? value<int>() : value<double>());
+        }
+        if (min_value_.has_value()) {
+            cJSON_AddNumberToObject(json, "minimum", min_value_.value());
+        }
+        if (max_value_.has_value()) {
+            cJSON_AddNumberToObject(json, "maximum", max_value_.value());
+        }
+    } else if (type_ == kPropertyTypeString) {
+        if (!enum_values_.empty()) {
+            cJSON *values = cJSON_CreateArray();
+            for (const auto& enum_value : enum_values_) {
+                cJSON_AddItemToArray(values, cJSON_CreateString(enum_value.c_str()));
+            }
+            cJSON_AddItemToObject(json, "enum", values);
+        }
+        if (has_default_value_) {
+            cJSON_AddStringToObject(json, "default", value<std::string>().c_str());
+        }
+    } else if (type_ == kPropertyTypeArray) {
+        cJSON *items = cJSON_CreateObject();
+        cJSON_AddStringToObject(items, "type", PropertyTypeName(item_type_));
+        cJSON_AddItemToObject(json, "items", items);
+        if (min_value_.has_value()) {
+            cJSON_AddNumberToObject(json, "minItems", min_value_.value());
+        }
+        if (max_value_.has_value()) {
+            cJSON_AddNumberToObject(json, "maxItems", max_value_.value());
+        }
+    } else if (type_ == kPropertyTypeObject) {
+        schema_->AddToJsonSchema(json);
+    }
+    return json;
+}
+
+void PropertyList::Parse(const cJSON* arguments) {
+    for (auto& property : properties_) {
+        auto argument = cJSON_IsObject(arguments) ? cJSON_GetObjectItem(arguments, property.name().c_str()) : nullptr;
+        bool found = argument != nullptr && property.Parse(argument);
+        if (!found && !property.has_default_value()) {
+            throw std::invalid_argument("Missing valid argument: " + property.name());
+        }
+    }
+}
+
+void PropertyList::AddToJsonSchema(cJSON* schema) const {
+    cJSON *properties = cJSON_CreateObject();
+    cJSON *required = cJSON_CreateArray();
+    for (const auto& property : properties_) {
+        cJSON_AddItemToObject(properties, property.name().c_str(), property.ToJsonSchema());
+        if (!property.has_default_value()) {
+            cJSON_AddItemToArray(required, cJSON_CreateString(property.name().c_str()));
+        }
+    }
+    cJSON_AddItemToObject(schema, "properties", properties);
+    if (cJSON_GetArraySize(required) > 0) {
+        cJSON_AddItemToObject(schema, "required", required);
+    } else {
+        cJSON_Delete(required);
+    }
 }
 
-McpServer::McpServer() {
-    uart_initialize();
+McpServer::McpServer() : tool_pool_([this](int id, bool success, const std::string& payload) {
+        if (id < 0) {
+            std::function<void(bool, const std::string&)> done;
+            {
+                std::lock_guard<std::mutex> lock(local_calls_mutex_);
+                auto it = local_calls_.find(id);
+                if (it == local_calls_.end()) {
+                    return;
+                }
+                done = std::move(it->second);
+                local_calls_.erase(it);
+            }
+            if (done) {
+                done(success, payload);
+            }
+            return;
+        }
+        CompleteToolCall(id, success, payload);
+    }) {
+    RobotLink::GetInstance().Start();
+    // Status results like the volume or the network state may change with the device state
+    DeviceStateEventManager::GetInstance().RegisterStateChangeCallback([this](DeviceState, DeviceState) {
+        InvalidateToolCache();
+    }, kStateDeliveryInline, "mcp_tool_cache");
 }
 
 McpServer::~McpServer() {
@@ -44,6 +251,37 @@ McpServer::~McpServer() {
     tools_.clear();
 }
 
+// Speed and duration only exist with the framed protocol, the byte protocol has no parameters
+#if CONFIG_ROBOT_UART_FRAMED
+#define MOTION_TOOL_DESCRIPTION(action) action "。speed: 速度百分比；duration_ms: 持续时间，0 表示由底盘决定"
+
+static PropertyList MotionProperties() {
+    return PropertyList({
+        Property("speed", kPropertyTypeInteger, 50, 0, 100),
+        Property("duration_ms", kPropertyTypeInteger, 0, 0, 10000)
+    });
+}
+
+static bool SendMotionCommand(uint8_t command, const PropertyList& properties) {
+    int duration_ms = properties["duration_ms"].value<int>();
+    return RobotLink::GetInstance().SendAndWait(command, {
+        (uint8_t)properties["speed"].value<int>(),
+        (uint8_t)(duration_ms & 0xFF),
+        (uint8_t)(duration_ms >> 8)
+    });
+}
+#else
+#define MOTION_TOOL_DESCRIPTION(action) action
+
+static PropertyList MotionProperties() {
+    return PropertyList();
+}
+
+static bool SendMotionCommand(uint8_t command, const PropertyList& properties) {
+    return RobotLink::GetInstance().SendAndWait(command);
+}
+#endif
+
 void McpServer::AddCommonTools() {
     // To speed up the response time, we add the common tools to the beginning of
     // the tools list to utilize the prompt cache.
@@ -51,136 +289,119 @@ void McpServer::AddCommonTools() {
     auto original_tools = std::move(tools_);
     auto& board = Board::GetInstance();
     AddTool("move_forward",
-        "前进",
-        PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('1');
-            return true;
+        MOTION_TOOL_DESCRIPTION("前进"),
+        MotionProperties(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return SendMotionCommand('1', properties);
         });
 
     AddTool("move_backward",
-        "后退",
-        PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('2');
-            return true;
+        MOTION_TOOL_DESCRIPTION("后退"),
+        MotionProperties(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return SendMotionCommand('2', properties);
         });
 
     AddTool("move_Left",
-        "左转",
-        PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('3');
-            return true;
+        MOTION_TOOL_DESCRIPTION("左转"),
+        MotionProperties(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return SendMotionCommand('3', properties);
         });
 
     AddTool("move_Right",
-        "右转",
-        PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('4');
-            return true;
+        MOTION_TOOL_DESCRIPTION("右转"),
+        MotionProperties(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return SendMotionCommand('4', properties);
         });
 
     AddTool("STOP",
         "停止",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('0');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('0');
         });
     AddTool("nod_head",
         "点点头",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('6');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('6');
         });
 
     AddTool("shake_head",
         "摇摇头",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('5');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('5');
         });
 
     AddTool("move_LeftEar",
         "动一下左耳朵",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('8');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('8');
         });
 
     AddTool("move_RightEar",
         "动一下右耳朵",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('9');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('9');
         });
 
     AddTool("动两个耳朵",
         "动动耳朵",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('a');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('a');
         });
 
     AddTool("思考",
         "think",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('b');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('b');
         });
 
     AddTool("摇摆",
         "晃一晃",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('c');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('c');
         });
 
     AddTool("低头",
         "lower_head",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('d');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('d');
         });
 
     AddTool("转一圈",
         "转圈",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('e');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('e');
         });
 
     AddTool("向左看",
         "seeleft",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('g');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('g');
         });
     AddTool("向右看",
         "seeright",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('f');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('f');
         });
     AddTool("向前看",
         "lookforward",
         PropertyList(),
-        [this](const PropertyList& properties) -> ReturnValue {
-            send_uart_data('h');
-            return true;
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().SendAndWait('h');
         });
     AddTool("self.get_device_status",
         "Provides the real-time information of the device, including the current status of the audio speaker, screen, battery, network, etc.\n"
@@ -190,6 +411,131 @@ void McpServer::AddCommonTools() {
         PropertyList(),
         [&board](const PropertyList& properties) -> ReturnValue {
             return board.GetDeviceStatusJson();
+        }, McpToolOptions{ .cache_ttl_ms = 5000 });
+
+    AddTool("self.network.get_diagnostics",
+        "Provides the network diagnostics of the device: round-trip time, jitter, packet loss and throughput of the "
+        "server connection, reconnect statistics, the latency of control messages and the count of incoming messages by type.\n"
+        "Use this tool when the user asks about the network quality or why the responses are slow.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetNetworkDiagnosticsJson();
+        });
+
+    AddTool("self.debug.get_event_loop_stats",
+        "Debug tool: returns dispatch counts and execution time histograms of the main event loop, the wait time of "
+        "scheduled tasks, the slow handlers, how long device state changes take to show on the screen and the time spent "
+        "in each state change listener.\n"
+        "Args:\n"
+        "  `slow_threshold_ms`: Log handlers slower than this, 0 keeps the current threshold.\n"
+        "  `reset`: Clear the statistics after returning them.",
+        PropertyList({
+            Property("slow_threshold_ms", kPropertyTypeInteger, 0, 0, 10000),
+            Property("reset", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& app = Application::GetInstance();
+            int threshold_ms = properties["slow_threshold_ms"].value<int>();
+            if (threshold_ms > 0) {
+                app.GetEventLoopStats().SetSlowThresholdMs(threshold_ms);
+            }
+            auto json = app.GetEventLoopStatsJson();
+            if (properties["reset"].value<bool>()) {
+                app.ResetEventLoopStats();
+            }
+            return json;
+        });
+
+    AddTool("self.debug.get_boot_timeline",
+        "Debug tool: returns when each boot phase (board, codec, audio_processor, wake_word, network, version_check, "
+        "protocol, first_frame, ready) started and how long it took, as [start_ms, duration_ms], for the current boot "
+        "and the previous boots since power-on, with the reset reason of each.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return BootProfiler::GetInstance().GetJson();
+        });
+
+    AddTool("self.debug.get_settings_stats",
+        "Debug tool: returns how many settings writes were requested, how many were skipped because the value was "
+        "unchanged, and how many keys and commits actually reached the NVS flash.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return SettingsStore::GetInstance().GetStatsJson();
+        });
+
+    AddTool("self.debug.get_task_stats",
+        "Debug tool: returns the stack size, priority and core of every task in the task registry, whether the board "
+        "overrides it, and for running tasks the least free stack ever (bytes) and the CPU share since the previous call.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return TaskRegistry::GetInstance().GetJson();
+        });
+
+    AddTool("self.debug.get_tool_stats",
+        "Debug tool: returns the MCP tool worker pool state (queued and running calls, workers per stack class) and "
+        "for every tool the number of calls, rejections, timeouts, cancellations and errors, with queue wait and "
+        "execution time histograms. `cache` has the hits, misses and coalesced calls of the tools with cached results.",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return "{\"pool\":" + tool_pool_.GetStatsJson() + ",\"cache\":" + GetToolCacheStatsJson() + "}";
+        });
+
+#if CONFIG_USE_MCP_LOOPBACK_BENCHMARK
+    AddTool("self.debug.run_mcp_benchmark",
+        "Debug tool: sends `initialize`, every page of `tools/list` and a call of each tool in `tools` (without arguments) "
+        "to this MCP server over a local loopback, `iterations` times, and returns the parse and dispatch time histograms "
+        "per method and tool, the response sizes, the requests per second and the lowest free internal heap.\n"
+        "Args:\n"
+        "  `tools`: Tools to call, they must not need arguments or change the device state.\n"
+        "  `use_cache`: Keep the cached tool results between calls, false measures the tools themselves.",
+        PropertyList({
+            Property("tools", kPropertyTypeArray, std::vector<std::string>{ "self.get_device_status" }),
+            Property("iterations", kPropertyTypeInteger, 10, 1, 50),
+            Property("use_cache", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            McpLoopback loopback;
+            return loopback.RunBenchmark(properties["tools"].value<std::vector<std::string>>(),
+                properties["iterations"].value<int>(), properties["use_cache"].value<bool>());
+        }, McpToolOptions{ .stack_class = kToolStackLarge, .timeout_ms = 0 });
+#endif
+
+#if CONFIG_USE_OFFLINE_COMMANDS
+    AddTool("self.offline_commands.get_table",
+        "Get the command words recognized and run on the device without the server, and how often each one was "
+        "detected, rejected under its threshold or failed, with the latency from detection to the end of the action.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& commands = OfflineCommands::GetInstance();
+            return "{\"table\":" + commands.GetTableJson() + ",\"stats\":" + commands.GetStatsJson() + "}";
+        });
+
+    AddTool("self.offline_commands.set_table",
+        "Replace the offline command words, applied after a reboot.\n"
+        "Args:\n"
+        "  `table`: JSON array of objects with `phrase` (pinyin with spaces, like \"da sheng yi dian\"), optional `text` "
+        "to display, either `tool` (a tool of this device) with optional `arguments`, or `handler` (volume_up, volume_down, "
+        "stop_speaking or one registered by the board), optional `threshold` (0 to 1) and `notify`. Empty restores the defaults.",
+        PropertyList({
+            Property("table", kPropertyTypeString, "")
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto table = properties["table"].value<std::string>();
+            if (table.empty()) {
+                OfflineCommands::GetInstance().ResetTable();
+            } else {
+                OfflineCommands::GetInstance().SaveTableJson(table);
+            }
+            return true;
+        });
+#endif
+
+    AddTool("self.debug.get_robot_link_stats",
+        "Debug tool: returns the counters of the UART link to the robot peripheral: commands sent, acked, nacked, "
+        "retransmitted, failed and dropped, CRC errors, telemetry frames and the last telemetry payload in hex.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return RobotLink::GetInstance().GetStatsJson();
         });
 
     AddTool("self.audio_speaker.set_volume", 
@@ -222,7 +568,7 @@ void McpServer::AddCommonTools() {
         AddTool("self.screen.set_theme",
             "Set the theme of the screen. The theme can be `light` or `dark`.",
             PropertyList({
-                Property("theme", kPropertyTypeString)
+                Property::Enum("theme", {"light", "dark"})
             }),
             [display](const PropertyList& properties) -> ReturnValue {
                 display->SetTheme(properties["theme"].value<std::string>().c_str());
@@ -242,31 +588,43 @@ void McpServer::AddCommonTools() {
                 Property("question", kPropertyTypeString)
             }),
             [camera](const PropertyList& properties) -> ReturnValue {
+                McpToolContext::ReportProgress(0, 2, "Capturing");
                 if (!camera->Capture()) {
                     return "{\"success\": false, \"message\": \"Failed to capture photo\"}";
                 }
+                if (McpToolContext::IsCancelled()) {
+                    return "{\"success\": false, \"message\": \"Cancelled\"}";
+                }
+                McpToolContext::ReportProgress(1, 2, "Explaining");
                 auto question = properties["question"].value<std::string>();
                 return camera->Explain(question);
-            });
+            }, McpToolOptions{ .stack_class = kToolStackLarge, .timeout_ms = 60000 });
     }
 
     // Restore the original tools list to the end of the tools list
     tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
+
+    std::lock_guard<std::mutex> lock(tools_list_mutex_);
+    tools_list_dirty_ = true;
 }
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (!tool_index_.emplace(tool->name(), tool).second) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
 
     ESP_LOGI(TAG, "Add tool: %s", tool->name().c_str());
     tools_.push_back(tool);
+
+    std::lock_guard<std::mutex> lock(tools_list_mutex_);
+    tools_list_dirty_ = true;
 }
 
-void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
-    AddTool(new McpTool(name, description, properties, callback));
+void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+    const McpToolOptions& options) {
+    AddTool(new McpTool(name, description, properties, callback, options));
 }
 
 void McpServer::ParseMessage(const std::string& message) {
@@ -299,36 +657,104 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
 }
 
 void McpServer::ParseMessage(const cJSON* json) {
+    if (cJSON_IsArray(json)) {
+        ParseBatch(json);
+    } else {
+        HandleRequest(json);
+    }
+}
+
+/*
+ * The ids of a batch are registered before its requests are handled, so replies
+ * sent right away and replies sent later by tool workers both land in the batch.
+ * The batch itself holds one pending entry until all its requests are handled.
+ */
+void McpServer::ParseBatch(const cJSON* json) {
+    if (cJSON_GetArraySize(json) == 0) {
+        ESP_LOGE(TAG, "Empty batch");
+        return;
+    }
+
+    auto batch = std::make_shared<McpBatch>();
+    batch->pending = 1;
+    const cJSON* request;
+    cJSON_ArrayForEach(request, json) {
+        auto id = cJSON_GetObjectItem(request, "id");
+        bool has_id = cJSON_IsObject(request) && cJSON_IsNumber(id);
+        if (has_id) {
+            // The response of a call already running under this id must not be taken over
+            bool registered = false;
+            if (!IsCallInProgress(id->valueint)) {
+                std::lock_guard<std::mutex> lock(batch_mutex_);
+                registered = batch_ids_.emplace(id->valueint, batch).second;
+            }
+            {
+                std::lock_guard<std::mutex> lock(batch_mutex_);
+                batch->pending++;
+            }
+            if (!registered) {
+                ESP_LOGW(TAG, "Batch: id %d is already in progress", id->valueint);
+                std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id->valueint) +
+                    ",\"error\":{\"message\":\"Request id is already in progress\"}}";
+                FinishBatchEntry(batch, &payload);
+                continue;
+            }
+        }
+        if (!HandleRequest(request) && has_id) {
+            // Dropped without a response
+            DropReply(id->valueint);
+        }
+    }
+    FinishBatchEntry(batch, nullptr);
+}
+
+bool McpServer::HandleRequest(const cJSON* json) {
     // Check JSONRPC version
     auto version = cJSON_GetObjectItem(json, "jsonrpc");
     if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
         ESP_LOGE(TAG, "Invalid JSONRPC version: %s", version ? version->valuestring : "null");
-        return;
+        return false;
     }
     
     // Check method
     auto method = cJSON_GetObjectItem(json, "method");
     if (method == nullptr || !cJSON_IsString(method)) {
         ESP_LOGE(TAG, "Missing method");
-        return;
+        return false;
     }
     
     auto method_str = std::string(method->valuestring);
+    if (method_str == "notifications/cancelled") {
+        auto params = cJSON_GetObjectItem(json, "params");
+        auto request_id = cJSON_GetObjectItem(params, "requestId");
+        if (cJSON_IsNumber(request_id)) {
+            if (CancelCoalescedCall(request_id->valueint)) {
+                DropReply(request_id->valueint);
+            } else if (tool_pool_.Cancel(request_id->valueint)) {
+                DropReply(request_id->valueint);
+                // Identical calls waiting for this one get an error
+                CompleteToolCall(request_id->valueint, false, "Cancelled", false);
+            } else {
+                ESP_LOGW(TAG, "notifications/cancelled: No call in progress with id %d", request_id->valueint);
+            }
+        }
+        return false;
+    }
     if (method_str.find("notifications") == 0) {
-        return;
+        return false;
     }
     
     // Check params
     auto params = cJSON_GetObjectItem(json, "params");
     if (params != nullptr && !cJSON_IsObject(params)) {
         ESP_LOGE(TAG, "Invalid params for method: %s", method_str.c_str());
-        return;
+        return false;
     }
 
     auto id = cJSON_GetObjectItem(json, "id");
     if (id == nullptr || !cJSON_IsNumber(id)) {
         ESP_LOGE(TAG, "Invalid id for method: %s", method_str.c_str());
-        return;
+        return false;
     }
     auto id_int = id->valueint;
     
@@ -357,31 +783,36 @@ void McpServer::ParseMessage(const cJSON* json) {
         if (!cJSON_IsObject(params)) {
             ESP_LOGE(TAG, "tools/call: Missing params");
             ReplyError(id_int, "Missing params");
-            return;
+            return true;
         }
         auto tool_name = cJSON_GetObjectItem(params, "name");
         if (!cJSON_IsString(tool_name)) {
             ESP_LOGE(TAG, "tools/call: Missing name");
             ReplyError(id_int, "Missing name");
-            return;
+            return true;
         }
         auto tool_arguments = cJSON_GetObjectItem(params, "arguments");
         if (tool_arguments != nullptr && !cJSON_IsObject(tool_arguments)) {
             ESP_LOGE(TAG, "tools/call: Invalid arguments");
             ReplyError(id_int, "Invalid arguments");
-            return;
+            return true;
         }
         auto stack_size = cJSON_GetObjectItem(params, "stackSize");
         if (stack_size != nullptr && !cJSON_IsNumber(stack_size)) {
             ESP_LOGE(TAG, "tools/call: Invalid stackSize");
             ReplyError(id_int, "Invalid stackSize");
-            return;
+            return true;
         }
-        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : DEFAULT_TOOLCALL_STACK_SIZE);
+        // A progress token asks for notifications/progress while the tool runs
+        auto meta = cJSON_GetObjectItem(params, "_meta");
+        auto progress_token = cJSON_IsObject(meta) ? cJSON_GetObjectItem(meta, "progressToken") : nullptr;
+        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : 0,
+            cJSON_IsString(progress_token) || cJSON_IsNumber(progress_token) ? progress_token : nullptr);
     } else {
         ESP_LOGE(TAG, "Method not implemented: %s", method_str.c_str());
         ReplyError(id_int, "Method not implemented: " + method_str);
     }
+    return true;
 }
 
 void McpServer::ReplyResult(int id, const std::string& result) {
@@ -389,126 +820,415 @@ void McpServer::ReplyResult(int id, const std::string& result) {
     payload += std::to_string(id) + ",\"result\":";
     payload += result;
     payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+    SendReply(id, payload);
 }
 
+// The message may quote arguments sent by the server, cJSON escapes it
 void McpServer::ReplyError(int id, const std::string& message) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id);
-    payload += ",\"error\":{\"message\":\"";
-    payload += message;
-    payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "jsonrpc", "2.0");
+    cJSON_AddNumberToObject(root, "id", id);
+    cJSON* error = cJSON_CreateObject();
+    cJSON_AddStringToObject(error, "message", message.c_str());
+    cJSON_AddItemToObject(root, "error", error);
+
+    auto payload_str = cJSON_PrintUnformatted(root);
+    std::string payload(payload_str);
+    cJSON_free(payload_str);
+    cJSON_Delete(root);
+    SendReply(id, payload);
+}
+
+void McpServer::SendReply(int id, const std::string& payload) {
+    std::shared_ptr<McpBatch> batch;
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        auto it = batch_ids_.find(id);
+        if (it != batch_ids_.end()) {
+            batch = std::move(it->second);
+            batch_ids_.erase(it);
+        }
+    }
+    if (batch) {
+        FinishBatchEntry(batch, &payload);
+    } else {
+        SendMessage(payload);
+    }
+}
+
+void McpServer::DropReply(int id) {
+    std::shared_ptr<McpBatch> batch;
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        auto it = batch_ids_.find(id);
+        if (it == batch_ids_.end()) {
+            return;
+        }
+        batch = std::move(it->second);
+        batch_ids_.erase(it);
+    }
+    FinishBatchEntry(batch, nullptr);
+}
+
+void McpServer::FinishBatchEntry(const std::shared_ptr<McpBatch>& batch, const std::string* payload) {
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        if (payload != nullptr) {
+            if (!batch->responses.empty()) {
+                batch->responses += ",";
+            }
+            batch->responses += *payload;
+        }
+        if (--batch->pending > 0 || batch->responses.empty()) {
+            // A batch of notifications only gets no response
+            return;
+        }
+        message = "[" + batch->responses + "]";
+    }
+    SendMessage(message);
+}
+
+void McpServer::SetTransport(std::function<void(const std::string&)> transport) {
+    std::lock_guard<std::mutex> lock(transport_mutex_);
+    transport_ = std::move(transport);
+}
+
+void McpServer::SendMessage(const std::string& payload) {
+    std::function<void(const std::string&)> transport;
+    {
+        std::lock_guard<std::mutex> lock(transport_mutex_);
+        transport = transport_;
+    }
+    if (transport) {
+        transport(payload);
+    } else {
+        Application::GetInstance().SendMcpMessage(payload);
+    }
+}
+
+void McpServer::SendProgress(const ToolJob& job, int progress, int total, const std::string& message) {
+    cJSON* params = cJSON_CreateObject();
+    cJSON_AddItemToObject(params, "progressToken", cJSON_Parse(job.progress_token.c_str()));
+    cJSON_AddNumberToObject(params, "progress", progress);
+    if (total > 0) {
+        cJSON_AddNumberToObject(params, "total", total);
+    }
+    if (!message.empty()) {
+        cJSON_AddStringToObject(params, "message", message.c_str());
+    }
+    SendNotification("notifications/progress", params);
+}
+
+void McpServer::SendNotification(const std::string& method, cJSON* params) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "jsonrpc", "2.0");
+    cJSON_AddStringToObject(root, "method", method.c_str());
+    if (params != nullptr) {
+        cJSON_AddItemToObject(root, "params", params);
+    }
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string payload(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    SendMessage(payload);
+}
+
+bool McpToolContext::IsCancelled() {
+    return ToolWorkerPool::IsCurrentCallCancelled();
+}
+
+void McpToolContext::ReportProgress(int progress, int total, const std::string& message) {
+    auto job = ToolWorkerPool::CurrentJob();
+    if (job == nullptr || job->progress_token.empty() || job->finished) {
+        return;
+    }
+    McpServer::GetInstance().SendProgress(*job, progress, total, message);
 }
 
 void McpServer::GetToolsList(int id, const std::string& cursor) {
+    std::lock_guard<std::mutex> lock(tools_list_mutex_);
+    if (tools_list_dirty_) {
+        BuildToolsListPages();
+    }
+
+    size_t page_index = 0;
+    if (!cursor.empty()) {
+        auto it = tools_list_cursors_.find(cursor);
+        if (it == tools_list_cursors_.end()) {
+            ESP_LOGE(TAG, "tools/list: Unknown cursor %s", cursor.c_str());
+            ReplyError(id, "Unknown cursor: " + cursor);
+            return;
+        }
+        page_index = it->second;
+    }
+
+    auto& page = tools_list_pages_[page_index];
+    if (!page.error.empty()) {
+        ESP_LOGE(TAG, "tools/list: %s", page.error.c_str());
+        ReplyError(id, page.error);
+        return;
+    }
+    ReplyResult(id, page.json);
+}
+
+void McpServer::BuildToolsListPages() {
     const int max_payload_size = 8000;
+    auto start_time = esp_timer_get_time();
+    tools_list_pages_.clear();
+    tools_list_cursors_.clear();
+
     std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
-            }
-        }
-        
+    for (auto tool : tools_) {
         // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
+        std::string tool_json = tool->to_json() + ",";
+        if (json.length() + tool_json.length() + 30 > max_payload_size && json.back() != '[') {
+            // 如果添加这个tool会超出大小限制，设置nextCursor并开始新的一页
+            json.pop_back();
+            json += "],\"nextCursor\":\"" + tool->name() + "\"}";
+            tools_list_pages_.push_back({ std::move(json), "" });
+            tools_list_cursors_[tool->name()] = tools_list_pages_.size();
+            json = "{\"tools\":[";
+        }
         if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
+            // 如果一页只放这一个tool也超出限制，这一页返回错误
+            tools_list_pages_.push_back({ "", "Failed to add tool " + tool->name() + " because of payload size limit" });
             break;
         }
-        
         json += tool_json;
-        ++it;
-    }
-    
-    if (json.back() == ',') {
-        json.pop_back();
-    }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
-        return;
     }
-
-    if (next_cursor.empty()) {
+    if (tools_list_pages_.empty() || tools_list_pages_.back().error.empty()) {
+        if (json.back() == ',') {
+            json.pop_back();
+        }
         json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+        tools_list_pages_.push_back({ std::move(json), "" });
     }
-    
-    ReplyResult(id, json);
+
+    tools_list_dirty_ = false;
+    ESP_LOGI(TAG, "tools/list: %u tools in %u pages, built in %lld us", tools_.size(), tools_list_pages_.size(),
+        esp_timer_get_time() - start_time);
 }
 
-void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size, const cJSON* progress_token) {
+    auto tool_iter = tool_index_.find(tool_name);
+    if (tool_iter == tool_index_.end()) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
         ReplyError(id, "Unknown tool: " + tool_name);
         return;
     }
+    auto tool = tool_iter->second;
 
-    PropertyList arguments = (*tool_iter)->properties();
+    PropertyList arguments = tool->properties();
     try {
-        for (auto& argument : arguments) {
-            bool found = false;
-            if (cJSON_IsObject(tool_arguments)) {
-                auto value = cJSON_GetObjectItem(tool_arguments, argument.name().c_str());
-                if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
-                    argument.set_value<bool>(value->valueint == 1);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
-                    argument.set_value<int>(value->valueint);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
-                    argument.set_value<std::string>(value->valuestring);
-                    found = true;
+        arguments.Parse(tool_arguments);
+    } catch (const std::exception& e) {
+        ESP_LOGE(TAG, "tools/call: %s", e.what());
+        ReplyError(id, e.what());
+        return;
+    }
+
+    auto cache_ttl_ms = tool->options().cache_ttl_ms;
+    if (cache_ttl_ms > 0) {
+        auto cache_key = tool->name();
+        if (tool_arguments != nullptr) {
+            auto arguments_str = cJSON_PrintUnformatted(tool_arguments);
+            cache_key += arguments_str;
+            cJSON_free(arguments_str);
+        }
+
+        std::string cached_result;
+        {
+            std::lock_guard<std::mutex> lock(tool_cache_mutex_);
+            auto& stats = tool_cache_stats_[tool->name()];
+            auto it = tool_cache_.find(cache_key);
+            if (it != tool_cache_.end() && esp_timer_get_time() < it->second.expire_time_us) {
+                stats.hits++;
+                cached_result = it->second.result;
+            } else {
+                auto inflight = tool_cache_inflight_.find(cache_key);
+                if (inflight != tool_cache_inflight_.end()) {
+                    stats.coalesced++;
+                    tool_cache_calls_[inflight->second].waiters.push_back(id);
+                    return;
                 }
+                stats.misses++;
+                tool_cache_inflight_[cache_key] = id;
+                tool_cache_calls_[id] = InflightToolCall{ cache_key, cache_ttl_ms, tool_cache_generation_, {} };
             }
+        }
+        if (!cached_result.empty()) {
+            ReplyResult(id, cached_result);
+            return;
+        }
+    }
 
-            if (!argument.has_default_value() && !found) {
-                ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", argument.name().c_str());
-                ReplyError(id, "Missing valid argument: " + argument.name());
-                return;
-            }
+    // Run the tool on a worker to avoid blocking the main thread
+    auto job = MakeToolJob(id, tool, std::move(arguments), stack_size);
+    if (progress_token != nullptr) {
+        auto token_str = cJSON_PrintUnformatted(progress_token);
+        job->progress_token = token_str;
+        cJSON_free(token_str);
+    }
+    if (!tool_pool_.Submit(std::move(job))) {
+        CompleteToolCall(id, false, "Too many tool calls in progress");
+    }
+}
+
+// The worker stacks are fixed, a stackSize above the default class moves the call to the large class
+std::shared_ptr<ToolJob> McpServer::MakeToolJob(int id, McpTool* tool, PropertyList arguments, int stack_size) {
+    auto job = std::make_shared<ToolJob>();
+    job->id = id;
+    job->tool_name = tool->name();
+    job->stack_class = tool->options().stack_class;
+    if (stack_size > (int)TaskRegistry::GetInstance().Get("tool_worker").stack_size) {
+        job->stack_class = kToolStackLarge;
+    }
+    if (tool->options().timeout_ms > 0) {
+        job->deadline_us = esp_timer_get_time() + tool->options().timeout_ms * 1000LL;
+    }
+    job->run = [this, tool, arguments = std::move(arguments)]() {
+        auto result = tool->Call(arguments);
+        // Any other tool may have changed what the cached ones report
+        if (tool->options().cache_ttl_ms == 0) {
+            InvalidateToolCache();
         }
+        return result;
+    };
+    return job;
+}
+
+bool McpServer::CallToolLocally(const std::string& name, const std::string& arguments,
+    std::function<void(bool success, const std::string& payload)> done) {
+    auto tool_iter = tool_index_.find(name);
+    if (tool_iter == tool_index_.end()) {
+        ESP_LOGE(TAG, "Local call: Unknown tool: %s", name.c_str());
+        return false;
+    }
+    auto tool = tool_iter->second;
+
+    PropertyList properties = tool->properties();
+    cJSON* json = arguments.empty() ? nullptr : cJSON_Parse(arguments.c_str());
+    try {
+        properties.Parse(json);
     } catch (const std::exception& e) {
-        ESP_LOGE(TAG, "tools/call: %s", e.what());
-        ReplyError(id, e.what());
-        return;
+        ESP_LOGE(TAG, "Local call %s: %s", name.c_str(), e.what());
+        cJSON_Delete(json);
+        return false;
+    }
+    cJSON_Delete(json);
+
+    // Local calls are not cached, they are the commands that change the state
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(local_calls_mutex_);
+        id = next_local_id_;
+        next_local_id_ = next_local_id_ == INT32_MIN ? -1 : next_local_id_ - 1;
+        local_calls_[id] = std::move(done);
+    }
+    if (!tool_pool_.Submit(MakeToolJob(id, tool, std::move(properties), 0))) {
+        std::lock_guard<std::mutex> lock(local_calls_mutex_);
+        local_calls_.erase(id);
+        return false;
     }
+    return true;
+}
 
-    // Start a task to receive data with stack size
-    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
-    cfg.thread_name = "tool_call";
-    cfg.stack_size = stack_size;
-    cfg.prio = 1;
-    esp_pthread_set_cfg(&cfg);
+void McpServer::CompleteToolCall(int id, bool success, const std::string& payload, bool reply_to_caller) {
+    std::vector<int> ids;
+    if (reply_to_caller) {
+        ids.push_back(id);
+    }
+    {
+        std::lock_guard<std::mutex> lock(tool_cache_mutex_);
+        auto it = tool_cache_calls_.find(id);
+        if (it != tool_cache_calls_.end()) {
+            auto& call = it->second;
+            if (success && call.generation == tool_cache_generation_) {
+                auto now = esp_timer_get_time();
+                if (tool_cache_.size() >= MCP_TOOL_CACHE_MAX_ENTRIES && tool_cache_.find(call.key) == tool_cache_.end()) {
+                    // Drop the entry that expires first, it is the least useful
+                    auto oldest = std::min_element(tool_cache_.begin(), tool_cache_.end(), [](const auto& a, const auto& b) {
+                        return a.second.expire_time_us < b.second.expire_time_us;
+                    });
+                    tool_cache_.erase(oldest);
+                }
+                tool_cache_[call.key] = CachedToolResult{ payload, now + call.ttl_ms * 1000LL };
+            }
+            ids.insert(ids.end(), call.waiters.begin(), call.waiters.end());
+            tool_cache_inflight_.erase(call.key);
+            tool_cache_calls_.erase(it);
+        }
+    }
 
-    // Use a thread to call the tool to avoid blocking the main thread
-    tool_call_thread_ = std::thread([this, id, tool_iter, arguments = std::move(arguments)]() {
-        try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
-        } catch (const std::exception& e) {
-            ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
+    for (int reply_id : ids) {
+        if (success) {
+            ReplyResult(reply_id, payload);
+        } else {
+            ReplyError(reply_id, payload);
         }
-    });
-    tool_call_thread_.detach();
+    }
+}
+
+bool McpServer::CancelCoalescedCall(int id) {
+    std::lock_guard<std::mutex> lock(tool_cache_mutex_);
+    for (auto& [call_id, call] : tool_cache_calls_) {
+        auto it = std::find(call.waiters.begin(), call.waiters.end(), id);
+        if (it != call.waiters.end()) {
+            call.waiters.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool McpServer::IsCallInProgress(int id) {
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        if (batch_ids_.count(id) > 0) {
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(tool_cache_mutex_);
+        for (const auto& [call_id, call] : tool_cache_calls_) {
+            if (std::find(call.waiters.begin(), call.waiters.end(), id) != call.waiters.end()) {
+                return true;
+            }
+        }
+    }
+    return tool_pool_.IsInProgress(id);
+}
+
+void McpServer::InvalidateToolCache() {
+    std::lock_guard<std::mutex> lock(tool_cache_mutex_);
+    // Calls running now finish with a stale generation and are not cached
+    tool_cache_generation_++;
+    if (!tool_cache_.empty() || !tool_cache_calls_.empty()) {
+        tool_cache_invalidations_++;
+        tool_cache_.clear();
+    }
+}
+
+std::string McpServer::GetToolCacheStatsJson() {
+    std::lock_guard<std::mutex> lock(tool_cache_mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "entries", tool_cache_.size());
+    cJSON_AddNumberToObject(root, "invalidations", tool_cache_invalidations_);
+    cJSON* tools = cJSON_CreateObject();
+    for (const auto& [name, stats] : tool_cache_stats_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "hits", stats.hits);
+        cJSON_AddNumberToObject(item, "misses", stats.misses);
+        cJSON_AddNumberToObject(item, "coalesced", stats.coalesced);
+        cJSON_AddItemToObject(tools, name.c_str(), item);
+    }
+    cJSON_AddItemToObject(root, "tools", tools);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
 }
\ No newline at end of file
@@ -4,31 +4,54 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <mutex>
 #include <functional>
 #include <variant>
 #include <optional>
+#include <memory>
 #include <stdexcept>
-#include <thread>
+#include <type_traits>
 
 #include <cJSON.h>
 
+#include "tool_worker_pool.h"
+
+#define MCP_TOOL_DEFAULT_TIMEOUT_MS 30000
+#define MCP_TOOL_CACHE_MAX_ENTRIES 8        // Results of idempotent tools, by tool name and arguments
+
 // 添加类型别名
 using ReturnValue = std::variant<bool, int, std::string>;
 
 enum PropertyType {
     kPropertyTypeBoolean,
     kPropertyTypeInteger,
-    kPropertyTypeString
+    kPropertyTypeString,
+    kPropertyTypeNumber,    // double
+    kPropertyTypeArray,     // Of integers, numbers or strings
+    kPropertyTypeObject     // With its own PropertyList
 };
 
+class PropertyList;
+
+using PropertyValue = std::variant<bool, int, std::string, double,
+    std::vector<int>, std::vector<double>, std::vector<std::string>, std::shared_ptr<const PropertyList>>;
+
 class Property {
 private:
     std::string name_;
     PropertyType type_;
-    std::variant<bool, int, std::string> value_;
+    PropertyValue value_;
     bool has_default_value_;
-    std::optional<int> min_value_;  // 新增：整数最小值
-    std::optional<int> max_value_;  // 新增：整数最大值
+    std::optional<double> min_value_;  // 新增：整数/数值最小值，数组最少元素数
+    std::optional<double> max_value_;  // 新增：整数/数值最大值，数组最多元素数
+    std::vector<std::string> enum_values_;          // Allowed values of a string, empty for any
+    PropertyType item_type_ = kPropertyTypeString;  // Of an array
+    std::shared_ptr<const PropertyList> schema_;    // Of an object
+
+    std::string FormatLimit(double limit) const {
+        return type_ == kPropertyTypeNumber ? std::to_string(limit) : std::to_string((int)limit);
+    }
 
 public:
     // Required field constructor
@@ -39,20 +62,41 @@ public:
     template<typename T>
     Property(const std::string& name, PropertyType type, const T& default_value)
         : name_(name), type_(type), has_default_value_(true) {
+        if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) {
+            if (type == kPropertyTypeNumber) {
+                value_ = (double)default_value;
+                return;
+            }
+        }
         value_ = default_value;
     }
 
     Property(const std::string& name, PropertyType type, int min_value, int max_value)
         : name_(name), type_(type), has_default_value_(false), min_value_(min_value), max_value_(max_value) {
-        if (type != kPropertyTypeInteger) {
-            throw std::invalid_argument("Range limits only apply to integer properties");
+        if (type != kPropertyTypeInteger && type != kPropertyTypeNumber) {
+            throw std::invalid_argument("Range limits only apply to integer and number properties");
         }
     }
 
     Property(const std::string& name, PropertyType type, int default_value, int min_value, int max_value)
         : name_(name), type_(type), has_default_value_(true), min_value_(min_value), max_value_(max_value) {
-        if (type != kPropertyTypeInteger) {
-            throw std::invalid_argument("Range limits only apply to integer properties");
+        if (type != kPropertyTypeInteger && type != kPropertyTypeNumber) {
+            throw std::invalid_argument("Range limits only apply to integer and number properties");
+        }
+        if (default_value < min_value || default_value > max_value) {
+            throw std::invalid_argument("Default value must be within the specified range");
+        }
+        if (type == kPropertyTypeNumber) {
+            value_ = (double)default_value;
+        } else {
+            value_ = default_value;
+        }
+    }
+
+    Property(const std::string& name, PropertyType type, double default_value, double min_value, double max_value)
+        : name_(name), type_(type), has_default_value_(true), min_value_(min_value), max_value_(max_value) {
+        if (type != kPropertyTypeNumber) {
+            throw std::invalid_argument("Fractional range limits only apply to number properties");
         }
         if (default_value < min_value || default_value > max_value) {
             throw std::invalid_argument("Default value must be within the specified range");
@@ -60,63 +104,56 @@ public:
         value_ = default_value;
     }
 
+    // A string that must be one of the values
+    static Property Enum(const std::string& name, const std::vector<std::string>& values);
+    static Property Enum(const std::string& name, const std::vector<std::string>& values, const std::string& default_value);
+    // item_type is kPropertyTypeInteger, kPropertyTypeNumber or kPropertyTypeString, max_items -1 for no limit
+    static Property Array(const std::string& name, PropertyType item_type, int min_items = 0, int max_items = -1);
+    static Property Object(const std::string& name, const PropertyList& properties);
+
     inline const std::string& name() const { return name_; }
     inline PropertyType type() const { return type_; }
     inline bool has_default_value() const { return has_default_value_; }
     inline bool has_range() const { return min_value_.has_value() && max_value_.has_value(); }
-    inline int min_value() const { return min_value_.value_or(0); }
-    inline int max_value() const { return max_value_.value_or(0); }
+    inline int min_value() const { return (int)min_value_.value_or(0); }
+    inline int max_value() const { return (int)max_value_.value_or(0); }
+    inline const std::vector<std::string>& enum_values() const { return enum_values_; }
 
     template<typename T>
     inline T value() const {
         return std::get<T>(value_);
     }
 
+    // The arguments of an object property
+    const PropertyList& object() const {
+        return *std::get<std::shared_ptr<const PropertyList>>(value_);
+    }
+
     template<typename T>
     inline void set_value(const T& value) {
         // 添加对设置的整数值进行范围检查
-        if constexpr (std::is_same_v<T, int>) {
+        if constexpr (std::is_same_v<T, int> || std::is_same_v<T, double>) {
             if (min_value_.has_value() && value < min_value_.value()) {
-                throw std::invalid_argument("Value is below minimum allowed: " + std::to_string(min_value_.value()));
+                throw std::invalid_argument("Value is below minimum allowed: " + FormatLimit(min_value_.value()));
             }
             if (max_value_.has_value() && value > max_value_.value()) {
-                throw std::invalid_argument("Value exceeds maximum allowed: " + std::to_string(max_value_.value()));
+                throw std::invalid_argument("Value exceeds maximum allowed: " + FormatLimit(max_value_.value()));
             }
         }
         value_ = value;
     }
 
+    // Takes the argument if it has the right type, false otherwise. Throws if it fails validation
+    bool Parse(const cJSON* argument);
+    cJSON* ToJsonSchema() const;
+
     std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        
-        if (type_ == kPropertyTypeBoolean) {
-            cJSON_AddStringToObject(json, "type", "boolean");
-            if (has_default_value_) {
-                cJSON_AddBoolToObject(json, "default", value<bool>());
-            }
-        } else if (type_ == kPropertyTypeInteger) {
-            cJSON_AddStringToObject(json, "type", "integer");
-            if (has_default_value_) {
-                cJSON_AddNumberToObject(json, "default", value<int>());
-            }
-            if (min_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "minimum", min_value_.value());
-            }
-            if (max_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "maximum", max_value_.value());
-            }
-        } else if (type_ == kPropertyTypeString) {
-            cJSON_AddStringToObject(json, "type", "string");
-            if (has_default_value_) {
-                cJSON_AddStringToObject(json, "default", value<std::string>().c_str());
-            }
-        }
-        
+        cJSON *json = ToJsonSchema();
         char *json_str = cJSON_PrintUnformatted(json);
         std::string result(json_str);
         cJSON_free(json_str);
         cJSON_Delete(json);
-        
+
         return result;
     }
 };
@@ -124,25 +161,47 @@ public:
 class PropertyList {
 private:
     std::vector<Property> properties_;
+    // Shared by the copies made for each call, rebuilt when a property is added
+    std::shared_ptr<const std::unordered_map<std::string, size_t>> index_;
+
+    void BuildIndex() {
+        auto index = std::make_shared<std::unordered_map<std::string, size_t>>();
+        for (size_t i = 0; i < properties_.size(); i++) {
+            (*index)[properties_[i].name()] = i;
+        }
+        index_ = std::move(index);
+    }
 
 public:
     PropertyList() = default;
-    PropertyList(const std::vector<Property>& properties) : properties_(properties) {}
+    PropertyList(const std::vector<Property>& properties) : properties_(properties) {
+        BuildIndex();
+    }
     void AddProperty(const Property& property) {
         properties_.push_back(property);
+        BuildIndex();
+    }
+
+    const Property* Find(const std::string& name) const {
+        if (!index_) {
+            return nullptr;
+        }
+        auto it = index_->find(name);
+        return it != index_->end() ? &properties_[it->second] : nullptr;
     }
 
     const Property& operator[](const std::string& name) const {
-        for (const auto& property : properties_) {
-            if (property.name() == name) {
-                return property;
-            }
+        auto property = Find(name);
+        if (property == nullptr) {
+            throw std::runtime_error("Property not found: " + name);
         }
-        throw std::runtime_error("Property not found: " + name);
+        return *property;
     }
 
     auto begin() { return properties_.begin(); }
     auto end() { return properties_.end(); }
+    auto begin() const { return properties_.begin(); }
+    auto end() const { return properties_.end(); }
 
     std::vector<std::string> GetRequired() const {
         std::vector<std::string> required;
@@ -154,64 +213,68 @@ public:
         return required;
     }
 
+    // Takes the value of every property from the arguments object in one pass, throws if a required one is missing
+    void Parse(const cJSON* arguments);
+    // The "properties" and "required" members of an object schema
+    void AddToJsonSchema(cJSON* schema) const;
+
     std::string to_json() const {
         cJSON *json = cJSON_CreateObject();
-        
-        for (const auto& property : properties_) {
-            cJSON *prop_json = cJSON_Parse(property.to_json().c_str());
-            cJSON_AddItemToObject(json, property.name().c_str(), prop_json);
-        }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
+        AddToJsonSchema(json);
+        cJSON *properties = cJSON_DetachItemFromObject(json, "properties");
+        cJSON_Delete(json);
+
+        char *json_str = cJSON_PrintUnformatted(properties);
         std::string result(json_str);
         cJSON_free(json_str);
-        cJSON_Delete(json);
-        
+        cJSON_Delete(properties);
+
         return result;
     }
 };
 
+// How a tool is run by the worker pool
+struct McpToolOptions {
+    ToolStackClass stack_class = kToolStackDefault;
+    uint32_t timeout_ms = MCP_TOOL_DEFAULT_TIMEOUT_MS;     // 0 for no deadline
+    // Idempotent tools only: the result is reused for identical calls within this time,
+    // or until the device state changes or a tool that is not cached is called. 0 to disable
+    uint32_t cache_ttl_ms = 0;
+};
+
 class McpTool {
 private:
     std::string name_;
     std::string description_;
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
+    McpToolOptions options_;
 
 public:
     McpTool(const std::string& name, 
             const std::string& description, 
             const PropertyList& properties, 
-            std::function<ReturnValue(const PropertyList&)> callback)
+            std::function<ReturnValue(const PropertyList&)> callback,
+            const McpToolOptions& options = McpToolOptions())
         : name_(name), 
         description_(description), 
         properties_(properties), 
-        callback_(callback) {}
+        callback_(callback),
+        options_(options) {}
 
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
+    inline const McpToolOptions& options() const { return options_; }
 
     std::string to_json() const {
-        std::vector<std::string> required = properties_.GetRequired();
-        
         cJSON *json = cJSON_CreateObject();
         cJSON_AddStringToObject(json, "name", name_.c_str());
         cJSON_AddStringToObject(json, "description", description_.c_str());
         
         cJSON *input_schema = cJSON_CreateObject();
         cJSON_AddStringToObject(input_schema, "type", "object");
-        
-        cJSON *properties = cJSON_Parse(properties_.to_json().c_str());
-        cJSON_AddItemToObject(input_schema, "properties", properties);
-        
-        if (!required.empty()) {
-            cJSON *required_array = cJSON_CreateArray();
-            for (const auto& property : required) {
-                cJSON_AddItemToArray(required_array, cJSON_CreateString(property.c_str()));
-            }
-            cJSON_AddItemToObject(input_schema, "required", required_array);
-        }
+        properties_.AddToJsonSchema(input_schema);
         
         cJSON_AddItemToObject(json, "inputSchema", input_schema);
         
@@ -249,6 +312,15 @@ public:
     }
 };
 
+// For the tool running on the calling worker task
+class McpToolContext {
+public:
+    // True after notifications/cancelled or the deadline; the result will be dropped
+    static bool IsCancelled();
+    // Sends notifications/progress if the call came with a progress token
+    static void ReportProgress(int progress, int total = 0, const std::string& message = "");
+};
+
 class McpServer {
 public:
     static McpServer& GetInstance() {
@@ -258,26 +330,113 @@ public:
 
     void AddCommonTools();
     void AddTool(McpTool* tool);
-    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+        const McpToolOptions& options = McpToolOptions());
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
+    // Drops the cached tool results, for state changes the server does not see
+    void InvalidateToolCache();
+    // Where responses and notifications are sent instead of the protocol, nullptr to restore it
+    void SetTransport(std::function<void(const std::string&)> transport);
+    // Runs a tool without a request, for commands recognized on the device. done gets the
+    // result or the error on the worker; false if the tool is unknown, the arguments (JSON,
+    // may be empty) do not match or the pool is full
+    bool CallToolLocally(const std::string& name, const std::string& arguments,
+        std::function<void(bool success, const std::string& payload)> done);
+    // Sends a JSON-RPC notification, takes ownership of params
+    void SendNotification(const std::string& method, cJSON* params);
 
 private:
+    friend class McpToolContext;
+
     McpServer();
     ~McpServer();
 
+    // Responses of a JSON-RPC batch, sent as one array once every request is answered
+    struct McpBatch {
+        int pending = 0;
+        std::string responses;
+    };
+
     void ParseCapabilities(const cJSON* capabilities);
+    // Returns true if a response is sent now or later by a worker
+    bool HandleRequest(const cJSON* json);
+    void ParseBatch(const cJSON* json);
 
     void ReplyResult(int id, const std::string& result);
     void ReplyError(int id, const std::string& message);
+    void SendReply(int id, const std::string& payload);
+    // For a request of a batch that gets no response, like a cancelled call
+    void DropReply(int id);
+    void FinishBatchEntry(const std::shared_ptr<McpBatch>& batch, const std::string* payload);
+    void SendProgress(const ToolJob& job, int progress, int total, const std::string& message);
+    void SendMessage(const std::string& payload);
 
     void GetToolsList(int id, const std::string& cursor);
-    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size);
-
-    std::vector<McpTool*> tools_;
-    std::thread tool_call_thread_;
+    void BuildToolsListPages();
+    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size, const cJSON* progress_token);
+    std::shared_ptr<ToolJob> MakeToolJob(int id, McpTool* tool, PropertyList arguments, int stack_size);
+    // Called by the worker pool; also answers the calls coalesced into this one
+    void CompleteToolCall(int id, bool success, const std::string& payload, bool reply_to_caller = true);
+    // For notifications/cancelled of a call waiting for an identical one
+    bool CancelCoalescedCall(int id);
+    // A single call with this id has not been answered yet
+    bool IsCallInProgress(int id);
+    std::string GetToolCacheStatsJson();
+
+    struct ToolsListPage {
+        std::string json;       // The tools/list result
+        std::string error;      // Set if a tool does not fit in a page on its own
+    };
+
+    std::vector<McpTool*> tools_;       // In tools/list order
+    std::unordered_map<std::string, McpTool*> tool_index_;
+    ToolWorkerPool tool_pool_;
+
+    struct CachedToolResult {
+        std::string result;
+        int64_t expire_time_us;
+    };
+
+    // A call of a cached tool that is running, identical calls wait for its result
+    struct InflightToolCall {
+        std::string key;
+        uint32_t ttl_ms;
+        uint32_t generation;        // The result is not cached if the cache was invalidated meanwhile
+        std::vector<int> waiters;
+    };
+
+    struct ToolCacheStats {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t coalesced = 0;
+    };
+
+    std::mutex tool_cache_mutex_;
+    std::unordered_map<std::string, CachedToolResult> tool_cache_;      // Tool name and arguments to result
+    std::unordered_map<std::string, int> tool_cache_inflight_;          // Tool name and arguments to call id
+    std::unordered_map<int, InflightToolCall> tool_cache_calls_;        // By call id
+    std::map<std::string, ToolCacheStats> tool_cache_stats_;
+    uint32_t tool_cache_generation_ = 0;
+    uint32_t tool_cache_invalidations_ = 0;
+
+    std::mutex transport_mutex_;
+    std::function<void(const std::string&)> transport_;
+
+    // Calls from CallToolLocally, by their id; negative so they never match a request
+    std::mutex local_calls_mutex_;
+    std::unordered_map<int, std::function<void(bool, const std::string&)>> local_calls_;
+    int next_local_id_ = -1;
+
+    std::mutex batch_mutex_;
+    std::unordered_map<int, std::shared_ptr<McpBatch>> batch_ids_;     // Request id to the batch it came in
+
+    // Serialized on the first tools/list after the tools changed. The pages are
+    // larger than SPIRAM_MALLOC_ALWAYSINTERNAL, so they live in PSRAM where present
+    std::mutex tools_list_mutex_;
+    bool tools_list_dirty_ = true;
+    std::vector<ToolsListPage> tools_list_pages_;
+    std::unordered_map<std::string, size_t> tools_list_cursors_;    // nextCursor to page
 };
 
-void send_uart_data(char command);
-
 #endif // MCP_SERVER_H
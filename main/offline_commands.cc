@@ -0,0 +1,316 @@
+#include "offline_commands.h"
+#include "application.h"
+#include "board.h"
+#include "display.h"
+#include "mcp_server.h"
+#include "settings.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+#include <sdkconfig.h>
+#include <algorithm>
+#include <stdexcept>
+
+#define TAG "OfflineCommands"
+
+#ifndef CONFIG_OFFLINE_COMMAND_THRESHOLD
+#define CONFIG_OFFLINE_COMMAND_THRESHOLD 60
+#endif
+
+#if CONFIG_OFFLINE_COMMAND_NOTIFY
+#define OFFLINE_COMMAND_NOTIFY_DEFAULT true
+#else
+#define OFFLINE_COMMAND_NOTIFY_DEFAULT false
+#endif
+
+static std::vector<OfflineCommand> DefaultCommands() {
+    const float threshold = CONFIG_OFFLINE_COMMAND_THRESHOLD / 100.0f;
+    const bool notify = OFFLINE_COMMAND_NOTIFY_DEFAULT;
+    return {
+        { "da sheng yi dian", "大声一点", "", "volume_up", "", threshold, notify },
+        { "xiao sheng yi dian", "小声一点", "", "volume_down", "", threshold, notify },
+        { "qian jin", "前进", "move_forward", "", "", threshold, notify },
+        { "hou tui", "后退", "move_backward", "", "", threshold, notify },
+        { "ting zhi", "停止", "STOP", "", "", threshold, notify },
+    };
+}
+
+static bool ChangeVolume(int delta) {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    if (codec == nullptr) {
+        return false;
+    }
+    codec->SetOutputVolume(std::clamp(codec->output_volume() + delta, 0, 100));
+    return true;
+}
+
+OfflineCommands::OfflineCommands() {
+    handlers_["volume_up"] = []() { return ChangeVolume(OFFLINE_COMMAND_VOLUME_STEP); };
+    handlers_["volume_down"] = []() { return ChangeVolume(-OFFLINE_COMMAND_VOLUME_STEP); };
+    handlers_["stop_speaking"] = []() {
+        Application::GetInstance().AbortSpeaking(kAbortReasonNone);
+        return true;
+    };
+}
+
+const std::vector<OfflineCommand>& OfflineCommands::Load() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (loaded_) {
+        return commands_;
+    }
+    loaded_ = true;
+
+    Settings settings("offline_cmds");
+    auto table = settings.GetString("table");
+    if (!table.empty()) {
+        try {
+            commands_ = ParseTable(table);
+        } catch (const std::exception& e) {
+            ESP_LOGE(TAG, "Invalid stored table, using the defaults: %s", e.what());
+        }
+    }
+    if (commands_.empty()) {
+        commands_ = DefaultCommands();
+    }
+    stats_.resize(commands_.size());
+    ESP_LOGI(TAG, "%u commands loaded", commands_.size());
+    return commands_;
+}
+
+void OfflineCommands::RegisterHandler(const std::string& name, Handler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handlers_[name] = std::move(handler);
+}
+
+bool OfflineCommands::Execute(int command_id, float probability) {
+    auto detect_time_us = esp_timer_get_time();
+    size_t index = command_id - OFFLINE_COMMAND_ID_BASE;
+    OfflineCommand command;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (command_id < OFFLINE_COMMAND_ID_BASE || index >= commands_.size()) {
+            return false;
+        }
+        command = commands_[index];
+        stats_[index].detected++;
+        if (probability < command.threshold) {
+            stats_[index].rejected++;
+            ESP_LOGI(TAG, "'%s' under the threshold: %.2f < %.2f", command.phrase.c_str(), probability, command.threshold);
+            return false;
+        }
+    }
+    ESP_LOGI(TAG, "'%s' detected, prob=%.2f", command.phrase.c_str(), probability);
+
+    // Tools and handlers are looked up and started on the main task, like the calls from the server
+    Application::GetInstance().Schedule([this, index, command, detect_time_us]() {
+        auto display = Board::GetInstance().GetDisplay();
+        if (display != nullptr && !command.text.empty()) {
+            display->ShowNotification(command.text, 1000);
+        }
+
+        if (!command.handler.empty()) {
+            Handler handler;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = handlers_.find(command.handler);
+                if (it != handlers_.end()) {
+                    handler = it->second;
+                }
+            }
+            if (!handler) {
+                Finish(index, detect_time_us, false, "Unknown handler: " + command.handler);
+                return;
+            }
+            Finish(index, detect_time_us, handler(), "");
+            return;
+        }
+
+        bool started = McpServer::GetInstance().CallToolLocally(command.tool, command.arguments,
+            [this, index, detect_time_us](bool success, const std::string& result) {
+                Finish(index, detect_time_us, success, result);
+            });
+        if (!started) {
+            Finish(index, detect_time_us, false, "Cannot call " + command.tool);
+        }
+    });
+    return true;
+}
+
+void OfflineCommands::Finish(size_t index, int64_t detect_time_us, bool success, const std::string& result) {
+    auto elapsed_us = esp_timer_get_time() - detect_time_us;
+    OfflineCommand command;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        command = commands_[index];
+        stats_[index].latency.Add(elapsed_us);
+        if (!success) {
+            stats_[index].failed++;
+        }
+    }
+    if (success) {
+        ESP_LOGI(TAG, "'%s' done in %lld ms", command.phrase.c_str(), elapsed_us / 1000);
+    } else {
+        ESP_LOGW(TAG, "'%s' failed in %lld ms: %s", command.phrase.c_str(), elapsed_us / 1000, result.c_str());
+    }
+    if (!command.notify) {
+        return;
+    }
+
+    cJSON* data = cJSON_CreateObject();
+    cJSON_AddStringToObject(data, "phrase", command.phrase.c_str());
+    cJSON_AddStringToObject(data, "text", command.text.c_str());
+    if (!command.tool.empty()) {
+        cJSON_AddStringToObject(data, "tool", command.tool.c_str());
+    } else {
+        cJSON_AddStringToObject(data, "handler", command.handler.c_str());
+    }
+    cJSON_AddBoolToObject(data, "success", success);
+    if (!result.empty()) {
+        cJSON_AddStringToObject(data, "result", result.c_str());
+    }
+    cJSON_AddNumberToObject(data, "latency_ms", elapsed_us / 1000);
+
+    cJSON* params = cJSON_CreateObject();
+    cJSON_AddStringToObject(params, "level", success ? "info" : "warning");
+    cJSON_AddStringToObject(params, "logger", "offline_command");
+    cJSON_AddItemToObject(params, "data", data);
+    McpServer::GetInstance().SendNotification("notifications/message", params);
+}
+
+std::vector<OfflineCommand> OfflineCommands::ParseTable(const std::string& json) {
+    cJSON* root = cJSON_Parse(json.c_str());
+    if (!cJSON_IsArray(root)) {
+        cJSON_Delete(root);
+        throw std::invalid_argument("The table must be a JSON array");
+    }
+    if (cJSON_GetArraySize(root) > OFFLINE_COMMANDS_MAX) {
+        cJSON_Delete(root);
+        throw std::invalid_argument("Too many commands, at most " + std::to_string(OFFLINE_COMMANDS_MAX));
+    }
+
+    std::vector<OfflineCommand> commands;
+    std::string error;
+    cJSON* item;
+    cJSON_ArrayForEach(item, root) {
+        auto phrase = cJSON_GetObjectItem(item, "phrase");
+        auto text = cJSON_GetObjectItem(item, "text");
+        auto tool = cJSON_GetObjectItem(item, "tool");
+        auto handler = cJSON_GetObjectItem(item, "handler");
+        auto arguments = cJSON_GetObjectItem(item, "arguments");
+        auto threshold = cJSON_GetObjectItem(item, "threshold");
+        auto notify = cJSON_GetObjectItem(item, "notify");
+        auto position = "Command " + std::to_string(commands.size()) + ": ";
+
+        if (!cJSON_IsString(phrase) || phrase->valuestring[0] == '\0') {
+            error = position + "missing phrase";
+            break;
+        }
+        if (cJSON_IsString(tool) == cJSON_IsString(handler)) {
+            error = position + "needs either a tool or a handler";
+            break;
+        }
+        if (arguments != nullptr && !cJSON_IsObject(arguments)) {
+            error = position + "arguments must be an object";
+            break;
+        }
+        if (threshold != nullptr && (!cJSON_IsNumber(threshold) || threshold->valuedouble < 0 || threshold->valuedouble > 1)) {
+            error = position + "threshold must be between 0 and 1";
+            break;
+        }
+
+        OfflineCommand command;
+        command.phrase = phrase->valuestring;
+        command.text = cJSON_IsString(text) ? text->valuestring : command.phrase;
+        if (cJSON_IsString(tool)) {
+            command.tool = tool->valuestring;
+        } else {
+            command.handler = handler->valuestring;
+        }
+        if (arguments != nullptr) {
+            auto arguments_str = cJSON_PrintUnformatted(arguments);
+            command.arguments = arguments_str;
+            cJSON_free(arguments_str);
+        }
+        command.threshold = threshold != nullptr ? threshold->valuedouble : CONFIG_OFFLINE_COMMAND_THRESHOLD / 100.0f;
+        command.notify = cJSON_IsBool(notify) ? cJSON_IsTrue(notify) : OFFLINE_COMMAND_NOTIFY_DEFAULT;
+        commands.push_back(std::move(command));
+    }
+    cJSON_Delete(root);
+    if (!error.empty()) {
+        throw std::invalid_argument(error);
+    }
+    if (commands.empty()) {
+        throw std::invalid_argument("The table is empty");
+    }
+    return commands;
+}
+
+std::string OfflineCommands::TableToJson(const std::vector<OfflineCommand>& commands) {
+    cJSON* root = cJSON_CreateArray();
+    for (const auto& command : commands) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "phrase", command.phrase.c_str());
+        cJSON_AddStringToObject(item, "text", command.text.c_str());
+        if (!command.tool.empty()) {
+            cJSON_AddStringToObject(item, "tool", command.tool.c_str());
+        } else {
+            cJSON_AddStringToObject(item, "handler", command.handler.c_str());
+        }
+        if (!command.arguments.empty()) {
+            cJSON_AddItemToObject(item, "arguments", cJSON_Parse(command.arguments.c_str()));
+        }
+        cJSON_AddNumberToObject(item, "threshold", command.threshold);
+        cJSON_AddBoolToObject(item, "notify", command.notify);
+        cJSON_AddItemToArray(root, item);
+    }
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+std::string OfflineCommands::GetTableJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return TableToJson(commands_);
+}
+
+void OfflineCommands::SaveTableJson(const std::string& json) {
+    // Stored in the normalized form, so the next startup parses what was checked here
+    auto table = TableToJson(ParseTable(json));
+    // The write to NVS happens later in the settings flush, where a failure is only logged
+    if (table.size() > OFFLINE_COMMANDS_MAX_TABLE_SIZE) {
+        throw std::invalid_argument("The table is too large: " + std::to_string(table.size()) + " bytes, at most " +
+            std::to_string(OFFLINE_COMMANDS_MAX_TABLE_SIZE));
+    }
+    Settings settings("offline_cmds", true);
+    settings.SetString("table", table);
+}
+
+void OfflineCommands::ResetTable() {
+    Settings settings("offline_cmds", true);
+    settings.EraseKey("table");
+}
+
+std::string OfflineCommands::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    for (size_t i = 0; i < commands_.size(); i++) {
+        const auto& stats = stats_[i];
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "id", OFFLINE_COMMAND_ID_BASE + i);
+        cJSON_AddNumberToObject(item, "detected", stats.detected);
+        cJSON_AddNumberToObject(item, "rejected", stats.rejected);
+        cJSON_AddNumberToObject(item, "failed", stats.failed);
+        cJSON_AddItemToObject(item, "latency", stats.latency.ToJson());
+        cJSON_AddItemToObject(root, commands_[i].phrase.c_str(), item);
+    }
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,86 @@
+#ifndef _OFFLINE_COMMANDS_H_
+#define _OFFLINE_COMMANDS_H_
+
+#include "event_loop_stats.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define OFFLINE_COMMAND_ID_BASE 2           // multinet command id of the first entry, 1 is the wake word
+#define OFFLINE_COMMANDS_MAX 32
+#define OFFLINE_COMMAND_VOLUME_STEP 10
+#define OFFLINE_COMMANDS_MAX_TABLE_SIZE 3999    // nvs_set_str stores at most 4000 bytes with the terminator
+
+struct OfflineCommand {
+    std::string phrase;         // Pinyin for multinet, like "da sheng yi dian"
+    std::string text;           // Shown on the display and sent in the notification
+    std::string tool;           // MCP tool to call, or
+    std::string handler;        // a handler registered with RegisterHandler()
+    std::string arguments;      // Tool arguments, JSON object or empty
+    float threshold = 0;        // Minimum multinet probability
+    bool notify = true;         // Tell the server after the command ran
+};
+
+/*
+ * Commands recognized by the custom wake word multinet model and run on the
+ * device, without a round trip to the server. Each entry maps a phrase to a
+ * local MCP tool or a handler. The server hears about it afterwards through a
+ * notifications/message, when a session is open.
+ *
+ * The table is read once at startup, from the "offline_cmds" settings if
+ * present, as multinet registers its commands only then. A JSON array of
+ * objects with the fields of OfflineCommand.
+ */
+class OfflineCommands {
+public:
+    // Runs on the main task, returns false on failure
+    using Handler = std::function<bool()>;
+
+    static OfflineCommands& GetInstance() {
+        static OfflineCommands instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    OfflineCommands(const OfflineCommands&) = delete;
+    OfflineCommands& operator=(const OfflineCommands&) = delete;
+
+    // Loads the table from the settings or the defaults, once
+    const std::vector<OfflineCommand>& Load();
+    void RegisterHandler(const std::string& name, Handler handler);
+    // Runs the command with this multinet id; false if there is none or the
+    // probability is under its threshold
+    bool Execute(int command_id, float probability);
+
+    std::string GetTableJson();
+    // Checks and stores a table for the next startup, throws std::invalid_argument, also when
+    // the table is too large for NVS
+    void SaveTableJson(const std::string& json);
+    void ResetTable();
+    std::string GetStatsJson();
+
+private:
+    OfflineCommands();
+
+    struct CommandStats {
+        uint32_t detected = 0;
+        uint32_t rejected = 0;          // Under the threshold
+        uint32_t failed = 0;
+        LatencyHistogram latency;       // Detection until the action returned
+    };
+
+    std::mutex mutex_;
+    bool loaded_ = false;
+    std::vector<OfflineCommand> commands_;
+    std::map<std::string, Handler> handlers_;
+    std::vector<CommandStats> stats_;       // Same order as commands_
+
+    static std::vector<OfflineCommand> ParseTable(const std::string& json);
+    static std::string TableToJson(const std::vector<OfflineCommand>& commands);
+    void Finish(size_t index, int64_t detect_time_us, bool success, const std::string& result);
+};
+
+#endif // _OFFLINE_COMMANDS_H_
@@ -1,6 +1,8 @@
 #include "ota.h"
 #include "system_info.h"
 #include "settings.h"
+#include "connection_manager.h"
+#include "boot_profiler.h"
 #include "assets/lang_config.h"
 
 #include <cJSON.h>
@@ -49,12 +51,10 @@ std::string Ota::GetCheckVersionUrl() {
     return url;
 }
 
-std::unique_ptr<Http> Ota::SetupHttp() {
+void Ota::SetupHttp(Http* http) {
     auto& board = Board::GetInstance();
     auto app_desc = esp_app_get_description();
 
-    auto network = board.GetNetwork();
-    auto http = network->CreateHttp(0);
     http->SetHeader("Activation-Version", has_serial_number_ ? "2" : "1");
     http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
     http->SetHeader("Client-Id", board.GetUuid());
@@ -64,14 +64,20 @@ std::unique_ptr<Http> Ota::SetupHttp() {
     http->SetHeader("User-Agent", std::string(BOARD_NAME "/") + app_desc->version);
     http->SetHeader("Accept-Language", Lang::CODE);
     http->SetHeader("Content-Type", "application/json");
-
-    return http;
 }
 
 /* 
  * Specification: https://ccnphfhqs21z.feishu.cn/wiki/FjW6wZmisimNBBkov6OcmfvknVd
  */
 bool Ota::CheckVersion() {
+    auto& boot_profiler = BootProfiler::GetInstance();
+    boot_profiler.Begin(kBootPhaseVersionCheck);
+    bool success = DoCheckVersion();
+    boot_profiler.End(kBootPhaseVersionCheck);
+    return success;
+}
+
+bool Ota::DoCheckVersion() {
     auto& board = Board::GetInstance();
     auto app_desc = esp_app_get_description();
 
@@ -85,13 +91,16 @@ bool Ota::CheckVersion() {
         return false;
     }
 
-    auto http = SetupHttp();
+    auto& connection_manager = ConnectionManager::GetInstance();
+    auto http = connection_manager.AcquireHttp(0, url, "ota");
 
     std::string data = board.GetJson();
     std::string method = data.length() > 0 ? "POST" : "GET";
-    http->SetContent(std::move(data));
 
-    if (!http->Open(method, url)) {
+    if (!connection_manager.OpenHttp(http, 0, method, url, [this, &data](Http* http) {
+            SetupHttp(http);
+            http->SetContent(std::string(data));
+        })) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
     }
@@ -103,7 +112,8 @@ bool Ota::CheckVersion() {
     }
 
     data = http->ReadAll();
-    http->Close();
+    // Keep the connection alive for the activation request that usually follows
+    connection_manager.ReleaseHttp(0, url, "ota", std::move(http));
 
     // Response: { "firmware": { "version": "1.0.0", "url": "http://" } }
     // Parse the JSON response and check if the version is newer
@@ -237,9 +247,49 @@ bool Ota::CheckVersion() {
     }
 
     cJSON_Delete(root);
+    UpdateCachedConfig();
     return true;
 }
 
+/*
+ * The mqtt and websocket sections are already stored in NVS by CheckVersion,
+ * the cache only records which one to use and which firmware checked it.
+ * A device that needs activation or an upgrade always does the full check at boot.
+ */
+void Ota::UpdateCachedConfig() {
+    Settings settings("ota", true);
+    bool cacheable = !has_activation_code_ && !has_activation_challenge_ && !has_new_version_ &&
+        (has_mqtt_config_ || has_websocket_config_);
+    if (!cacheable) {
+        if (!settings.GetString("version").empty()) {
+            ESP_LOGI(TAG, "Clearing cached OTA config");
+            settings.EraseKey("version");
+        }
+        return;
+    }
+
+    std::string protocol = has_mqtt_config_ ? "mqtt" : "websocket";
+    if (settings.GetString("version") != current_version_) {
+        settings.SetString("version", current_version_);
+    }
+    if (settings.GetString("protocol") != protocol) {
+        settings.SetString("protocol", protocol);
+    }
+}
+
+bool Ota::LoadCachedConfig() {
+    Settings settings("ota", false);
+    current_version_ = esp_app_get_description()->version;
+    if (settings.GetString("version") != current_version_) {
+        return false;
+    }
+
+    auto protocol = settings.GetString("protocol");
+    has_mqtt_config_ = protocol == "mqtt";
+    has_websocket_config_ = protocol == "websocket";
+    return has_mqtt_config_ || has_websocket_config_;
+}
+
 void Ota::MarkCurrentVersionValid() {
     auto partition = esp_ota_get_running_partition();
     if (strcmp(partition->label, "factory") == 0) {
@@ -273,9 +323,9 @@ bool Ota::Upgrade(const std::string& firmware_url) {
     bool image_header_checked = false;
     std::string image_header;
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    if (!http->Open("GET", firmware_url)) {
+    auto& connection_manager = ConnectionManager::GetInstance();
+    auto http = connection_manager.AcquireHttp(0, firmware_url, "firmware");
+    if (!connection_manager.OpenHttp(http, 0, "GET", firmware_url, [](Http* http) {})) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
     }
@@ -349,6 +399,8 @@ bool Ota::Upgrade(const std::string& firmware_url) {
         }
     }
     http->Close();
+    // The device reboots after the upgrade, so there is no point in keeping idle connections
+    connection_manager.CloseIdleConnections();
 
     esp_err_t err = esp_ota_end(update_handle);
     if (err != ESP_OK) {
@@ -452,18 +504,23 @@ esp_err_t Ota::Activate() {
         url += "activate";
     }
 
-    auto http = SetupHttp();
+    auto& connection_manager = ConnectionManager::GetInstance();
+    auto http = connection_manager.AcquireHttp(0, url, "ota");
 
     std::string data = GetActivationPayload();
-    http->SetContent(std::move(data));
-
-    if (!http->Open("POST", url)) {
+    if (!connection_manager.OpenHttp(http, 0, "POST", url, [this, &data](Http* http) {
+            SetupHttp(http);
+            http->SetContent(std::string(data));
+        })) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return ESP_FAIL;
     }
     
     auto status_code = http->GetStatusCode();
     if (status_code == 202) {
+        // The server holds the request until the user confirms, reuse the connection for the next poll
+        http->ReadAll();
+        connection_manager.ReleaseHttp(0, url, "ota", std::move(http));
         return ESP_ERR_TIMEOUT;
     }
     if (status_code != 200) {
@@ -471,6 +528,8 @@ esp_err_t Ota::Activate() {
         return ESP_FAIL;
     }
 
+    http->ReadAll();
+    connection_manager.ReleaseHttp(0, url, "ota", std::move(http));
     ESP_LOGI(TAG, "Activation successful");
     return ESP_OK;
 }
@@ -13,6 +13,8 @@ public:
     ~Ota();
 
     bool CheckVersion();
+    // Restore the protocol selection of the last successful check, if it was made by this firmware version
+    bool LoadCachedConfig();
     esp_err_t Activate();
     bool HasActivationChallenge() { return has_activation_challenge_; }
     bool HasNewVersion() { return has_new_version_; }
@@ -51,7 +53,9 @@ private:
     std::vector<int> ParseVersion(const std::string& version);
     bool IsNewVersionAvailable(const std::string& currentVersion, const std::string& newVersion);
     std::string GetActivationPayload();
-    std::unique_ptr<Http> SetupHttp();
+    void SetupHttp(Http* http);
+    void UpdateCachedConfig();
+    bool DoCheckVersion();
 };
 
 #endif // _OTA_H
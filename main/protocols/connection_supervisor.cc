@@ -0,0 +1,185 @@
+#include "connection_supervisor.h"
+#include "application.h"
+#include "task_registry.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_random.h>
+#include <cJSON.h>
+#include <algorithm>
+
+#define TAG "Supervisor"
+
+ConnectionSupervisor::ConnectionSupervisor(Protocol* protocol) : protocol_(protocol) {
+    protocol_->OnPong([this](uint32_t id) {
+        OnPong(id);
+    });
+}
+
+void ConnectionSupervisor::OnPong(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pong_supported_ = true;
+    ping_unsupported_ = false;
+    if (probe_sent_ms_ == 0 || id != probe_id_) {
+        return;
+    }
+    stats_.last_rtt_ms = esp_timer_get_time() / 1000 - probe_sent_ms_;
+    protocol_->link_estimator().OnRttSample(stats_.last_rtt_ms);
+    probe_sent_ms_ = 0;
+    missed_probes_ = 0;
+}
+
+// Equal jitter: wait between half and all of the current backoff
+int ConnectionSupervisor::NextBackoff() {
+    int delay_ms = backoff_ms_ / 2 + esp_random() % (backoff_ms_ / 2 + 1);
+    backoff_ms_ = std::min(backoff_ms_ * 2, SUPERVISOR_BACKOFF_MAX_MS);
+    return delay_ms;
+}
+
+void ConnectionSupervisor::Tick(bool idle) {
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    bool connected = protocol_->IsConnected();
+
+    if (connected != connected_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connected_ = connected;
+        if (connected) {
+            stats_.connects++;
+            connected_since_ms_ = now_ms;
+            backoff_ms_ = SUPERVISOR_BACKOFF_MIN_MS;
+        } else {
+            auto uptime_ms = now_ms - connected_since_ms_;
+            stats_.disconnects++;
+            stats_.total_uptime_ms += uptime_ms;
+            stats_.longest_uptime_ms = std::max(stats_.longest_uptime_ms, uptime_ms);
+            probe_sent_ms_ = 0;
+            missed_probes_ = 0;
+            next_attempt_ms_ = now_ms + NextBackoff();
+            ESP_LOGI(TAG, "Connection closed after %lld s", uptime_ms / 1000);
+        }
+    }
+
+    if (connected) {
+        CheckLiveness(now_ms, idle);
+        return;
+    }
+
+    // Reconnect only while idle, so that a reconnect does not compete with a conversation
+    if (!protocol_->IsPersistent() || !idle || reconnecting_ || now_ms < next_attempt_ms_) {
+        return;
+    }
+
+    uint32_t attempt;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        attempt = ++stats_.reconnect_attempts;
+    }
+    ESP_LOGI(TAG, "Reconnecting, attempt %lu", attempt);
+    // The connect blocks for seconds, the main loop keeps running and gets the result
+    reconnecting_ = true;
+    auto result = TaskRegistry::GetInstance().Create("reconnect", [](void* arg) {
+        auto supervisor = static_cast<ConnectionSupervisor*>(arg);
+        bool success = supervisor->protocol_->Reconnect();
+        Application::GetInstance().Schedule([supervisor, success]() {
+            supervisor->OnReconnectDone(success);
+        });
+        vTaskDelete(NULL);
+    }, this);
+    if (result != pdPASS) {
+        OnReconnectDone(false);
+    }
+}
+
+void ConnectionSupervisor::OnReconnectDone(bool success) {
+    reconnecting_ = false;
+    if (success) {
+        return;
+    }
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.reconnect_failures++;
+    next_attempt_ms_ = now_ms + NextBackoff();
+    // Failures are only counted and logged here, an outage while idle is not shown to the user
+    ESP_LOGW(TAG, "Reconnect failed (%lu failures), next attempt in %lld ms", stats_.reconnect_failures,
+        next_attempt_ms_ - now_ms);
+}
+
+void ConnectionSupervisor::CheckLiveness(int64_t now_ms, bool idle) {
+    auto idle_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - protocol_->last_incoming_time()).count();
+    int probe_idle_ms = protocol_->IsPersistent() ? SUPERVISOR_PROBE_IDLE_PERSISTENT_MS : SUPERVISOR_PROBE_IDLE_MS;
+
+    uint32_t probe_id = 0;
+    bool half_open = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (probe_sent_ms_ != 0) {
+            if (now_ms - probe_sent_ms_ < SUPERVISOR_PROBE_TIMEOUT_MS) {
+                return;
+            }
+            stats_.probes_lost++;
+            probe_sent_ms_ = 0;
+            if (!pong_supported_) {
+                // Maybe the server does not know ping, this says nothing about the link
+                if (++unanswered_probes_ >= SUPERVISOR_PING_DISCOVERY_PROBES) {
+                    ping_unsupported_ = true;
+                    ESP_LOGW(TAG, "No pong to %d probes, watching the incoming traffic only", unanswered_probes_);
+                }
+            } else {
+                protocol_->link_estimator().OnPackets(0, 1);
+                if (++missed_probes_ >= SUPERVISOR_MAX_MISSED_PROBES) {
+                    stats_.half_open_detected++;
+                    missed_probes_ = 0;
+                    half_open = true;
+                }
+            }
+        }
+        if (ping_unsupported_) {
+            return;
+        }
+
+        // Keep probing after a lost probe or during a conversation, otherwise only when the connection is quiet
+        bool session_probe = !idle && now_ms - last_probe_ms_ >= SUPERVISOR_PROBE_SESSION_MS;
+        if (!half_open && (missed_probes_ > 0 || session_probe || idle_ms >= probe_idle_ms)) {
+            probe_id = ++probe_id_;
+            probe_sent_ms_ = now_ms;
+            last_probe_ms_ = now_ms;
+            stats_.probes_sent++;
+        }
+    }
+
+    if (half_open) {
+        ESP_LOGW(TAG, "No response to %d probes, closing half-open connection", SUPERVISOR_MAX_MISSED_PROBES);
+        protocol_->CloseConnection();
+    } else if (probe_id != 0) {
+        protocol_->SendPing(probe_id);
+    }
+}
+
+std::string ConnectionSupervisor::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t uptime_ms = connected_ ? esp_timer_get_time() / 1000 - connected_since_ms_ : 0;
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "connected", connected_);
+    cJSON_AddNumberToObject(root, "uptime_s", uptime_ms / 1000);
+    cJSON_AddNumberToObject(root, "longest_uptime_s", std::max(stats_.longest_uptime_ms, uptime_ms) / 1000);
+    cJSON_AddNumberToObject(root, "total_uptime_s", (stats_.total_uptime_ms + uptime_ms) / 1000);
+    cJSON_AddNumberToObject(root, "connects", stats_.connects);
+    cJSON_AddNumberToObject(root, "disconnects", stats_.disconnects);
+    cJSON_AddNumberToObject(root, "reconnect_attempts", stats_.reconnect_attempts);
+    cJSON_AddNumberToObject(root, "reconnect_failures", stats_.reconnect_failures);
+    cJSON_AddNumberToObject(root, "half_open_detected", stats_.half_open_detected);
+    cJSON_AddNumberToObject(root, "probes_sent", stats_.probes_sent);
+    cJSON_AddNumberToObject(root, "probes_lost", stats_.probes_lost);
+    cJSON_AddBoolToObject(root, "ping_supported", pong_supported_);
+    cJSON_AddBoolToObject(root, "ping_unsupported", ping_unsupported_);
+    if (stats_.last_rtt_ms >= 0) {
+        cJSON_AddNumberToObject(root, "last_rtt_ms", stats_.last_rtt_ms);
+    }
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
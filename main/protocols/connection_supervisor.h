@@ -0,0 +1,76 @@
+#ifndef CONNECTION_SUPERVISOR_H
+#define CONNECTION_SUPERVISOR_H
+
+#include "protocol.h"
+
+#include <mutex>
+#include <string>
+
+#define SUPERVISOR_PROBE_IDLE_MS 15000              // Probe a session connection after this long without incoming data
+#define SUPERVISOR_PROBE_IDLE_PERSISTENT_MS 60000   // Probe a persistent connection (MQTT) after this long without incoming data
+#define SUPERVISOR_PROBE_SESSION_MS 5000            // Probe interval during a conversation, feeds the link estimator
+#define SUPERVISOR_PROBE_TIMEOUT_MS 5000
+#define SUPERVISOR_MAX_MISSED_PROBES 2
+#define SUPERVISOR_PING_DISCOVERY_PROBES 3          // Unanswered probes before a server is taken as not supporting ping
+#define SUPERVISOR_BACKOFF_MIN_MS 2000
+#define SUPERVISOR_BACKOFF_MAX_MS 120000
+
+struct ConnectionStats {
+    uint32_t connects = 0;
+    uint32_t disconnects = 0;
+    uint32_t reconnect_attempts = 0;
+    uint32_t reconnect_failures = 0;
+    uint32_t half_open_detected = 0;
+    uint32_t probes_sent = 0;
+    uint32_t probes_lost = 0;
+    int64_t total_uptime_ms = 0;
+    int64_t longest_uptime_ms = 0;
+    int64_t last_rtt_ms = -1;
+};
+
+/*
+ * Watches the protocol connection from the main loop:
+ * - Sends an application level ping when the connection has been quiet for a while,
+ *   and closes it as half-open when the server stops answering
+ * - Keeps probing during a conversation, the RTT samples feed the protocol's LinkEstimator
+ * - Reconnects a persistent connection (MQTT) on a background task with exponential
+ *   backoff and jitter, so that a fleet does not reconnect at the same instant
+ *   after an AP or server restart. Only the result comes back to the main loop
+ *
+ * A server that never answered a ping is not assumed to support it: its lost probes
+ * neither count as missed nor feed the link estimator, and after a few of them probing
+ * stops. Liveness then comes from the incoming traffic, through the transport state
+ * and Protocol::IsTimeout.
+ */
+class ConnectionSupervisor {
+public:
+    ConnectionSupervisor(Protocol* protocol);
+
+    // Must be called from the main loop, `idle` is true when no conversation is going on
+    void Tick(bool idle);
+    std::string GetStatsJson();
+
+private:
+    Protocol* protocol_;
+    std::mutex mutex_;
+    ConnectionStats stats_;
+    bool connected_ = false;
+    bool pong_supported_ = false;
+    bool ping_unsupported_ = false;     // Gave up probing a server that never answered
+    int unanswered_probes_ = 0;         // Lost before any pong was seen
+    bool reconnecting_ = false;         // The reconnect task is running
+    int64_t connected_since_ms_ = 0;
+    int64_t next_attempt_ms_ = 0;
+    int backoff_ms_ = SUPERVISOR_BACKOFF_MIN_MS;
+    uint32_t probe_id_ = 0;
+    int64_t probe_sent_ms_ = 0;     // 0 when no probe is in flight
+    int64_t last_probe_ms_ = 0;
+    int missed_probes_ = 0;
+
+    void OnPong(uint32_t id);
+    void OnReconnectDone(bool success);
+    void CheckLiveness(int64_t now_ms, bool idle);
+    int NextBackoff();
+};
+
+#endif // CONNECTION_SUPERVISOR_H
@@ -0,0 +1,90 @@
+#include "link_estimator.h"
+
+#include <esp_timer.h>
+#include <cJSON.h>
+#include <cstdlib>
+
+void LinkEstimator::OnRttSample(int rtt_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (quality_.rtt_samples == 0) {
+        quality_.srtt_ms = rtt_ms;
+        quality_.rttvar_ms = rtt_ms / 2;
+        quality_.min_rtt_ms = rtt_ms;
+    } else {
+        quality_.rttvar_ms = (3 * quality_.rttvar_ms + std::abs(quality_.srtt_ms - rtt_ms)) / 4;
+        quality_.srtt_ms = (7 * quality_.srtt_ms + rtt_ms) / 8;
+        if (rtt_ms < quality_.min_rtt_ms) {
+            quality_.min_rtt_ms = rtt_ms;
+        }
+    }
+    quality_.rtt_samples++;
+    quality_.packets_expected++;
+}
+
+void LinkEstimator::OnPackets(uint32_t received, uint32_t lost) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quality_.packets_expected += received + lost;
+    quality_.packets_lost += lost;
+}
+
+void LinkEstimator::OnBytesSent(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quality_.tx_bytes += bytes;
+    window_tx_bytes_ += bytes;
+    UpdateThroughputLocked(esp_timer_get_time());
+}
+
+void LinkEstimator::OnBytesReceived(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quality_.rx_bytes += bytes;
+    window_rx_bytes_ += bytes;
+    UpdateThroughputLocked(esp_timer_get_time());
+}
+
+void LinkEstimator::UpdateThroughputLocked(int64_t now_us) {
+    int64_t elapsed_us = now_us - window_start_us_;
+    if (elapsed_us < LINK_THROUGHPUT_WINDOW_MS * 1000LL) {
+        return;
+    }
+
+    uint32_t tx_rate = window_tx_bytes_ * 1000000LL / elapsed_us;
+    uint32_t rx_rate = window_rx_bytes_ * 1000000LL / elapsed_us;
+    if (elapsed_us > 4 * LINK_THROUGHPUT_WINDOW_MS * 1000LL) {
+        // The link was quiet, do not let an old burst dominate the estimate
+        quality_.tx_bytes_per_second = tx_rate;
+        quality_.rx_bytes_per_second = rx_rate;
+    } else {
+        quality_.tx_bytes_per_second = (3 * quality_.tx_bytes_per_second + tx_rate) / 4;
+        quality_.rx_bytes_per_second = (3 * quality_.rx_bytes_per_second + rx_rate) / 4;
+    }
+    window_start_us_ = now_us;
+    window_tx_bytes_ = 0;
+    window_rx_bytes_ = 0;
+}
+
+LinkQuality LinkEstimator::GetQuality() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    UpdateThroughputLocked(esp_timer_get_time());
+    return quality_;
+}
+
+std::string LinkEstimator::GetJson() {
+    auto quality = GetQuality();
+    cJSON* root = cJSON_CreateObject();
+    if (quality.rtt_samples > 0) {
+        cJSON_AddNumberToObject(root, "srtt_ms", quality.srtt_ms);
+        cJSON_AddNumberToObject(root, "jitter_ms", quality.rttvar_ms);
+        cJSON_AddNumberToObject(root, "min_rtt_ms", quality.min_rtt_ms);
+    }
+    cJSON_AddNumberToObject(root, "rtt_samples", quality.rtt_samples);
+    cJSON_AddNumberToObject(root, "loss_percent", quality.loss_percent());
+    cJSON_AddNumberToObject(root, "tx_bytes_per_second", quality.tx_bytes_per_second);
+    cJSON_AddNumberToObject(root, "rx_bytes_per_second", quality.rx_bytes_per_second);
+    cJSON_AddNumberToObject(root, "tx_bytes", quality.tx_bytes);
+    cJSON_AddNumberToObject(root, "rx_bytes", quality.rx_bytes);
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,53 @@
+#ifndef LINK_ESTIMATOR_H
+#define LINK_ESTIMATOR_H
+
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+#define LINK_THROUGHPUT_WINDOW_MS 1000
+
+struct LinkQuality {
+    int32_t srtt_ms = -1;           // Smoothed RTT, -1 until the first sample
+    int32_t rttvar_ms = 0;          // RTT variation, used as the jitter estimate
+    int32_t min_rtt_ms = -1;
+    uint32_t rtt_samples = 0;
+    uint32_t packets_expected = 0;  // Probes and sequenced UDP audio packets
+    uint32_t packets_lost = 0;
+    uint32_t tx_bytes_per_second = 0;
+    uint32_t rx_bytes_per_second = 0;
+    uint64_t tx_bytes = 0;
+    uint64_t rx_bytes = 0;
+
+    float loss_percent() const {
+        return packets_expected == 0 ? 0.0f : packets_lost * 100.0f / packets_expected;
+    }
+};
+
+/*
+ * Link quality estimate of the protocol connection.
+ * RTT comes from the supervisor pings (smoothed as in RFC 6298), loss from lost
+ * pings and UDP sequence gaps, and throughput from the bytes passing through
+ * the protocol. All methods are thread safe.
+ */
+class LinkEstimator {
+public:
+    void OnRttSample(int rtt_ms);
+    void OnPackets(uint32_t received, uint32_t lost);
+    void OnBytesSent(size_t bytes);
+    void OnBytesReceived(size_t bytes);
+
+    LinkQuality GetQuality();
+    std::string GetJson();
+
+private:
+    std::mutex mutex_;
+    LinkQuality quality_;
+    int64_t window_start_us_ = 0;
+    uint32_t window_tx_bytes_ = 0;
+    uint32_t window_rx_bytes_ = 0;
+
+    void UpdateThroughputLocked(int64_t now_us);
+};
+
+#endif // LINK_ESTIMATOR_H
@@ -0,0 +1,84 @@
+#include "message_dispatcher.h"
+
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "MessageDispatcher"
+
+static_assert((MESSAGE_DISPATCHER_SLOTS & (MESSAGE_DISPATCHER_SLOTS - 1)) == 0, "MESSAGE_DISPATCHER_SLOTS must be a power of 2");
+
+bool MessageDispatcher::Register(const char* type, MessageHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t hash = MessageTypeHash(type);
+    for (uint32_t i = 0; i < MESSAGE_DISPATCHER_SLOTS; i++) {
+        Slot& slot = slots_[(hash + i) & (MESSAGE_DISPATCHER_SLOTS - 1)];
+        uint32_t slot_hash = slot.hash.load(std::memory_order_relaxed);
+        if (slot_hash == 0) {
+            slot.type = type;
+            slot.handler = std::move(handler);
+            slot.hash.store(hash, std::memory_order_release);
+            return true;
+        }
+        if (slot_hash == hash && strcmp(slot.type, type) == 0) {
+            ESP_LOGE(TAG, "Handler for message type %s already registered", type);
+            return false;
+        }
+    }
+    ESP_LOGE(TAG, "Too many message types, cannot register %s", type);
+    return false;
+}
+
+bool MessageDispatcher::Dispatch(const cJSON* root) {
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (!cJSON_IsString(type)) {
+        invalid_.fetch_add(1, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "Message without type");
+        return false;
+    }
+
+    uint32_t hash = MessageTypeHash(type->valuestring);
+    for (uint32_t i = 0; i < MESSAGE_DISPATCHER_SLOTS; i++) {
+        Slot& slot = slots_[(hash + i) & (MESSAGE_DISPATCHER_SLOTS - 1)];
+        uint32_t slot_hash = slot.hash.load(std::memory_order_acquire);
+        if (slot_hash == 0) {
+            break;
+        }
+        if (slot_hash == hash && strcmp(slot.type, type->valuestring) == 0) {
+            slot.count.fetch_add(1, std::memory_order_relaxed);
+            slot.handler(root);
+            return true;
+        }
+    }
+
+    unknown_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_unknown_type_ = type->valuestring;
+    }
+    ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+    return false;
+}
+
+std::string MessageDispatcher::GetStatsJson() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* types = cJSON_CreateObject();
+    for (auto& slot : slots_) {
+        if (slot.hash.load(std::memory_order_acquire) != 0) {
+            cJSON_AddNumberToObject(types, slot.type, slot.count.load(std::memory_order_relaxed));
+        }
+    }
+    cJSON_AddItemToObject(root, "types", types);
+    cJSON_AddNumberToObject(root, "unknown", unknown_.load(std::memory_order_relaxed));
+    cJSON_AddNumberToObject(root, "invalid", invalid_.load(std::memory_order_relaxed));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!last_unknown_type_.empty()) {
+            cJSON_AddStringToObject(root, "last_unknown_type", last_unknown_type_.c_str());
+        }
+    }
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
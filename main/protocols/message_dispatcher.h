@@ -0,0 +1,65 @@
+#ifndef _MESSAGE_DISPATCHER_H_
+#define _MESSAGE_DISPATCHER_H_
+
+#include <cJSON.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#define MESSAGE_DISPATCHER_SLOTS 32     // Must be a power of 2
+
+// FNV-1a, usable in case labels: switch (MessageTypeHash(state)) { case MessageTypeHash("start"): ... }
+constexpr uint32_t MessageTypeHash(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash = (hash ^ (uint8_t)*str++) * 16777619u;
+    }
+    return hash == 0 ? 1 : hash;    // 0 marks an empty slot
+}
+
+using MessageHandler = std::function<void(const cJSON* root)>;
+
+/*
+ * Routes incoming JSON messages to the handler registered for their "type".
+ * Handlers live in an open addressing table keyed by the hash of the type, so a
+ * dispatch costs one hash, usually one probe and one strcmp to rule out collisions.
+ * Slots are published with a release store and never removed, the network task
+ * dispatches without taking a lock.
+ */
+class MessageDispatcher {
+public:
+    static MessageDispatcher& GetInstance() {
+        static MessageDispatcher instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    MessageDispatcher(const MessageDispatcher&) = delete;
+    MessageDispatcher& operator=(const MessageDispatcher&) = delete;
+
+    // The type string must stay valid, a string literal in practice
+    bool Register(const char* type, MessageHandler handler);
+    // Returns false if no handler is registered for the message type
+    bool Dispatch(const cJSON* root);
+    std::string GetStatsJson();
+
+private:
+    MessageDispatcher() = default;
+    ~MessageDispatcher() = default;
+
+    struct Slot {
+        std::atomic<uint32_t> hash{0};
+        const char* type = nullptr;
+        MessageHandler handler;
+        std::atomic<uint32_t> count{0};
+    };
+
+    Slot slots_[MESSAGE_DISPATCHER_SLOTS];
+    std::mutex mutex_;      // Serializes Register and the unknown type bookkeeping
+    std::atomic<uint32_t> invalid_{0};
+    std::atomic<uint32_t> unknown_{0};
+    std::string last_unknown_type_;
+};
+
+#endif // _MESSAGE_DISPATCHER_H_
@@ -29,31 +29,48 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         mqtt_.reset();
     }
 
+    Settings settings("mqtt", false);
+    publish_topic_ = settings.GetString("publish_topic");
+    mqtt_ = ConnectMqttClient(report_error);
+    if (mqtt_ == nullptr) {
+        return false;
+    }
+    if (!mqtt_->IsConnected()) {
+        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        return false;
+    }
+    return true;
+}
+
+// Creates a client and connects it. Returns nullptr if there is no endpoint, and the
+// disconnected client if the connection failed. Sets no member, and reports no error
+// unless report_error is set, so that the supervisor's reconnect task can call it.
+std::unique_ptr<Mqtt> MqttProtocol::ConnectMqttClient(bool report_error) {
     Settings settings("mqtt", false);
     auto endpoint = settings.GetString("endpoint");
     auto client_id = settings.GetString("client_id");
     auto username = settings.GetString("username");
     auto password = settings.GetString("password");
     int keepalive_interval = settings.GetInt("keepalive", 240);
-    publish_topic_ = settings.GetString("publish_topic");
 
     if (endpoint.empty()) {
         ESP_LOGW(TAG, "MQTT endpoint is not specified");
         if (report_error) {
             SetError(Lang::Strings::SERVER_NOT_FOUND);
         }
-        return false;
+        return nullptr;
     }
 
     auto network = Board::GetInstance().GetNetwork();
-    mqtt_ = network->CreateMqtt(0);
-    mqtt_->SetKeepAlive(keepalive_interval);
+    auto mqtt = network->CreateMqtt(0);
+    mqtt->SetKeepAlive(keepalive_interval);
 
-    mqtt_->OnDisconnected([this]() {
+    mqtt->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Disconnected from endpoint");
     });
 
-    mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
+    mqtt->OnMessage([this](const std::string& topic, const std::string& payload) {
+        link_estimator_.OnBytesReceived(payload.size());
         cJSON* root = cJSON_Parse(payload.c_str());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
@@ -68,6 +85,8 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
 
         if (strcmp(type->valuestring, "hello") == 0) {
             ParseServerHello(root);
+        } else if (strcmp(type->valuestring, "pong") == 0) {
+            HandlePong(root);
         } else if (strcmp(type->valuestring, "goodbye") == 0) {
             auto session_id = cJSON_GetObjectItem(root, "session_id");
             ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id ? session_id->valuestring : "null");
@@ -93,20 +112,20 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     } else {
         broker_address = endpoint;
     }
-    if (!mqtt_->Connect(broker_address, broker_port, client_id, username, password)) {
+    if (!mqtt->Connect(broker_address, broker_port, client_id, username, password)) {
         ESP_LOGE(TAG, "Failed to connect to endpoint");
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
-        return false;
+        return mqtt;
     }
 
     ESP_LOGI(TAG, "Connected to endpoint");
-    return true;
+    return mqtt;
 }
 
 bool MqttProtocol::SendText(const std::string& text) {
-    if (publish_topic_.empty()) {
+    if (publish_topic_.empty() || mqtt_ == nullptr) {
         return false;
     }
+    link_estimator_.OnBytesSent(text.size());
     if (!mqtt_->Publish(publish_topic_, text)) {
         ESP_LOGE(TAG, "Failed to publish message: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
@@ -138,10 +157,13 @@ bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         return false;
     }
 
+    link_estimator_.OnBytesSent(encrypted.size());
     return udp_->Send(encrypted) > 0;
 }
 
 void MqttProtocol::CloseAudioChannel() {
+    // Queued control messages, like a stop listening, go out before the goodbye
+    FlushControlMessages();
     {
         std::lock_guard<std::mutex> lock(channel_mutex_);
         udp_.reset();
@@ -209,6 +231,8 @@ bool MqttProtocol::OpenAudioChannel() {
         if (sequence != remote_sequence_ + 1) {
             ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
         }
+        link_estimator_.OnBytesReceived(data.size());
+        link_estimator_.OnPackets(1, (remote_sequence_ != 0 && sequence > remote_sequence_ + 1) ? sequence - remote_sequence_ - 1 : 0);
 
         size_t decrypted_size = data.size() - aes_nonce_.size();
         size_t nc_off = 0;
@@ -333,3 +357,43 @@ std::string MqttProtocol::DecodeHexString(const std::string& hex_string) {
 bool MqttProtocol::IsAudioChannelOpened() const {
     return udp_ != nullptr && !error_occurred_ && !IsTimeout();
 }
+
+bool MqttProtocol::IsConnected() const {
+    return mqtt_ != nullptr && mqtt_->IsConnected();
+}
+
+// MQTT stays connected between sessions, the supervisor restores it after a drop
+bool MqttProtocol::IsPersistent() const {
+    return !publish_topic_.empty();
+}
+
+// Runs on the supervisor's reconnect task. The new client connects here and replaces
+// the old one on the main loop, where mqtt_ is used
+bool MqttProtocol::Reconnect() {
+    auto mqtt = ConnectMqttClient(false);
+    if (mqtt == nullptr || !mqtt->IsConnected()) {
+        return false;
+    }
+    Application::GetInstance().Schedule([this, mqtt = std::move(mqtt)]() mutable {
+        if (mqtt_ != nullptr && mqtt_->IsConnected()) {
+            // Reconnected by OpenAudioChannel in the meantime
+            return;
+        }
+        mqtt_ = std::move(mqtt);
+    });
+    return true;
+}
+
+// The broker stopped answering pings, drop the session and the client
+void MqttProtocol::CloseConnection() {
+    bool in_session;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        in_session = udp_ != nullptr;
+        udp_.reset();
+    }
+    mqtt_.reset();
+    if (in_session) {
+        SetError(Lang::Strings::SERVER_TIMEOUT);
+    }
+}
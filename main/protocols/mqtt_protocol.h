@@ -30,6 +30,10 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    bool IsConnected() const override;
+    bool IsPersistent() const override;
+    bool Reconnect() override;
+    void CloseConnection() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
@@ -47,6 +51,7 @@ private:
     uint32_t remote_sequence_;
 
     bool StartMqttClient(bool report_error=false);
+    std::unique_ptr<Mqtt> ConnectMqttClient(bool report_error);
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
 
@@ -1,6 +1,8 @@
 #include "protocol.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
 
 #define TAG "Protocol"
 
@@ -24,6 +26,14 @@ void Protocol::OnNetworkError(std::function<void(const std::string& message)> ca
     on_network_error_ = callback;
 }
 
+void Protocol::OnPong(std::function<void(uint32_t id)> callback) {
+    on_pong_ = callback;
+}
+
+void Protocol::OnControlQueued(std::function<void()> callback) {
+    on_control_queued_ = callback;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -37,13 +47,13 @@ void Protocol::SendAbortSpeaking(AbortReason reason) {
         message += ",\"reason\":\"wake_word_detected\"";
     }
     message += "}";
-    SendText(message);
+    SendControl(message, true);
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
-    SendText(json);
+    SendControl(json);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
@@ -57,19 +67,106 @@ void Protocol::SendStartListening(ListeningMode mode) {
         message += ",\"mode\":\"manual\"";
     }
     message += "}";
-    SendText(message);
+    SendControl(message);
 }
 
 void Protocol::SendStopListening() {
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
-    SendText(message);
+    SendControl(message);
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
+    QueueMcpMessage(payload);
+}
+
+void Protocol::SendPing(uint32_t id) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"ping\",\"id\":" + std::to_string(id) + "}";
     SendText(message);
 }
 
+void Protocol::HandlePong(const cJSON* root) {
+    auto id = cJSON_GetObjectItem(root, "id");
+    if (cJSON_IsNumber(id) && on_pong_ != nullptr) {
+        on_pong_(id->valueint);
+    }
+}
+
+// May be called from any task, the same queue keeps the order with MCP replies
+void Protocol::SendControl(const std::string& text, bool abort) {
+    {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        control_queue_.push_back(ControlMessage{text, esp_timer_get_time(), false, abort});
+    }
+    if (on_control_queued_ != nullptr) {
+        on_control_queued_();
+    }
+}
+
+void Protocol::QueueMcpMessage(const std::string& payload) {
+    {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        control_queue_.push_back(ControlMessage{payload, esp_timer_get_time(), true, false});
+    }
+    if (on_control_queued_ != nullptr) {
+        on_control_queued_();
+    }
+}
+
+bool Protocol::HasPendingControlMessages() {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    return !control_queue_.empty();
+}
+
+// Must be called from the main event loop, the same task that sends audio
+void Protocol::FlushControlMessages() {
+    while (true) {
+        ControlMessage message;
+        {
+            std::lock_guard<std::mutex> lock(control_mutex_);
+            if (control_queue_.empty()) {
+                return;
+            }
+            message = std::move(control_queue_.front());
+            control_queue_.pop_front();
+        }
+
+        if (message.mcp) {
+            SendText("{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + message.text + "}");
+        } else {
+            SendText(message.text);
+        }
+
+        auto latency_us = esp_timer_get_time() - message.queued_time_us;
+        outbound_stats_.control_sent++;
+        if (latency_us > outbound_stats_.max_control_latency_us.load()) {
+            outbound_stats_.max_control_latency_us = latency_us;
+        }
+        if (message.abort) {
+            outbound_stats_.last_abort_latency_us = latency_us;
+            ESP_LOGI(TAG, "Abort sent in %lld ms", latency_us / 1000);
+        }
+    }
+}
+
+// Called for the oldest pending frame, with the number of frames still queued behind it
+bool Protocol::ShouldDropAudio(size_t backlog, int frame_duration_ms) {
+#if CONFIG_DROP_AUDIO_ON_CONGESTION
+    // Allow at least one RTT of audio in flight before treating the backlog as congestion
+    size_t max_backlog = PROTOCOL_AUDIO_CONGESTION_BACKLOG;
+    auto quality = link_estimator_.GetQuality();
+    if (quality.srtt_ms > 0 && frame_duration_ms > 0) {
+        max_backlog = std::max(max_backlog, (size_t)((quality.srtt_ms + 4 * quality.rttvar_ms) / frame_duration_ms));
+    }
+    if (backlog > max_backlog) {
+        if (outbound_stats_.audio_dropped++ % 50 == 0) {
+            ESP_LOGW(TAG, "Uplink congested, dropped %lu audio frames, backlog: %u", outbound_stats_.audio_dropped.load(), backlog);
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
 bool Protocol::IsTimeout() const {
     const int kTimeoutSeconds = 120;
     auto now = std::chrono::steady_clock::now();
@@ -6,6 +6,15 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+#include "link_estimator.h"
+
+// Frames waiting in the send queue before the uplink is considered congested
+#define PROTOCOL_AUDIO_CONGESTION_BACKLOG 8
 
 struct AudioStreamPacket {
     int sample_rate = 0;
@@ -30,6 +39,14 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+// Written by the main loop, read by the diagnostics tool from other tasks
+struct OutboundStats {
+    std::atomic<uint32_t> control_sent{0};
+    std::atomic<uint32_t> audio_dropped{0};
+    std::atomic<int64_t> max_control_latency_us{0};  // Longest time a control message waited before it was sent
+    std::atomic<int64_t> last_abort_latency_us{0};   // From AbortSpeaking to the abort message being written
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -60,6 +77,9 @@ public:
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
+    void OnPong(std::function<void(uint32_t id)> callback);
+    // Called on the queuing task when a control message is queued, the main loop then flushes it
+    void OnControlQueued(std::function<void()> callback);
 
     virtual bool Start() = 0;
     virtual bool OpenAudioChannel() = 0;
@@ -71,6 +91,26 @@ public:
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
+    void SendPing(uint32_t id);
+
+    // Transport state used by the connection supervisor
+    virtual bool IsConnected() const = 0;
+    virtual bool IsPersistent() const { return false; }
+    // Blocks until connected or failed, runs on the supervisor's reconnect task
+    virtual bool Reconnect() { return false; }
+    virtual void CloseConnection() = 0;
+    inline std::chrono::time_point<std::chrono::steady_clock> last_incoming_time() const {
+        return last_incoming_time_;
+    }
+
+    // Control lane: control messages and MCP replies may be queued from any task, the main
+    // loop flushes them ahead of the pending audio frames
+    void QueueMcpMessage(const std::string& payload);
+    bool HasPendingControlMessages();
+    void FlushControlMessages();
+    bool ShouldDropAudio(size_t backlog, int frame_duration_ms);
+    const OutboundStats& outbound_stats() const { return outbound_stats_; }
+    LinkEstimator& link_estimator() { return link_estimator_; }
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
@@ -78,16 +118,33 @@ protected:
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
+    std::function<void(uint32_t id)> on_pong_;
+    std::function<void()> on_control_queued_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    OutboundStats outbound_stats_;
+    LinkEstimator link_estimator_;
 
     virtual bool SendText(const std::string& text) = 0;
+    void SendControl(const std::string& text, bool abort = false);
     virtual void SetError(const std::string& message);
+    void HandlePong(const cJSON* root);
     virtual bool IsTimeout() const;
+
+private:
+    struct ControlMessage {
+        std::string text;
+        int64_t queued_time_us;
+        bool mcp;    // text is a JSON-RPC payload, wrapped with the session id when sent
+        bool abort;
+    };
+
+    std::mutex control_mutex_;
+    std::deque<ControlMessage> control_queue_;
 };
 
 #endif // PROTOCOL_H
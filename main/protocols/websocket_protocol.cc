@@ -3,6 +3,7 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "connection_manager.h"
 
 #include <cstring>
 #include <cJSON.h>
@@ -41,6 +42,7 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         bp2->payload_size = htonl(packet->payload.size());
         memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
 
+        link_estimator_.OnBytesSent(serialized.size());
         return websocket_->Send(serialized.data(), serialized.size(), true);
     } else if (version_ == 3) {
         std::string serialized;
@@ -51,8 +53,10 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         bp3->payload_size = htons(packet->payload.size());
         memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
 
+        link_estimator_.OnBytesSent(serialized.size());
         return websocket_->Send(serialized.data(), serialized.size(), true);
     } else {
+        link_estimator_.OnBytesSent(packet->payload.size());
         return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
     }
 }
@@ -62,6 +66,7 @@ bool WebsocketProtocol::SendText(const std::string& text) {
         return false;
     }
 
+    link_estimator_.OnBytesSent(text.size());
     if (!websocket_->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
@@ -75,7 +80,19 @@ bool WebsocketProtocol::IsAudioChannelOpened() const {
     return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
+bool WebsocketProtocol::IsConnected() const {
+    return websocket_ != nullptr && websocket_->IsConnected();
+}
+
+// The server stopped answering pings during a session
+void WebsocketProtocol::CloseConnection() {
+    websocket_.reset();
+    SetError(Lang::Strings::SERVER_TIMEOUT);
+}
+
 void WebsocketProtocol::CloseAudioChannel() {
+    // Queued control messages, like a stop listening, go out before the channel closes
+    FlushControlMessages();
     websocket_.reset();
 }
 
@@ -90,8 +107,8 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     error_occurred_ = false;
 
-    auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
+    auto& connection_manager = ConnectionManager::GetInstance();
+    websocket_ = connection_manager.CreateWebSocket(1);
     if (websocket_ == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
         return false;
@@ -109,6 +126,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
     websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
+        link_estimator_.OnBytesReceived(len);
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
                 if (version_ == 2) {
@@ -151,6 +169,8 @@ bool WebsocketProtocol::OpenAudioChannel() {
             if (cJSON_IsString(type)) {
                 if (strcmp(type->valuestring, "hello") == 0) {
                     ParseServerHello(root);
+                } else if (strcmp(type->valuestring, "pong") == 0) {
+                    HandlePong(root);
                 } else {
                     if (on_incoming_json_ != nullptr) {
                         on_incoming_json_(root);
@@ -172,7 +192,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
     });
 
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
+    if (!connection_manager.ConnectWebSocket(websocket_.get(), url)) {
         ESP_LOGE(TAG, "Failed to connect to websocket server");
         SetError(Lang::Strings::SERVER_NOT_CONNECTED);
         return false;
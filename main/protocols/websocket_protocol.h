@@ -20,6 +20,8 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    bool IsConnected() const override;
+    void CloseConnection() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
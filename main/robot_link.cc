@@ -0,0 +1,283 @@
+#include "robot_link.h"
+#include "task_registry.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+#include <sdkconfig.h>
+#include <chrono>
+#include <future>
+#include <memory>
+
+#define TAG "RobotLink"
+
+#define FRAME_SOF0 0xA5
+#define FRAME_SOF1 0x5A
+#define FRAME_HEADER_SIZE 5     // SOF0, SOF1, len, seq, type
+#define FRAME_CRC_SIZE 2
+
+#ifndef CONFIG_ROBOT_UART_RX_PIN
+#define CONFIG_ROBOT_UART_RX_PIN -1
+#endif
+
+// CRC-16/CCITT-FALSE, small enough for frames of a few bytes without a table
+static uint16_t Crc16(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < size; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void RobotLink::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_) {
+        return;
+    }
+    started_ = true;
+
+    const uart_config_t uart_config = {
+        .baud_rate = ROBOT_LINK_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
+    };
+    uart_driver_install(ROBOT_LINK_UART_NUM, 1024 * 2, 0, 0, NULL, 0);
+    uart_param_config(ROBOT_LINK_UART_NUM, &uart_config);
+#if CONFIG_ROBOT_UART_FRAMED
+    rx_enabled_ = CONFIG_ROBOT_UART_RX_PIN >= 0;
+#endif
+    uart_set_pin(ROBOT_LINK_UART_NUM, ROBOT_LINK_TX_PIN, rx_enabled_ ? CONFIG_ROBOT_UART_RX_PIN : UART_PIN_NO_CHANGE,
+        UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+
+    TaskRegistry::GetInstance().Create("robot_link_tx", [](void* arg) {
+        static_cast<RobotLink*>(arg)->TxTask();
+        vTaskDelete(NULL);
+    }, this);
+    if (rx_enabled_) {
+        TaskRegistry::GetInstance().Create("robot_link_rx", [](void* arg) {
+            static_cast<RobotLink*>(arg)->RxTask();
+            vTaskDelete(NULL);
+        }, this);
+    }
+}
+
+bool RobotLink::Send(uint8_t command, const std::vector<uint8_t>& params, DoneCallback done) {
+    return Enqueue(command, params, std::move(done), nullptr);
+}
+
+bool RobotLink::Enqueue(uint8_t command, const std::vector<uint8_t>& params, DoneCallback done,
+    std::function<void()> dequeued) {
+    if (params.size() + 1 > ROBOT_LINK_MAX_PAYLOAD) {
+        ESP_LOGE(TAG, "Command %c: too many parameters (%u)", command, params.size());
+        return false;
+    }
+    Start();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() >= ROBOT_LINK_QUEUE_SIZE) {
+        stats_.dropped++;
+        ESP_LOGW(TAG, "Queue full, dropping command %c", command);
+        return false;
+    }
+    PendingCommand pending;
+    pending.seq = next_seq_++;
+    pending.payload.reserve(params.size() + 1);
+    pending.payload.push_back(command);
+    pending.payload.insert(pending.payload.end(), params.begin(), params.end());
+    pending.done = std::move(done);
+    pending.dequeued = std::move(dequeued);
+    queue_.push_back(std::move(pending));
+    cv_.notify_all();
+    return true;
+}
+
+bool RobotLink::SendAndWait(uint8_t command, const std::vector<uint8_t>& params) {
+    auto result = std::make_shared<std::promise<bool>>();
+    auto future = result->get_future();
+    auto dequeued = std::make_shared<std::promise<void>>();
+    auto dequeued_future = dequeued->get_future();
+    if (!Enqueue(command, params, [result](bool acked) { result->set_value(acked); },
+            [dequeued]() { dequeued->set_value(); })) {
+        return false;
+    }
+    // The commands ahead in the queue take their own time, the timeout is for this one
+    dequeued_future.wait();
+    if (future.wait_for(std::chrono::milliseconds(ROBOT_LINK_WAIT_TIMEOUT_MS)) != std::future_status::ready) {
+        ESP_LOGW(TAG, "Command %c: no result in %d ms", command, ROBOT_LINK_WAIT_TIMEOUT_MS);
+        return false;
+    }
+    return future.get();
+}
+
+void RobotLink::OnTelemetry(TelemetryCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    on_telemetry_ = std::move(callback);
+}
+
+void RobotLink::TxTask() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return !queue_.empty(); });
+        auto command = std::move(queue_.front());
+        queue_.pop_front();
+        if (command.dequeued) {
+            command.dequeued();
+        }
+
+        bool acked = Transmit(lock, command);
+        if (command.done) {
+            lock.unlock();
+            command.done(acked);
+            lock.lock();
+        }
+    }
+}
+
+bool RobotLink::Transmit(std::unique_lock<std::mutex>& lock, const PendingCommand& command) {
+#if CONFIG_ROBOT_UART_FRAMED
+    std::vector<uint8_t> frame = { FRAME_SOF0, FRAME_SOF1, (uint8_t)command.payload.size(), command.seq, kRobotFrameCommand };
+    frame.insert(frame.end(), command.payload.begin(), command.payload.end());
+    uint16_t crc = Crc16(frame.data() + 2, frame.size() - 2);
+    frame.push_back(crc & 0xFF);
+    frame.push_back(crc >> 8);
+
+    int attempts = rx_enabled_ ? ROBOT_LINK_MAX_RETRIES + 1 : 1;
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        if (attempt > 0) {
+            stats_.retransmits++;
+            ESP_LOGW(TAG, "Command %c (seq %u): retransmit %d", command.payload[0], command.seq, attempt);
+        }
+        ack_seq_ = -1;
+        stats_.sent++;
+        lock.unlock();
+        uart_write_bytes(ROBOT_LINK_UART_NUM, frame.data(), frame.size());
+        lock.lock();
+        if (!rx_enabled_) {
+            // Nothing to confirm with
+            return true;
+        }
+
+        bool answered = cv_.wait_for(lock, std::chrono::milliseconds(ROBOT_LINK_ACK_TIMEOUT_MS), [this, &command]() {
+            return ack_seq_ == command.seq;
+        });
+        if (answered && ack_ok_) {
+            stats_.acked++;
+            return true;
+        }
+    }
+    stats_.failed++;
+    ESP_LOGE(TAG, "Command %c (seq %u) was not acked", command.payload[0], command.seq);
+    return false;
+#else
+    stats_.sent++;
+    lock.unlock();
+    uart_write_bytes(ROBOT_LINK_UART_NUM, &command.payload[0], 1);
+    lock.lock();
+    return true;
+#endif
+}
+
+void RobotLink::RxTask() {
+    uint8_t frame[FRAME_HEADER_SIZE + ROBOT_LINK_MAX_PAYLOAD + FRAME_CRC_SIZE];
+    size_t received = 0;
+    size_t frame_size = 0;
+    while (true) {
+        uint8_t byte;
+        if (uart_read_bytes(ROBOT_LINK_UART_NUM, &byte, 1, portMAX_DELAY) != 1) {
+            continue;
+        }
+
+        // Resynchronize on the start of frame bytes after any error
+        if ((received == 0 && byte != FRAME_SOF0) || (received == 1 && byte != FRAME_SOF1)) {
+            received = 0;
+            continue;
+        }
+        if (received == 2) {
+            if (byte > ROBOT_LINK_MAX_PAYLOAD) {
+                received = 0;
+                continue;
+            }
+            frame_size = FRAME_HEADER_SIZE + byte + FRAME_CRC_SIZE;
+        }
+        frame[received++] = byte;
+        if (received < FRAME_HEADER_SIZE || received < frame_size) {
+            continue;
+        }
+
+        uint8_t length = frame[2];
+        uint16_t crc = frame[FRAME_HEADER_SIZE + length] | (frame[FRAME_HEADER_SIZE + length + 1] << 8);
+        if (Crc16(frame + 2, FRAME_HEADER_SIZE - 2 + length) == crc) {
+            HandleFrame(frame[3], frame[4], frame + FRAME_HEADER_SIZE, length);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.crc_errors++;
+        }
+        received = 0;
+    }
+}
+
+void RobotLink::HandleFrame(uint8_t seq, uint8_t type, const uint8_t* payload, size_t size) {
+    TelemetryCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        switch (type) {
+            case kRobotFrameAck:
+            case kRobotFrameNack:
+                if (type == kRobotFrameNack) {
+                    stats_.nacked++;
+                }
+                ack_seq_ = seq;
+                ack_ok_ = type == kRobotFrameAck;
+                cv_.notify_all();
+                return;
+            case kRobotFrameTelemetry:
+                stats_.telemetry++;
+                last_telemetry_.assign(payload, payload + size);
+                callback = on_telemetry_;
+                break;
+            default:
+                ESP_LOGW(TAG, "Unknown frame type 0x%02x", type);
+                return;
+        }
+    }
+    if (callback) {
+        callback(payload, size);
+    }
+}
+
+std::string RobotLink::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+#if CONFIG_ROBOT_UART_FRAMED
+    cJSON_AddStringToObject(root, "mode", rx_enabled_ ? "framed" : "framed_tx_only");
+#else
+    cJSON_AddStringToObject(root, "mode", "byte");
+#endif
+    cJSON_AddNumberToObject(root, "queued", queue_.size());
+    cJSON_AddNumberToObject(root, "sent", stats_.sent);
+    cJSON_AddNumberToObject(root, "acked", stats_.acked);
+    cJSON_AddNumberToObject(root, "nacked", stats_.nacked);
+    cJSON_AddNumberToObject(root, "retransmits", stats_.retransmits);
+    cJSON_AddNumberToObject(root, "failed", stats_.failed);
+    cJSON_AddNumberToObject(root, "dropped", stats_.dropped);
+    cJSON_AddNumberToObject(root, "crc_errors", stats_.crc_errors);
+    cJSON_AddNumberToObject(root, "telemetry", stats_.telemetry);
+    if (!last_telemetry_.empty()) {
+        std::string hex;
+        char byte_hex[3];
+        for (auto byte : last_telemetry_) {
+            snprintf(byte_hex, sizeof(byte_hex), "%02x", byte);
+            hex += byte_hex;
+        }
+        cJSON_AddStringToObject(root, "last_telemetry", hex.c_str());
+    }
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,113 @@
+#ifndef _ROBOT_LINK_H_
+#define _ROBOT_LINK_H_
+
+#include <driver/uart.h>
+#include <driver/gpio.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define ROBOT_LINK_UART_NUM UART_NUM_2
+#define ROBOT_LINK_TX_PIN GPIO_NUM_46
+#define ROBOT_LINK_BAUD_RATE 115200
+
+#define ROBOT_LINK_QUEUE_SIZE 16
+#define ROBOT_LINK_ACK_TIMEOUT_MS 100
+#define ROBOT_LINK_MAX_RETRIES 3            // Retransmissions after the first try
+#define ROBOT_LINK_WAIT_TIMEOUT_MS 1000     // SendAndWait, from the command leaving the queue
+#define ROBOT_LINK_MAX_PAYLOAD 32
+
+/*
+ * Frame format with CONFIG_ROBOT_UART_FRAMED, little endian:
+ *
+ *   0xA5 0x5A | len | seq | type | payload[len] | crc16
+ *
+ * crc16 is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over len, seq, type and
+ * the payload. A command payload is the command byte followed by its parameters.
+ * The peripheral answers each command frame with an ack (or a nack on a bad
+ * frame) carrying the same seq; a command received again with the seq of the
+ * previous one is acked without being run again. Telemetry frames from the
+ * peripheral are not acked.
+ *
+ * Without it every command is sent as its single command byte, as before.
+ */
+enum RobotFrameType : uint8_t {
+    kRobotFrameCommand = 0x01,
+    kRobotFrameAck = 0x02,
+    kRobotFrameNack = 0x03,
+    kRobotFrameTelemetry = 0x04,
+};
+
+/*
+ * Commands to the robot peripheral on UART2. They are queued and sent in order
+ * by one task, so commands from tool workers and the display do not interleave.
+ * Acks are only awaited when an RX pin is configured.
+ */
+class RobotLink {
+public:
+    using DoneCallback = std::function<void(bool acked)>;
+    using TelemetryCallback = std::function<void(const uint8_t* data, size_t size)>;
+
+    static RobotLink& GetInstance() {
+        static RobotLink instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    RobotLink(const RobotLink&) = delete;
+    RobotLink& operator=(const RobotLink&) = delete;
+
+    // Installs the UART driver and starts the link tasks, once
+    void Start();
+    // False if the queue is full; done is called on the link task
+    bool Send(uint8_t command, const std::vector<uint8_t>& params = {}, DoneCallback done = nullptr);
+    // Blocks until the command is acked or given up, true right after sending if acks are not used
+    bool SendAndWait(uint8_t command, const std::vector<uint8_t>& params = {});
+    void OnTelemetry(TelemetryCallback callback);
+    std::string GetStatsJson();
+
+private:
+    RobotLink() = default;
+
+    struct PendingCommand {
+        uint8_t seq;
+        std::vector<uint8_t> payload;
+        DoneCallback done;
+        std::function<void()> dequeued;     // Called on the link task before the command is sent
+    };
+
+    struct LinkStats {
+        uint32_t sent = 0;
+        uint32_t acked = 0;
+        uint32_t nacked = 0;
+        uint32_t retransmits = 0;
+        uint32_t failed = 0;
+        uint32_t dropped = 0;           // Queue full
+        uint32_t crc_errors = 0;
+        uint32_t telemetry = 0;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<PendingCommand> queue_;
+    bool started_ = false;
+    bool rx_enabled_ = false;
+    uint8_t next_seq_ = 0;
+    int ack_seq_ = -1;                  // seq of the last ack or nack received
+    bool ack_ok_ = false;
+    LinkStats stats_;
+    std::vector<uint8_t> last_telemetry_;
+    TelemetryCallback on_telemetry_;
+
+    bool Enqueue(uint8_t command, const std::vector<uint8_t>& params, DoneCallback done,
+        std::function<void()> dequeued);
+    void TxTask();
+    void RxTask();
+    bool Transmit(std::unique_lock<std::mutex>& lock, const PendingCommand& command);
+    void HandleFrame(uint8_t seq, uint8_t type, const uint8_t* payload, size_t size);
+};
+
+#endif // _ROBOT_LINK_H_
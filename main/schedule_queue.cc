@@ -0,0 +1,100 @@
+#include "schedule_queue.h"
+
+#include <esp_log.h>
+
+#define TAG "ScheduleQueue"
+
+static_assert((SCHEDULE_QUEUE_SIZE & (SCHEDULE_QUEUE_SIZE - 1)) == 0, "SCHEDULE_QUEUE_SIZE must be a power of 2");
+
+ScheduleQueue::ScheduleQueue() {
+    for (uint32_t i = 0; i < SCHEDULE_QUEUE_SIZE; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool ScheduleQueue::TryPush(ScheduledTask& task) {
+    uint32_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & (SCHEDULE_QUEUE_SIZE - 1)];
+        uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)sequence - (int32_t)pos;
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The consumer has not released this slot yet, the ring is full
+            return false;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->task = std::move(task);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    UpdateMaxDepth(pos + 1 - dequeue_pos_.load(std::memory_order_relaxed));
+    return true;
+}
+
+void ScheduleQueue::Push(ScheduledTask&& task) {
+    pushed_.fetch_add(1, std::memory_order_relaxed);
+    if (task.heap_allocated()) {
+        heap_allocated_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (!overflow_pending_.load(std::memory_order_acquire) && TryPush(task)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    auto overflowed = overflowed_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (overflow_.empty()) {
+        ESP_LOGW(TAG, "Schedule queue full, %lu tasks overflowed in total", overflowed);
+    }
+    overflow_.push_back(std::move(task));
+    overflow_pending_.store(true, std::memory_order_release);
+}
+
+bool ScheduleQueue::Pop(ScheduledTask& task) {
+    uint32_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell& cell = cells_[pos & (SCHEDULE_QUEUE_SIZE - 1)];
+    uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if ((int32_t)sequence - (int32_t)(pos + 1) >= 0) {
+        task = std::move(cell.task);
+        cell.sequence.store(pos + SCHEDULE_QUEUE_SIZE, std::memory_order_release);
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // The ring is empty, everything in the overflow list was pushed after it
+    if (!overflow_pending_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    if (overflow_.empty()) {
+        overflow_pending_.store(false, std::memory_order_release);
+        return false;
+    }
+    task = std::move(overflow_.front());
+    overflow_.pop_front();
+    if (overflow_.empty()) {
+        overflow_pending_.store(false, std::memory_order_release);
+    }
+    return true;
+}
+
+void ScheduleQueue::UpdateMaxDepth(uint32_t depth) {
+    uint32_t current = max_depth_.load(std::memory_order_relaxed);
+    while (depth > current && !max_depth_.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {
+    }
+}
+
+ScheduleQueueStats ScheduleQueue::GetStats() const {
+    ScheduleQueueStats stats;
+    stats.pushed = pushed_.load(std::memory_order_relaxed);
+    stats.overflowed = overflowed_.load(std::memory_order_relaxed);
+    stats.heap_allocated = heap_allocated_.load(std::memory_order_relaxed);
+    stats.max_depth = max_depth_.load(std::memory_order_relaxed);
+    return stats;
+}
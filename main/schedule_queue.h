@@ -0,0 +1,172 @@
+#ifndef _SCHEDULE_QUEUE_H_
+#define _SCHEDULE_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#define SCHEDULE_QUEUE_SIZE 32              // Must be a power of 2
+#define SCHEDULED_TASK_INLINE_SIZE 48       // Enough for `this` plus a few pointers and a std::string
+
+/*
+ * A move-only void() callable that keeps small captures inline instead of
+ * allocating like std::function. Larger or throwing-move captures are boxed
+ * on the heap and counted by the queue.
+ */
+class ScheduledTask {
+public:
+    ScheduledTask() = default;
+
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, ScheduledTask>>>
+    ScheduledTask(F&& callable) {
+        using T = std::decay_t<F>;
+        if constexpr (sizeof(T) <= SCHEDULED_TASK_INLINE_SIZE && alignof(T) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<T>) {
+            new (storage_) T(std::forward<F>(callable));
+            invoke_ = [](void* storage) { (*static_cast<T*>(storage))(); };
+            manage_ = [](void* dst, void* src) {
+                auto source = static_cast<T*>(src);
+                if (dst != nullptr) {
+                    new (dst) T(std::move(*source));
+                }
+                source->~T();
+            };
+        } else {
+            *reinterpret_cast<T**>(storage_) = new T(std::forward<F>(callable));
+            invoke_ = [](void* storage) { (**static_cast<T**>(storage))(); };
+            manage_ = [](void* dst, void* src) {
+                auto source = static_cast<T**>(src);
+                if (dst != nullptr) {
+                    *static_cast<T**>(dst) = *source;
+                } else {
+                    delete *source;
+                }
+            };
+            heap_allocated_ = true;
+        }
+    }
+
+    ScheduledTask(ScheduledTask&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    ScheduledTask& operator=(ScheduledTask&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    ScheduledTask(const ScheduledTask&) = delete;
+    ScheduledTask& operator=(const ScheduledTask&) = delete;
+
+    ~ScheduledTask() {
+        Reset();
+    }
+
+    void operator()() {
+        invoke_(storage_);
+    }
+
+    explicit operator bool() const { return invoke_ != nullptr; }
+    bool heap_allocated() const { return heap_allocated_; }
+
+    // Where and when the task was scheduled, for the event loop statistics
+    void SetOrigin(const char* file, int line, int64_t queued_time_us) {
+        file_ = file;
+        line_ = line;
+        queued_time_us_ = queued_time_us;
+    }
+    const char* file() const { return file_; }
+    int line() const { return line_; }
+    int64_t queued_time_us() const { return queued_time_us_; }
+
+    void Reset() {
+        if (manage_ != nullptr) {
+            manage_(nullptr, storage_);
+        }
+        invoke_ = nullptr;
+        manage_ = nullptr;
+        heap_allocated_ = false;
+    }
+
+private:
+    alignas(std::max_align_t) uint8_t storage_[SCHEDULED_TASK_INLINE_SIZE];
+    void (*invoke_)(void* storage) = nullptr;
+    void (*manage_)(void* dst, void* src) = nullptr;   // Move src into dst, or destroy src if dst is null
+    bool heap_allocated_ = false;
+    const char* file_ = nullptr;
+    int line_ = 0;
+    int64_t queued_time_us_ = 0;
+
+    void MoveFrom(ScheduledTask& other) {
+        if (other.manage_ != nullptr) {
+            other.manage_(storage_, other.storage_);
+        }
+        invoke_ = other.invoke_;
+        manage_ = other.manage_;
+        heap_allocated_ = other.heap_allocated_;
+        file_ = other.file_;
+        line_ = other.line_;
+        queued_time_us_ = other.queued_time_us_;
+        other.invoke_ = nullptr;
+        other.manage_ = nullptr;
+        other.heap_allocated_ = false;
+    }
+};
+
+struct ScheduleQueueStats {
+    uint32_t pushed = 0;
+    uint32_t overflowed = 0;        // Pushed to the locked overflow list because the ring was full
+    uint32_t heap_allocated = 0;    // Captures too large to be stored inline
+    uint32_t max_depth = 0;
+};
+
+/*
+ * Bounded multi-producer single-consumer queue of ScheduledTask.
+ * Producers claim a slot with a CAS on the enqueue position (per-slot sequence
+ * numbers as in Vyukov's bounded queue), so Schedule never takes a lock on the
+ * fast path. When the ring is full, tasks go to a mutex protected overflow list
+ * instead of being dropped; until the consumer drains it, later tasks follow them
+ * there to keep the order.
+ */
+class ScheduleQueue {
+public:
+    ScheduleQueue();
+
+    // Safe to call from any task
+    void Push(ScheduledTask&& task);
+    // Must only be called from the consumer task
+    bool Pop(ScheduledTask& task);
+    ScheduleQueueStats GetStats() const;
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        ScheduledTask task;
+    };
+
+    Cell cells_[SCHEDULE_QUEUE_SIZE];
+    std::atomic<uint32_t> enqueue_pos_{0};
+    std::atomic<uint32_t> dequeue_pos_{0};     // Only written by the consumer
+
+    std::mutex overflow_mutex_;
+    std::deque<ScheduledTask> overflow_;
+    std::atomic<bool> overflow_pending_{false};
+
+    std::atomic<uint32_t> pushed_{0};
+    std::atomic<uint32_t> overflowed_{0};
+    std::atomic<uint32_t> heap_allocated_{0};
+    std::atomic<uint32_t> max_depth_{0};
+
+    bool TryPush(ScheduledTask& task);
+    void UpdateMaxDepth(uint32_t depth);
+};
+
+#endif // _SCHEDULE_QUEUE_H_
@@ -1,58 +1,265 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_system.h>
 #include <nvs_flash.h>
+#include <cJSON.h>
 
 #define TAG "Settings"
 
-Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
-    nvs_open(ns.c_str(), read_write_ ? NVS_READWRITE : NVS_READONLY, &nvs_handle_);
+SettingsStore::SettingsStore() {
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<SettingsStore*>(arg)->Flush();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "settings_flush",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &flush_timer_));
+
+    // esp_restart() runs the shutdown handlers, so pending writes survive a reboot
+    esp_register_shutdown_handler([]() {
+        SettingsStore::GetInstance().Flush();
+    });
 }
 
-Settings::~Settings() {
-    if (nvs_handle_ != 0) {
-        if (read_write_ && dirty_) {
-            ESP_ERROR_CHECK(nvs_commit(nvs_handle_));
+SettingsStore::~SettingsStore() {
+    if (flush_timer_ != nullptr) {
+        esp_timer_stop(flush_timer_);
+        esp_timer_delete(flush_timer_);
+    }
+}
+
+SettingsStore::Entry& SettingsStore::Load(const std::string& ns, const std::string& key, EntryType type) {
+    auto& space = namespaces_[ns];
+    auto it = space.entries.find(key);
+    // A miss cached for the other type says nothing about this one, look it up again
+    if (it != space.entries.end() && (it->second.present || it->second.dirty || it->second.type == type)) {
+        return it->second;
+    }
+
+    auto& entry = space.entries[key];
+    entry.type = type;
+    if (space.erase_all) {
+        return entry;
+    }
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(ns.c_str(), NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return entry;
+    }
+    if (type == kEntryTypeInt) {
+        entry.present = nvs_get_i32(nvs_handle, key.c_str(), &entry.int_value) == ESP_OK;
+    } else {
+        size_t length = 0;
+        if (nvs_get_str(nvs_handle, key.c_str(), nullptr, &length) == ESP_OK) {
+            entry.string_value.resize(length);
+            ESP_ERROR_CHECK(nvs_get_str(nvs_handle, key.c_str(), entry.string_value.data(), &length));
+            while (!entry.string_value.empty() && entry.string_value.back() == '\0') {
+                entry.string_value.pop_back();
+            }
+            entry.present = true;
         }
-        nvs_close(nvs_handle_);
     }
+    nvs_close(nvs_handle);
+    return entry;
 }
 
-std::string Settings::GetString(const std::string& key, const std::string& default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
+void SettingsStore::MarkDirty(Namespace& ns, Entry& entry) {
+    entry.dirty = true;
+    ns.dirty = true;
+    ScheduleFlush();
+}
+
+void SettingsStore::ScheduleFlush() {
+    // The window starts with the first write and is not extended, so a stream of writes is still saved regularly
+    if (!flush_pending_) {
+        flush_pending_ = true;
+        esp_timer_start_once(flush_timer_, SETTINGS_FLUSH_DELAY_MS * 1000);
     }
+}
 
-    size_t length = 0;
-    if (nvs_get_str(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
-        return default_value;
+bool SettingsStore::GetString(const std::string& ns, const std::string& key, std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = Load(ns, key, kEntryTypeString);
+    if (!entry.present || entry.type != kEntryTypeString) {
+        return false;
+    }
+    value = entry.string_value;
+    return true;
+}
+
+void SettingsStore::SetString(const std::string& ns, const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.writes++;
+    auto& entry = Load(ns, key, kEntryTypeString);
+    if (entry.present && entry.type == kEntryTypeString && entry.string_value == value) {
+        stats_.unchanged++;
+        return;
+    }
+    entry.type = kEntryTypeString;
+    entry.present = true;
+    entry.string_value = value;
+    MarkDirty(namespaces_[ns], entry);
+}
+
+bool SettingsStore::GetInt(const std::string& ns, const std::string& key, int32_t& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = Load(ns, key, kEntryTypeInt);
+    if (!entry.present || entry.type != kEntryTypeInt) {
+        return false;
     }
+    value = entry.int_value;
+    return true;
+}
+
+void SettingsStore::SetInt(const std::string& ns, const std::string& key, int32_t value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.writes++;
+    auto& entry = Load(ns, key, kEntryTypeInt);
+    if (entry.present && entry.type == kEntryTypeInt && entry.int_value == value) {
+        stats_.unchanged++;
+        return;
+    }
+    entry.type = kEntryTypeInt;
+    entry.present = true;
+    entry.int_value = value;
+    entry.string_value.clear();
+    MarkDirty(namespaces_[ns], entry);
+}
+
+void SettingsStore::EraseKey(const std::string& ns, const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.writes++;
+    auto& space = namespaces_[ns];
+    auto& entry = space.entries[key];
+    entry.present = false;
+    entry.string_value.clear();
+    MarkDirty(space, entry);
+}
+
+void SettingsStore::EraseAll(const std::string& ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.writes++;
+    auto& space = namespaces_[ns];
+    space.entries.clear();
+    space.erase_all = true;
+    space.dirty = true;
+    ScheduleFlush();
+}
 
+void SettingsStore::Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (flush_pending_) {
+        esp_timer_stop(flush_timer_);
+        flush_pending_ = false;
+    }
+
+    for (auto& [name, space] : namespaces_) {
+        if (!space.dirty) {
+            continue;
+        }
+
+        nvs_handle_t nvs_handle;
+        esp_err_t err = nvs_open(name.c_str(), NVS_READWRITE, &nvs_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to open namespace %s: %s", name.c_str(), esp_err_to_name(err));
+            continue;
+        }
+
+        int written = 0;
+        if (space.erase_all) {
+            err = nvs_erase_all(nvs_handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to erase namespace %s: %s", name.c_str(), esp_err_to_name(err));
+            }
+            space.erase_all = false;
+            written++;
+        }
+        for (auto& [key, entry] : space.entries) {
+            if (!entry.dirty) {
+                continue;
+            }
+            if (!entry.present) {
+                err = nvs_erase_key(nvs_handle, key.c_str());
+                if (err == ESP_ERR_NVS_NOT_FOUND) {
+                    err = ESP_OK;
+                }
+            } else if (entry.type == kEntryTypeInt) {
+                err = nvs_set_i32(nvs_handle, key.c_str(), entry.int_value);
+            } else {
+                err = nvs_set_str(nvs_handle, key.c_str(), entry.string_value.c_str());
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to write %s.%s: %s", name.c_str(), key.c_str(), esp_err_to_name(err));
+            }
+            entry.dirty = false;
+            written++;
+        }
+
+        err = nvs_commit(nvs_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to commit namespace %s: %s", name.c_str(), esp_err_to_name(err));
+        }
+        nvs_close(nvs_handle);
+        space.dirty = false;
+
+        stats_.nvs_writes += written;
+        stats_.commits++;
+        ESP_LOGI(TAG, "Committed %d keys to %s", written, name.c_str());
+    }
+}
+
+SettingsStats SettingsStore::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::string SettingsStore::GetStatsJson() {
+    auto stats = GetStats();
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "writes", stats.writes);
+    cJSON_AddNumberToObject(root, "unchanged", stats.unchanged);
+    cJSON_AddNumberToObject(root, "nvs_writes", stats.nvs_writes);
+    cJSON_AddNumberToObject(root, "commits", stats.commits);
+    // Writes that were absorbed by the cache instead of reaching the flash
+    uint32_t saved = stats.writes > stats.nvs_writes ? stats.writes - stats.nvs_writes : 0;
+    cJSON_AddNumberToObject(root, "saved", saved);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
+}
+
+Settings::~Settings() {
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
     std::string value;
-    value.resize(length);
-    ESP_ERROR_CHECK(nvs_get_str(nvs_handle_, key.c_str(), value.data(), &length));
-    while (!value.empty() && value.back() == '\0') {
-        value.pop_back();
+    if (!SettingsStore::GetInstance().GetString(ns_, key, value)) {
+        return default_value;
     }
     return value;
 }
 
 void Settings::SetString(const std::string& key, const std::string& value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_str(nvs_handle_, key.c_str(), value.c_str()));
-        dirty_ = true;
+        SettingsStore::GetInstance().SetString(ns_, key, value);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
 
 int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
-    }
-
     int32_t value;
-    if (nvs_get_i32(nvs_handle_, key.c_str(), &value) != ESP_OK) {
+    if (!SettingsStore::GetInstance().GetInt(ns_, key, value)) {
         return default_value;
     }
     return value;
@@ -60,8 +267,7 @@ int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
 
 void Settings::SetInt(const std::string& key, int32_t value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_i32(nvs_handle_, key.c_str(), value));
-        dirty_ = true;
+        SettingsStore::GetInstance().SetInt(ns_, key, value);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -69,10 +275,7 @@ void Settings::SetInt(const std::string& key, int32_t value) {
 
 void Settings::EraseKey(const std::string& key) {
     if (read_write_) {
-        auto ret = nvs_erase_key(nvs_handle_, key.c_str());
-        if (ret != ESP_ERR_NVS_NOT_FOUND) {
-            ESP_ERROR_CHECK(ret);
-        }
+        SettingsStore::GetInstance().EraseKey(ns_, key);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -80,7 +283,7 @@ void Settings::EraseKey(const std::string& key) {
 
 void Settings::EraseAll() {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_erase_all(nvs_handle_));
+        SettingsStore::GetInstance().EraseAll(ns_);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -2,7 +2,82 @@
 #define SETTINGS_H
 
 #include <string>
+#include <map>
+#include <mutex>
 #include <nvs_flash.h>
+#include <esp_timer.h>
+
+#define SETTINGS_FLUSH_DELAY_MS 2000    // Writes within this window are committed together
+
+struct SettingsStats {
+    uint32_t writes = 0;            // Set and erase calls
+    uint32_t unchanged = 0;         // Writes of the value already stored, never reach the flash
+    uint32_t nvs_writes = 0;        // Keys written to or erased from NVS
+    uint32_t commits = 0;
+};
+
+/*
+ * Process wide write-back cache in front of NVS. Values are read from NVS once,
+ * writes only update the cache and mark the key dirty; the dirty keys are written
+ * and committed per namespace by a one-shot timer, on Flush() and before a restart.
+ * Deep sleep and power off do not run the shutdown handlers, their callers flush.
+ * Rapid changes such as dragging the volume end up as a single flash write.
+ */
+class SettingsStore {
+public:
+    static SettingsStore& GetInstance() {
+        static SettingsStore instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    SettingsStore(const SettingsStore&) = delete;
+    SettingsStore& operator=(const SettingsStore&) = delete;
+
+    bool GetString(const std::string& ns, const std::string& key, std::string& value);
+    void SetString(const std::string& ns, const std::string& key, const std::string& value);
+    bool GetInt(const std::string& ns, const std::string& key, int32_t& value);
+    void SetInt(const std::string& ns, const std::string& key, int32_t value);
+    void EraseKey(const std::string& ns, const std::string& key);
+    void EraseAll(const std::string& ns);
+
+    // Write all dirty keys to NVS now
+    void Flush();
+    SettingsStats GetStats();
+    std::string GetStatsJson();
+
+private:
+    SettingsStore();
+    ~SettingsStore();
+
+    enum EntryType {
+        kEntryTypeInt,
+        kEntryTypeString,
+    };
+
+    struct Entry {
+        EntryType type = kEntryTypeInt;
+        bool present = false;       // False if the key does not exist or is erased
+        bool dirty = false;
+        int32_t int_value = 0;
+        std::string string_value;
+    };
+
+    struct Namespace {
+        bool erase_all = false;     // nvs_erase_all is pending, keys not in the cache are absent
+        bool dirty = false;
+        std::map<std::string, Entry> entries;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, Namespace> namespaces_;
+    esp_timer_handle_t flush_timer_ = nullptr;
+    bool flush_pending_ = false;
+    SettingsStats stats_;
+
+    Entry& Load(const std::string& ns, const std::string& key, EntryType type);
+    void MarkDirty(Namespace& ns, Entry& entry);
+    void ScheduleFlush();
+};
 
 class Settings {
 public:
@@ -18,9 +93,7 @@ public:
 
 private:
     std::string ns_;
-    nvs_handle_t nvs_handle_ = 0;
     bool read_write_ = false;
-    bool dirty_ = false;
 };
 
 #endif
@@ -0,0 +1,127 @@
+#include "state_presenter.h"
+#include "board.h"
+#include "display.h"
+#include "task_registry.h"
+#include "assets/lang_config.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "StatePresenter"
+
+StatePresenter::~StatePresenter() {
+    if (task_handle_ != nullptr) {
+        vTaskDelete(task_handle_);
+    }
+}
+
+void StatePresenter::Start() {
+    TaskRegistry::GetInstance().Create("state_presenter", [](void* arg) {
+        StatePresenter* presenter = (StatePresenter*)arg;
+        presenter->PresenterTask();
+        vTaskDelete(NULL);
+    }, this, &task_handle_);
+}
+
+void StatePresenter::Post(DeviceState state) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        posted_++;
+        if (pending_) {
+            coalesced_++;
+        }
+        pending_ = true;
+        pending_state_ = state;
+        pending_time_us_ = esp_timer_get_time();
+    }
+    if (task_handle_ != nullptr) {
+        xTaskNotifyGive(task_handle_);
+    }
+}
+
+void StatePresenter::Flush() {
+    RenderPending(true);
+}
+
+void StatePresenter::PresenterTask() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        RenderPending(false);
+    }
+}
+
+bool StatePresenter::RenderPending(bool flush) {
+    std::lock_guard<std::mutex> render_lock(render_mutex_);
+    DeviceState state;
+    int64_t posted_time_us;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pending_) {
+            return false;
+        }
+        pending_ = false;
+        state = pending_state_;
+        posted_time_us = pending_time_us_;
+    }
+
+    auto start_time = esp_timer_get_time();
+    Render(state);
+    auto end_time = esp_timer_get_time();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (flush) {
+        flushed_++;
+    }
+    latency_.Add(end_time - posted_time_us);
+    render_time_.Add(end_time - start_time);
+    return true;
+}
+
+void StatePresenter::Render(DeviceState state) {
+    auto& board = Board::GetInstance();
+    auto display = board.GetDisplay();
+    auto led = board.GetLed();
+    led->OnStateChanged();
+    switch (state) {
+        case kDeviceStateUnknown:
+        case kDeviceStateIdle:
+            display->SetStatus(Lang::Strings::STANDBY);
+            display->SetEmotion("neutral");
+            break;
+        case kDeviceStateConnecting:
+            display->SetStatus(Lang::Strings::CONNECTING);
+            display->SetEmotion("neutral");
+            display->SetChatMessage("system", "");
+            break;
+        case kDeviceStateListening:
+            display->SetStatus(Lang::Strings::LISTENING);
+            display->SetEmotion("neutral");
+            break;
+        case kDeviceStateSpeaking:
+            display->SetStatus(Lang::Strings::SPEAKING);
+            break;
+        default:
+            // Do nothing
+            break;
+    }
+}
+
+void StatePresenter::ResetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    posted_ = 0;
+    coalesced_ = 0;
+    flushed_ = 0;
+    latency_ = LatencyHistogram();
+    render_time_ = LatencyHistogram();
+}
+
+cJSON* StatePresenter::ToJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "posted", posted_);
+    cJSON_AddNumberToObject(root, "coalesced", coalesced_);
+    cJSON_AddNumberToObject(root, "flushed", flushed_);
+    cJSON_AddItemToObject(root, "latency", latency_.ToJson());
+    cJSON_AddItemToObject(root, "render_time", render_time_.ToJson());
+    return root;
+}
@@ -0,0 +1,53 @@
+#ifndef _STATE_PRESENTER_H_
+#define _STATE_PRESENTER_H_
+
+#include "device_state.h"
+#include "event_loop_stats.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mutex>
+
+/*
+ * Renders the LED and display side of device state transitions on a
+ * low priority task, so SetDeviceState only does the audio and protocol work
+ * on the main loop. Only the latest requested state is kept, a burst of
+ * transitions that arrives before the UI task runs is drawn once.
+ *
+ * Direct writes to the status, emotion or chat message that must land after
+ * the state presentation (alerts) call Flush() first.
+ */
+class StatePresenter {
+public:
+    StatePresenter() = default;
+    ~StatePresenter();
+
+    void Start();
+    // Called from the main loop after the device state has changed
+    void Post(DeviceState state);
+    // Render a pending state on the calling task, if the UI task has not done it yet
+    void Flush();
+
+    void ResetStats();
+    cJSON* ToJson();
+
+private:
+    TaskHandle_t task_handle_ = nullptr;
+    std::mutex render_mutex_;       // Serializes the UI task and Flush()
+    std::mutex mutex_;
+    bool pending_ = false;
+    DeviceState pending_state_ = kDeviceStateUnknown;
+    int64_t pending_time_us_ = 0;
+
+    uint32_t posted_ = 0;
+    uint32_t coalesced_ = 0;        // Replaced by a newer state before being rendered
+    uint32_t flushed_ = 0;          // Rendered by Flush() instead of the UI task
+    LatencyHistogram latency_;      // From Post() to the end of rendering
+    LatencyHistogram render_time_;
+
+    void PresenterTask();
+    bool RenderPending(bool flush);
+    void Render(DeviceState state);
+};
+
+#endif // _STATE_PRESENTER_H_
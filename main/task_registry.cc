@@ -0,0 +1,203 @@
+#include "task_registry.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_pthread.h>
+#include <cJSON.h>
+#include <sdkconfig.h>
+#include <cstring>
+#include <vector>
+
+#define TAG "TaskRegistry"
+
+// Used for tasks that are not in the table, with a warning
+#define TASK_DEFAULT_STACK_SIZE 4096
+#define TASK_DEFAULT_PRIORITY 1
+
+static const TaskConfig DEFAULT_TASKS[] = {
+    // name                     stack           priority                    core
+    { "main",                   CONFIG_ESP_MAIN_TASK_STACK_SIZE, 3,         tskNO_AFFINITY },   // Runs MainEventLoop, stack set by sdkconfig
+    { "state_presenter",        4096,           2,                          tskNO_AFFINITY },   // Below the main event loop
+    { "check_new_version",      4096 * 2,       2,                          tskNO_AFFINITY },
+    { "reconnect",              4096 * 2,       2,                          tskNO_AFFINITY },   // Persistent connection, by the supervisor
+#if CONFIG_USE_AUDIO_PROCESSOR
+    { "audio_input",            2048 * 3,       8,                          1 },
+    { "audio_output",           2048 * 2,       3,                          tskNO_AFFINITY },
+#else
+    { "audio_input",            2048 * 2,       8,                          tskNO_AFFINITY },
+    { "audio_output",           2048,           3,                          tskNO_AFFINITY },
+#endif
+    { "opus_codec",             2048 * 13,      2,                          tskNO_AFFINITY },
+    { "wake_word_preload",      4096 * 2,       1,                          tskNO_AFFINITY },
+    { "audio_communication",    4096,           3,                          tskNO_AFFINITY },
+#if CONFIG_USE_CUSTOM_WAKE_WORD
+    { "audio_detection",        16384,          3,                          tskNO_AFFINITY },
+#else
+    { "audio_detection",        4096,           3,                          tskNO_AFFINITY },
+#endif
+    { "encode_detect_packets",  4096 * 8,       2,                          tskNO_AFFINITY },   // Stack in PSRAM
+    { "tool_worker",            6144,           1,                          tskNO_AFFINITY },   // MCP tool calls
+    { "tool_worker_large",      12288,          1,                          tskNO_AFFINITY },   // MCP tool calls with a large stack
+    { "robot_link_tx",          3072,           4,                          tskNO_AFFINITY },   // UART commands to the robot peripheral
+    { "robot_link_rx",          3072,           4,                          tskNO_AFFINITY },
+    { "jpeg_encoder",           4096,           1,                          tskNO_AFFINITY },   // pthread, camera explain
+    { "img_slideshow",          4096,           3,                          tskNO_AFFINITY },
+    { "otto_action",            1024 * 3,       configMAX_PRIORITIES - 1,   tskNO_AFFINITY },
+    { "electron_action",        1024 * 4,       configMAX_PRIORITIES - 1,   tskNO_AFFINITY },
+};
+
+TaskRegistry::TaskRegistry() {
+    for (const auto& config : DEFAULT_TASKS) {
+        entries_[config.name].config = config;
+    }
+}
+
+TaskRegistry::Entry& TaskRegistry::Find(const char* name) {
+    auto it = entries_.find(name);
+    if (it != entries_.end()) {
+        return it->second;
+    }
+    ESP_LOGW(TAG, "Task %s is not in the table, using defaults", name);
+    auto& entry = entries_[name];
+    entry.config = { name, TASK_DEFAULT_STACK_SIZE, TASK_DEFAULT_PRIORITY, tskNO_AFFINITY };
+    return entry;
+}
+
+void TaskRegistry::Override(const char* name, const TaskOverride& task_override) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = Find(name);
+    if (task_override.stack_size != 0) {
+        entry.config.stack_size = task_override.stack_size;
+    }
+    if (task_override.priority != TASK_OVERRIDE_KEEP) {
+        entry.config.priority = task_override.priority;
+    }
+    if (task_override.core_id != TASK_OVERRIDE_KEEP) {
+        entry.config.core_id = task_override.core_id;
+    }
+    entry.overridden = true;
+    ESP_LOGI(TAG, "Task %s: stack %lu, priority %u, core %d", name, entry.config.stack_size,
+        entry.config.priority, entry.config.core_id == tskNO_AFFINITY ? -1 : (int)entry.config.core_id);
+}
+
+TaskConfig TaskRegistry::Get(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Find(name).config;
+}
+
+BaseType_t TaskRegistry::Create(const char* name, TaskFunction_t function, void* arg, TaskHandle_t* handle) {
+    TaskConfig config;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = Find(name);
+        entry.created++;
+        config = entry.config;
+    }
+    auto ret = xTaskCreatePinnedToCore(function, name, config.stack_size, arg, config.priority, handle, config.core_id);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task %s with %lu bytes of stack", name, config.stack_size);
+    }
+    return ret;
+}
+
+TaskHandle_t TaskRegistry::CreateStatic(const char* name, TaskFunction_t function, void* arg, StackType_t** stack, StaticTask_t* buffer) {
+    TaskConfig config;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = Find(name);
+        entry.created++;
+        config = entry.config;
+    }
+    // The size of an existing stack cannot change, overrides must happen before the first run
+    if (*stack == nullptr) {
+        *stack = (StackType_t*)heap_caps_malloc(config.stack_size, MALLOC_CAP_SPIRAM);
+        if (*stack == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate %lu bytes of stack for task %s", config.stack_size, name);
+            return nullptr;
+        }
+    }
+    return xTaskCreateStaticPinnedToCore(function, name, config.stack_size, arg, config.priority, *stack, buffer, config.core_id);
+}
+
+esp_pthread_cfg_t TaskRegistry::ApplyPthreadConfig(const char* name, uint32_t stack_size) {
+    TaskConfig config;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = Find(name);
+        entry.created++;
+        config = entry.config;
+    }
+    esp_pthread_cfg_t previous;
+    if (esp_pthread_get_cfg(&previous) != ESP_OK) {
+        previous = esp_pthread_get_default_config();
+    }
+    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+    cfg.thread_name = config.name;
+    cfg.stack_size = stack_size != 0 ? stack_size : config.stack_size;
+    cfg.prio = config.priority;
+    cfg.pin_to_core = config.core_id;
+    esp_pthread_set_cfg(&cfg);
+    return previous;
+}
+
+void TaskRegistry::ApplyToCurrentTask(const char* name) {
+    auto config = Get(name);
+    vTaskPrioritySet(NULL, config.priority);
+}
+
+std::string TaskRegistry::GetJson() {
+    std::vector<TaskStatus_t> tasks(uxTaskGetNumberOfTasks() + 5);
+    configRUN_TIME_COUNTER_TYPE total_run_time = 0;
+    tasks.resize(uxTaskGetSystemState(tasks.data(), tasks.size(), &total_run_time));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Share of the time since the previous call, over all cores
+    uint64_t elapsed = (uint64_t)(total_run_time - last_total_run_time_) * CONFIG_FREERTOS_NUMBER_OF_CORES;
+    last_total_run_time_ = total_run_time;
+
+    cJSON* root = cJSON_CreateArray();
+    std::map<TaskHandle_t, configRUN_TIME_COUNTER_TYPE> run_time;
+    for (const auto& [name, entry] : entries_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", name.c_str());
+        cJSON_AddNumberToObject(item, "stack_size", entry.config.stack_size);
+        cJSON_AddNumberToObject(item, "priority", entry.config.priority);
+        cJSON_AddNumberToObject(item, "core", entry.config.core_id == tskNO_AFFINITY ? -1 : entry.config.core_id);
+        cJSON_AddBoolToObject(item, "overridden", entry.overridden);
+        cJSON_AddNumberToObject(item, "created", entry.created);
+
+        // Tasks with the same name, like a worker started again, are added up
+        bool running = false;
+        uint32_t min_free_stack = UINT32_MAX;
+        configRUN_TIME_COUNTER_TYPE task_run_time = 0;
+        for (const auto& task : tasks) {
+            // FreeRTOS keeps only the first configMAX_TASK_NAME_LEN - 1 characters of the name
+            if (strncmp(name.c_str(), task.pcTaskName, configMAX_TASK_NAME_LEN - 1) != 0) {
+                continue;
+            }
+            running = true;
+            if (task.usStackHighWaterMark < min_free_stack) {
+                min_free_stack = task.usStackHighWaterMark;
+            }
+            auto last = last_run_time_.find(task.xHandle);
+            task_run_time += task.ulRunTimeCounter - (last != last_run_time_.end() ? last->second : 0);
+            run_time[task.xHandle] = task.ulRunTimeCounter;
+        }
+        cJSON_AddBoolToObject(item, "running", running);
+        if (running) {
+            // The high-water mark is the least free stack ever, in bytes
+            cJSON_AddNumberToObject(item, "stack_free_min", min_free_stack);
+            if (elapsed > 0) {
+                cJSON_AddNumberToObject(item, "cpu_percent", (int)((uint64_t)task_run_time * 1000 / elapsed) / 10.0);
+            }
+        }
+        cJSON_AddItemToArray(root, item);
+    }
+    last_run_time_ = std::move(run_time);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
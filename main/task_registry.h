@@ -0,0 +1,74 @@
+#ifndef _TASK_REGISTRY_H_
+#define _TASK_REGISTRY_H_
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_pthread.h>
+#include <string>
+#include <map>
+#include <mutex>
+
+#define TASK_OVERRIDE_KEEP -1
+
+struct TaskConfig {
+    const char* name;
+    uint32_t stack_size;        // Bytes
+    UBaseType_t priority;
+    BaseType_t core_id;         // tskNO_AFFINITY to run on any core
+};
+
+// Fields left at their defaults keep the value from the table
+struct TaskOverride {
+    uint32_t stack_size = 0;
+    int priority = TASK_OVERRIDE_KEEP;
+    int core_id = TASK_OVERRIDE_KEEP;
+};
+
+/*
+ * Stack sizes, priorities and core affinities of all tasks started by the
+ * application, in one table (task_registry.cc). Boards adjust entries with
+ * Override() in their constructor, before the tasks are created.
+ */
+class TaskRegistry {
+public:
+    static TaskRegistry& GetInstance() {
+        static TaskRegistry instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    TaskRegistry(const TaskRegistry&) = delete;
+    TaskRegistry& operator=(const TaskRegistry&) = delete;
+
+    void Override(const char* name, const TaskOverride& task_override);
+    TaskConfig Get(const char* name);
+
+    BaseType_t Create(const char* name, TaskFunction_t function, void* arg, TaskHandle_t* handle = nullptr);
+    // The stack is allocated from PSRAM on first use and kept in *stack for later runs
+    TaskHandle_t CreateStatic(const char* name, TaskFunction_t function, void* arg, StackType_t** stack, StaticTask_t* buffer);
+    // Threads started by the calling task after this use the entry (std::thread), a stack_size of 0 keeps the table's.
+    // Returns the config it replaces, to restore with esp_pthread_set_cfg() once the thread is started
+    esp_pthread_cfg_t ApplyPthreadConfig(const char* name, uint32_t stack_size = 0);
+    // For tasks created by the system, like the main task
+    void ApplyToCurrentTask(const char* name);
+
+    // Configuration, stack high-water mark and CPU share since the previous call of every registered task
+    std::string GetJson();
+
+private:
+    TaskRegistry();
+
+    struct Entry {
+        TaskConfig config;
+        bool overridden = false;
+        uint32_t created = 0;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+    std::map<TaskHandle_t, configRUN_TIME_COUNTER_TYPE> last_run_time_;
+    configRUN_TIME_COUNTER_TYPE last_total_run_time_ = 0;
+
+    Entry& Find(const char* name);
+};
+
+#endif // _TASK_REGISTRY_H_
@@ -0,0 +1,254 @@
+#include "tool_worker_pool.h"
+#include "task_registry.h"
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <algorithm>
+#include <chrono>
+
+#define TAG "ToolWorkerPool"
+
+// The job of the tool running on this worker task
+static thread_local ToolJob* current_job = nullptr;
+
+ToolWorkerPool::ToolWorkerPool(ReplyCallback reply) : reply_(std::move(reply)) {
+    const char* task_names[kToolStackClassCount] = { "tool_worker", "tool_worker_large" };
+    const int max_workers[kToolStackClassCount] = { TOOL_WORKER_MAX_DEFAULT, TOOL_WORKER_MAX_LARGE };
+    for (int i = 0; i < kToolStackClassCount; i++) {
+        classes_[i].pool = this;
+        classes_[i].stack_class = (ToolStackClass)i;
+        classes_[i].task_name = task_names[i];
+        classes_[i].max_workers = max_workers[i];
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<ToolWorkerPool*>(arg)->CheckDeadlines();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "tool_deadline",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &deadline_timer_));
+}
+
+ToolWorkerPool::~ToolWorkerPool() {
+    if (deadline_timer_ != nullptr) {
+        esp_timer_stop(deadline_timer_);
+        esp_timer_delete(deadline_timer_);
+    }
+}
+
+bool ToolWorkerPool::IsCurrentCallCancelled() {
+    return current_job != nullptr && current_job->cancelled.load();
+}
+
+ToolJob* ToolWorkerPool::CurrentJob() {
+    return current_job;
+}
+
+bool ToolWorkerPool::Submit(std::shared_ptr<ToolJob> job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = stats_[job->tool_name];
+    if (queued_ >= TOOL_WORKER_QUEUE_SIZE) {
+        stats.rejected++;
+        ESP_LOGW(TAG, "Queue full, rejecting %s (id %d)", job->tool_name.c_str(), job->id);
+        return false;
+    }
+
+    auto& worker_class = classes_[job->stack_class];
+    if (worker_class.idle == 0 && worker_class.workers < worker_class.max_workers) {
+        auto ret = TaskRegistry::GetInstance().Create(worker_class.task_name, [](void* arg) {
+            auto worker_class = (WorkerClass*)arg;
+            worker_class->pool->WorkerLoop(*worker_class);
+            vTaskDelete(NULL);
+        }, &worker_class);
+        if (ret == pdPASS) {
+            worker_class.workers++;
+        } else if (worker_class.workers == 0) {
+            stats.rejected++;
+            return false;
+        }
+    }
+
+    job->enqueue_time_us = esp_timer_get_time();
+    worker_class.queue.push_back(std::move(job));
+    queued_++;
+    worker_class.cv.notify_one();
+
+    if (!esp_timer_is_active(deadline_timer_)) {
+        esp_timer_start_periodic(deadline_timer_, TOOL_WORKER_DEADLINE_CHECK_MS * 1000);
+    }
+    return true;
+}
+
+void ToolWorkerPool::WorkerLoop(WorkerClass& worker_class) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        worker_class.idle++;
+        bool has_job = worker_class.cv.wait_for(lock, std::chrono::milliseconds(TOOL_WORKER_IDLE_TIMEOUT_MS), [&worker_class]() {
+            return !worker_class.queue.empty();
+        });
+        worker_class.idle--;
+        if (!has_job) {
+            worker_class.workers--;
+            ESP_LOGI(TAG, "%s idle, exiting", worker_class.task_name);
+            return;
+        }
+
+        auto job = std::move(worker_class.queue.front());
+        worker_class.queue.pop_front();
+        queued_--;
+        if (job->finished) {
+            // Cancelled or timed out while waiting
+            continue;
+        }
+        auto start_time = esp_timer_get_time();
+        stats_[job->tool_name].queue_wait.Add(start_time - job->enqueue_time_us);
+        running_.push_back(job);
+        lock.unlock();
+
+        std::string payload;
+        bool success = true;
+        current_job = job.get();
+        try {
+            payload = job->run();
+        } catch (const std::exception& e) {
+            ESP_LOGE(TAG, "%s: %s", job->tool_name.c_str(), e.what());
+            payload = e.what();
+            success = false;
+        }
+        current_job = nullptr;
+        auto elapsed_us = esp_timer_get_time() - start_time;
+        Finish(*job, success, payload);
+
+        lock.lock();
+        running_.erase(std::find(running_.begin(), running_.end(), job));
+        auto& stats = stats_[job->tool_name];
+        stats.calls++;
+        stats.execution.Add(elapsed_us);
+        if (!success) {
+            stats.errors++;
+        }
+    }
+}
+
+void ToolWorkerPool::Finish(ToolJob& job, bool success, const std::string& payload) {
+    if (job.finished.exchange(true)) {
+        ESP_LOGW(TAG, "%s (id %d) finished after it was cancelled or timed out, result dropped", job.tool_name.c_str(), job.id);
+        return;
+    }
+    reply_(job.id, success, payload);
+}
+
+bool ToolWorkerPool::Cancel(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& worker_class : classes_) {
+        for (auto& job : worker_class.queue) {
+            if (job->id == id && !job->finished) {
+                // Skipped by the worker that dequeues it
+                job->cancelled = true;
+                job->finished = true;
+                stats_[job->tool_name].cancelled++;
+                ESP_LOGI(TAG, "Cancelled queued %s (id %d)", job->tool_name.c_str(), id);
+                return true;
+            }
+        }
+    }
+    for (auto& job : running_) {
+        if (job->id == id && !job->finished) {
+            job->cancelled = true;
+            job->finished = true;
+            stats_[job->tool_name].cancelled++;
+            ESP_LOGI(TAG, "Cancelled running %s (id %d)", job->tool_name.c_str(), id);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ToolWorkerPool::IsInProgress(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& worker_class : classes_) {
+        for (auto& job : worker_class.queue) {
+            if (job->id == id && !job->finished) {
+                return true;
+            }
+        }
+    }
+    for (auto& job : running_) {
+        if (job->id == id && !job->finished) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ToolWorkerPool::CheckDeadlines() {
+    std::vector<std::shared_ptr<ToolJob>> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = esp_timer_get_time();
+        auto check = [&](const std::shared_ptr<ToolJob>& job) {
+            if (job->deadline_us != 0 && now >= job->deadline_us && !job->finished) {
+                job->cancelled = true;
+                job->finished = true;
+                stats_[job->tool_name].timeouts++;
+                expired.push_back(job);
+            }
+        };
+        for (auto& worker_class : classes_) {
+            std::for_each(worker_class.queue.begin(), worker_class.queue.end(), check);
+        }
+        std::for_each(running_.begin(), running_.end(), check);
+
+        if (queued_ == 0 && running_.empty()) {
+            esp_timer_stop(deadline_timer_);
+        }
+    }
+
+    // Replies are sent without the lock
+    for (auto& job : expired) {
+        ESP_LOGW(TAG, "%s (id %d) timed out", job->tool_name.c_str(), job->id);
+        reply_(job->id, false, "Tool call timed out");
+    }
+}
+
+std::string ToolWorkerPool::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "queued", queued_);
+    cJSON_AddNumberToObject(root, "running", running_.size());
+
+    cJSON* workers = cJSON_CreateObject();
+    for (auto& worker_class : classes_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "workers", worker_class.workers);
+        cJSON_AddNumberToObject(item, "idle", worker_class.idle);
+        cJSON_AddNumberToObject(item, "max", worker_class.max_workers);
+        cJSON_AddItemToObject(workers, worker_class.task_name, item);
+    }
+    cJSON_AddItemToObject(root, "workers", workers);
+
+    cJSON* tools = cJSON_CreateObject();
+    for (const auto& [name, stats] : stats_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "calls", stats.calls);
+        cJSON_AddNumberToObject(item, "rejected", stats.rejected);
+        cJSON_AddNumberToObject(item, "timeouts", stats.timeouts);
+        cJSON_AddNumberToObject(item, "cancelled", stats.cancelled);
+        cJSON_AddNumberToObject(item, "errors", stats.errors);
+        cJSON_AddItemToObject(item, "queue_wait", stats.queue_wait.ToJson());
+        cJSON_AddItemToObject(item, "execution", stats.execution.ToJson());
+        cJSON_AddItemToObject(tools, name.c_str(), item);
+    }
+    cJSON_AddItemToObject(root, "tools", tools);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,105 @@
+#ifndef _TOOL_WORKER_POOL_H_
+#define _TOOL_WORKER_POOL_H_
+
+#include "event_loop_stats.h"
+
+#include <esp_timer.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define TOOL_WORKER_QUEUE_SIZE 4            // Calls waiting for a worker, over all stack classes
+#define TOOL_WORKER_IDLE_TIMEOUT_MS 30000   // Idle workers exit and give their stack back
+#define TOOL_WORKER_DEADLINE_CHECK_MS 500
+#define TOOL_WORKER_MAX_DEFAULT 2
+#define TOOL_WORKER_MAX_LARGE 1
+
+// Each class has its own workers, with the stack size of its task registry entry
+enum ToolStackClass {
+    kToolStackDefault,      // "tool_worker"
+    kToolStackLarge,        // "tool_worker_large", for tools like the camera
+    kToolStackClassCount
+};
+
+struct ToolJob {
+    int id;
+    std::string tool_name;
+    ToolStackClass stack_class = kToolStackDefault;
+    int64_t enqueue_time_us = 0;
+    int64_t deadline_us = 0;                // 0 for no deadline
+    std::function<std::string()> run;       // Returns the result, throws on error
+    std::string progress_token;             // JSON of _meta.progressToken, empty if not asked for
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> finished{false};      // Replied, timed out or cancelled; only the first one counts
+};
+
+/*
+ * Runs MCP tool calls on a bounded set of worker tasks. Workers are started on
+ * demand up to the class limit and exit after being idle for a while.
+ * A call that passes its deadline gets an error reply; the tool itself cannot be
+ * killed, it keeps its worker until it returns and its result is dropped.
+ * Tools that loop or wait should check IsCurrentCallCancelled().
+ */
+class ToolWorkerPool {
+public:
+    using ReplyCallback = std::function<void(int id, bool success, const std::string& payload)>;
+
+    ToolWorkerPool(ReplyCallback reply);
+    ~ToolWorkerPool();
+
+    // False if the queue is full, the job is not taken then
+    bool Submit(std::shared_ptr<ToolJob> job);
+    // notifications/cancelled: the call gets no reply
+    bool Cancel(int id);
+    // Queued or running, and not answered yet
+    bool IsInProgress(int id);
+    std::string GetStatsJson();
+
+    // For the tool running on the calling task; true after a cancel or timeout
+    static bool IsCurrentCallCancelled();
+    // The job of the tool running on the calling task, nullptr outside a worker
+    static ToolJob* CurrentJob();
+
+private:
+    struct WorkerClass {
+        ToolWorkerPool* pool;
+        ToolStackClass stack_class;
+        const char* task_name;
+        int max_workers;
+        int workers = 0;
+        int idle = 0;
+        std::deque<std::shared_ptr<ToolJob>> queue;
+        std::condition_variable cv;
+    };
+
+    struct ToolStats {
+        uint32_t calls = 0;
+        uint32_t rejected = 0;
+        uint32_t timeouts = 0;
+        uint32_t cancelled = 0;
+        uint32_t errors = 0;
+        LatencyHistogram queue_wait;
+        LatencyHistogram execution;
+    };
+
+    ReplyCallback reply_;
+    std::mutex mutex_;
+    WorkerClass classes_[kToolStackClassCount];
+    std::vector<std::shared_ptr<ToolJob>> running_;
+    std::map<std::string, ToolStats> stats_;
+    esp_timer_handle_t deadline_timer_ = nullptr;
+    int queued_ = 0;
+
+    void WorkerLoop(WorkerClass& worker_class);
+    void CheckDeadlines();
+    void Finish(ToolJob& job, bool success, const std::string& payload);
+};
+
+#endif // _TOOL_WORKER_POOL_H_
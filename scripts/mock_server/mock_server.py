@@ -0,0 +1,646 @@
+# 本地模拟语音服务器，用于在没有云端后端的情况下对设备协议进行端到端基准测试
+#
+# 提供:
+#   - OTA 接口 (HTTP)，下发指向本机的 websocket 或 mqtt 配置
+#   - WebSocket 传输，支持二进制协议 v1 / v2 / v3
+#   - MQTT (最小化的 3.1.1 实现，无需外部 broker) + AES-128-CTR 加密的 UDP 音频通道
+#   - hello / listen / abort / stt / llm / tts / mcp 消息
+#   - 以可控速率下发 p3 格式的 TTS 音频，可注入丢包、抖动和乱序
+#   - 记录上行音频 (p3) 和事件时间线 (jsonl)，退出时打印统计
+import argparse
+import asyncio
+import json
+import os
+import random
+import socket
+import struct
+import time
+import uuid
+
+import websockets
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+
+
+def now_ms():
+    return time.monotonic() * 1000.0
+
+
+def load_p3_frames(path):
+    """读取 p3 文件: [1字节类型, 1字节保留, 2字节长度, Opus数据]"""
+    frames = []
+    with open(path, 'rb') as f:
+        while True:
+            header = f.read(4)
+            if len(header) < 4:
+                break
+            _, _, size = struct.unpack('>BBH', header)
+            payload = f.read(size)
+            if len(payload) < size:
+                break
+            frames.append(payload)
+    return frames
+
+
+class Recorder:
+    """记录事件时间线和上行音频"""
+
+    def __init__(self, output_dir):
+        os.makedirs(output_dir, exist_ok=True)
+        self.output_dir = output_dir
+        self.start = now_ms()
+        self.events = open(os.path.join(output_dir, 'events.jsonl'), 'w')
+        self.uplink_file = None
+        self.stats = {
+            'sessions': 0,
+            'uplink_frames': 0,
+            'uplink_bytes': 0,
+            'uplink_max_gap_ms': 0.0,
+            'downlink_frames': 0,
+            'downlink_dropped': 0,
+            'downlink_reordered': 0,
+            'response_latency_ms': [],
+            'abort_latency_ms': [],
+            'mcp_latency_ms': [],
+        }
+        self.last_uplink_ms = None
+
+    def event(self, session, name, **fields):
+        record = {'t_ms': round(now_ms() - self.start, 2), 'session': session, 'event': name}
+        record.update(fields)
+        self.events.write(json.dumps(record, ensure_ascii=False) + '\n')
+        self.events.flush()
+
+    def begin_uplink(self, session):
+        if self.uplink_file:
+            self.uplink_file.close()
+        path = os.path.join(self.output_dir, f'uplink_{session}_{int(time.time())}.p3')
+        self.uplink_file = open(path, 'wb')
+        self.last_uplink_ms = None
+        return path
+
+    def uplink(self, session, payload, timestamp=0):
+        t = now_ms()
+        if self.last_uplink_ms is not None:
+            gap = t - self.last_uplink_ms
+            self.stats['uplink_max_gap_ms'] = max(self.stats['uplink_max_gap_ms'], gap)
+        self.last_uplink_ms = t
+        self.stats['uplink_frames'] += 1
+        self.stats['uplink_bytes'] += len(payload)
+        if self.uplink_file:
+            self.uplink_file.write(struct.pack('>BBH', 0, 0, len(payload)) + payload)
+
+    def summary(self):
+        def describe(values):
+            if not values:
+                return 'n/a'
+            values = sorted(values)
+            p50 = values[len(values) // 2]
+            p95 = values[min(len(values) - 1, int(len(values) * 0.95))]
+            return f'n={len(values)} p50={p50:.1f}ms p95={p95:.1f}ms max={values[-1]:.1f}ms'
+
+        s = self.stats
+        print('==== 统计 ====')
+        print(f"会话数: {s['sessions']}")
+        print(f"上行: {s['uplink_frames']} 帧, {s['uplink_bytes']} 字节, 最大间隔 {s['uplink_max_gap_ms']:.1f}ms")
+        print(f"下行: {s['downlink_frames']} 帧, 丢弃 {s['downlink_dropped']}, 乱序 {s['downlink_reordered']}")
+        print(f"响应延迟 (listen stop -> 首帧 TTS): {describe(s['response_latency_ms'])}")
+        print(f"打断延迟 (abort -> 停止下发): {describe(s['abort_latency_ms'])}")
+        print(f"MCP 往返延迟: {describe(s['mcp_latency_ms'])}")
+        with open(os.path.join(self.output_dir, 'summary.json'), 'w') as f:
+            json.dump(s, f, indent=2)
+
+
+class Session:
+    """一个设备会话，与具体传输无关"""
+
+    def __init__(self, server, transport):
+        self.server = server
+        self.args = server.args
+        self.recorder = server.recorder
+        self.transport = transport
+        self.session_id = uuid.uuid4().hex[:12]
+        self.listening = False
+        self.listen_mode = 'auto'
+        self.listen_audio_ms = 0
+        self.tts_task = None
+        self.abort_requested_ms = None
+        self.listen_stop_ms = None
+        self.mcp_next_id = 1
+        self.mcp_pending = {}
+
+    async def send_json(self, message):
+        message.setdefault('session_id', self.session_id)
+        await self.transport.send_text(json.dumps(message, ensure_ascii=False))
+
+    async def on_hello(self, message):
+        self.recorder.stats['sessions'] += 1
+        self.recorder.event(self.session_id, 'hello', version=message.get('version'),
+                            features=message.get('features'), audio_params=message.get('audio_params'))
+        reply = {
+            'type': 'hello',
+            'transport': self.transport.name,
+            'audio_params': {
+                'format': 'opus',
+                'sample_rate': self.args.sample_rate,
+                'channels': 1,
+                'frame_duration': self.args.frame_duration,
+            },
+        }
+        reply.update(self.transport.hello_extra())
+        await self.send_json(reply)
+        if self.args.mcp and message.get('features', {}).get('mcp'):
+            await self.mcp_request('initialize', {'protocolVersion': '2024-11-05', 'capabilities': {}})
+            await self.mcp_request('tools/list', {})
+            for call in self.args.mcp_call:
+                name, _, arguments = call.partition(':')
+                await self.mcp_request('tools/call', {'name': name, 'arguments': json.loads(arguments or '{}')})
+
+    async def mcp_request(self, method, params):
+        request_id = self.mcp_next_id
+        self.mcp_next_id += 1
+        self.mcp_pending[request_id] = (method, now_ms())
+        await self.send_json({'type': 'mcp', 'payload': {
+            'jsonrpc': '2.0', 'id': request_id, 'method': method, 'params': params}})
+
+    def on_mcp(self, payload):
+        responses = payload if isinstance(payload, list) else [payload]
+        for response in responses:
+            pending = self.mcp_pending.pop(response.get('id'), None)
+            if pending is None:
+                self.recorder.event(self.session_id, 'mcp_notification', payload=response)
+                continue
+            method, sent_ms = pending
+            latency = now_ms() - sent_ms
+            self.recorder.stats['mcp_latency_ms'].append(latency)
+            result = response.get('result', response.get('error'))
+            if method == 'tools/list' and isinstance(result, dict):
+                tools = [tool.get('name') for tool in result.get('tools', [])]
+                self.recorder.event(self.session_id, 'mcp_tools', latency_ms=round(latency, 2), tools=tools)
+                print(f'[{self.session_id}] MCP tools ({len(tools)}): {", ".join(tools)}')
+            else:
+                self.recorder.event(self.session_id, 'mcp_result', method=method,
+                                    latency_ms=round(latency, 2), result=result)
+
+    async def on_text(self, text):
+        try:
+            message = json.loads(text)
+        except json.JSONDecodeError:
+            self.recorder.event(self.session_id, 'invalid_json', text=text)
+            return
+        kind = message.get('type')
+        if kind == 'hello':
+            await self.on_hello(message)
+        elif kind == 'listen':
+            await self.on_listen(message)
+        elif kind == 'abort':
+            self.abort_requested_ms = now_ms()
+            self.recorder.event(self.session_id, 'abort', reason=message.get('reason'))
+            if self.tts_task and not self.tts_task.done():
+                self.tts_task.cancel()
+        elif kind == 'ping':
+            if not self.args.no_pong:
+                await self.send_json({'type': 'pong', 'id': message.get('id')})
+        elif kind == 'mcp':
+            self.on_mcp(message.get('payload', {}))
+        elif kind == 'goodbye':
+            self.recorder.event(self.session_id, 'goodbye')
+            await self.close()
+        else:
+            self.recorder.event(self.session_id, 'message', payload=message)
+
+    async def on_listen(self, message):
+        state = message.get('state')
+        self.recorder.event(self.session_id, 'listen', state=state, mode=message.get('mode'),
+                            text=message.get('text'))
+        if state == 'start':
+            self.listening = True
+            self.listen_mode = message.get('mode', 'auto')
+            self.listen_audio_ms = 0
+            path = self.recorder.begin_uplink(self.session_id)
+            print(f'[{self.session_id}] 开始录制上行音频: {path}')
+        elif state == 'stop':
+            await self.end_of_speech()
+        elif state == 'detect':
+            # 唤醒词之后立即进入对话
+            self.listening = True
+            self.listen_audio_ms = 0
+
+    async def on_audio(self, payload, timestamp=0):
+        self.recorder.uplink(self.session_id, payload, timestamp)
+        if not self.listening:
+            return
+        self.listen_audio_ms += self.args.frame_duration
+        # auto / realtime 模式下用固定时长模拟服务端 VAD
+        if self.listen_mode != 'manual' and self.listen_audio_ms >= self.args.vad_ms:
+            await self.end_of_speech()
+
+    async def end_of_speech(self):
+        if not self.listening:
+            return
+        self.listening = False
+        self.listen_stop_ms = now_ms()
+        self.recorder.event(self.session_id, 'end_of_speech', audio_ms=self.listen_audio_ms)
+        if self.tts_task and not self.tts_task.done():
+            self.tts_task.cancel()
+        self.tts_task = asyncio.create_task(self.reply())
+
+    async def reply(self):
+        args = self.args
+        aborted = False
+        try:
+            await self.send_json({'type': 'stt', 'text': args.stt_text})
+            await asyncio.sleep(args.think_ms / 1000.0)
+            await self.send_json({'type': 'llm', 'emotion': 'happy', 'text': '😀'})
+            await self.send_json({'type': 'tts', 'state': 'start'})
+            await self.send_json({'type': 'tts', 'state': 'sentence_start', 'text': args.tts_text})
+            await self.stream_tts()
+        except asyncio.CancelledError:
+            aborted = True
+        finally:
+            self.transport.end_stream()
+            if aborted and self.abort_requested_ms is not None:
+                latency = now_ms() - self.abort_requested_ms
+                self.recorder.stats['abort_latency_ms'].append(latency)
+                self.recorder.event(self.session_id, 'tts_aborted', latency_ms=round(latency, 2))
+                self.abort_requested_ms = None
+            try:
+                await self.send_json({'type': 'tts', 'state': 'stop'})
+            except Exception:
+                pass
+
+    async def stream_tts(self):
+        args = self.args
+        frames = list(enumerate(self.server.tts_frames))
+        # 乱序: 以一定概率与下一帧交换
+        for i in range(len(frames) - 1):
+            if random.random() < args.reorder:
+                frames[i], frames[i + 1] = frames[i + 1], frames[i]
+                self.recorder.stats['downlink_reordered'] += 1
+        interval = args.frame_duration / 1000.0 / args.tts_rate
+        next_send = time.monotonic()
+        first = True
+        for index, payload in frames:
+            if random.random() < args.loss:
+                self.recorder.stats['downlink_dropped'] += 1
+            else:
+                await self.transport.send_audio(payload, index * args.frame_duration)
+                self.recorder.stats['downlink_frames'] += 1
+                if first and self.listen_stop_ms is not None:
+                    latency = now_ms() - self.listen_stop_ms
+                    self.recorder.stats['response_latency_ms'].append(latency)
+                    self.recorder.event(self.session_id, 'tts_first_frame', latency_ms=round(latency, 2))
+                    first = False
+            next_send += interval
+            jitter = random.uniform(-args.jitter_ms, args.jitter_ms) / 1000.0 if args.jitter_ms > 0 else 0
+            delay = next_send + jitter - time.monotonic()
+            if delay > 0:
+                await asyncio.sleep(delay)
+        self.recorder.event(self.session_id, 'tts_done', frames=len(frames))
+
+    async def close(self):
+        if self.tts_task and not self.tts_task.done():
+            self.tts_task.cancel()
+        await self.transport.close()
+
+
+class WebsocketTransport:
+    name = 'websocket'
+
+    def __init__(self, websocket, version):
+        self.websocket = websocket
+        self.version = version
+
+    def hello_extra(self):
+        return {}
+
+    async def send_text(self, text):
+        await self.websocket.send(text)
+
+    async def send_audio(self, payload, timestamp):
+        if self.version == 2:
+            data = struct.pack('>HHIII', 2, 0, 0, timestamp, len(payload)) + payload
+        elif self.version == 3:
+            data = struct.pack('>BBH', 0, 0, len(payload)) + payload
+        else:
+            data = payload
+        await self.websocket.send(data)
+
+    def end_stream(self):
+        pass
+
+    def parse_audio(self, data):
+        if self.version == 2:
+            _, _, _, timestamp, size = struct.unpack('>HHIII', data[:16])
+            return data[16:16 + size], timestamp
+        if self.version == 3:
+            _, _, size = struct.unpack('>BBH', data[:4])
+            return data[4:4 + size], 0
+        return data, 0
+
+    async def close(self):
+        await self.websocket.close()
+
+
+class MqttUdpTransport:
+    """MQTT 控制通道 + UDP 加密音频通道"""
+    name = 'udp'
+
+    def __init__(self, server, writer, client_id):
+        self.server = server
+        self.writer = writer
+        self.client_id = client_id
+        self.topic = f'devices/p2p/{client_id}'
+        self.key = os.urandom(16)
+        self.nonce = bytes([0x01]) + os.urandom(15)
+        self.udp_addr = None
+        self.sequence_base = 0
+        self.sequence_max = 0
+
+    def hello_extra(self):
+        return {'udp': {
+            'server': self.server.args.host,
+            'port': self.server.args.udp_port,
+            'key': self.key.hex(),
+            'nonce': self.nonce.hex(),
+            'encryption': 'aes-128-ctr',
+        }}
+
+    async def send_text(self, text):
+        self.writer.write(mqtt_publish_packet(self.topic, text.encode()))
+        await self.writer.drain()
+
+    def crypt(self, nonce, data):
+        cipher = Cipher(algorithms.AES(self.key), modes.CTR(nonce))
+        return cipher.encryptor().update(data)
+
+    async def send_audio(self, payload, timestamp):
+        if self.udp_addr is None:
+            return
+        # 序号按帧的原始位置生成，乱序注入后设备端能观察到序号回退
+        sequence = self.sequence_base + timestamp // self.server.args.frame_duration + 1
+        self.sequence_max = max(self.sequence_max, sequence)
+        nonce = bytearray(self.nonce)
+        struct.pack_into('>H', nonce, 2, len(payload))
+        struct.pack_into('>II', nonce, 8, timestamp, sequence)
+        nonce = bytes(nonce)
+        self.server.udp_transport.sendto(nonce + self.crypt(nonce, payload), self.udp_addr)
+
+    def end_stream(self):
+        self.sequence_base = self.sequence_max
+
+    def parse_audio(self, data):
+        nonce = data[:16]
+        _, _, size, _, timestamp, _ = struct.unpack('>BBHIII', nonce)
+        return self.crypt(nonce, data[16:16 + size]), timestamp
+
+    async def close(self):
+        pass
+
+
+def mqtt_encode_length(length):
+    encoded = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        if length > 0:
+            byte |= 0x80
+        encoded.append(byte)
+        if length == 0:
+            return bytes(encoded)
+
+
+def mqtt_publish_packet(topic, payload):
+    topic_bytes = topic.encode()
+    body = struct.pack('>H', len(topic_bytes)) + topic_bytes + payload
+    return bytes([0x30]) + mqtt_encode_length(len(body)) + body
+
+
+async def mqtt_read_packet(reader):
+    header = await reader.readexactly(1)
+    multiplier, length = 1, 0
+    while True:
+        byte = (await reader.readexactly(1))[0]
+        length += (byte & 0x7F) * multiplier
+        if not byte & 0x80:
+            break
+        multiplier *= 128
+    body = await reader.readexactly(length) if length else b''
+    return header[0], body
+
+
+class UdpProtocol(asyncio.DatagramProtocol):
+    def __init__(self, server):
+        self.server = server
+
+    def datagram_received(self, data, addr):
+        if len(data) < 16 or data[0] != 0x01:
+            return
+        # 通过 nonce 匹配会话 (设备上行与下行共用同一个 nonce 前缀)
+        for session in self.server.mqtt_sessions.values():
+            transport = session.transport
+            if transport.nonce[4:8] == data[4:8] or transport.udp_addr in (None, addr):
+                transport.udp_addr = addr
+                payload, timestamp = transport.parse_audio(data)
+                asyncio.ensure_future(session.on_audio(payload, timestamp))
+                return
+
+
+class MockServer:
+    def __init__(self, args):
+        self.args = args
+        self.recorder = Recorder(args.output)
+        self.tts_frames = load_p3_frames(args.tts_file)
+        self.mqtt_sessions = {}
+        self.udp_transport = None
+        print(f'TTS 音频: {args.tts_file} ({len(self.tts_frames)} 帧)')
+
+    def ota_config(self, request_body):
+        version = '0.0.0'
+        try:
+            version = json.loads(request_body).get('application', {}).get('version', version)
+        except (json.JSONDecodeError, AttributeError):
+            pass
+        config = {
+            'firmware': {'version': version, 'url': ''},
+            'server_time': {'timestamp': int(time.time() * 1000), 'timezone_offset': 0},
+        }
+        if self.args.transport == 'mqtt':
+            config['mqtt'] = {
+                'endpoint': f'{self.args.host}:{self.args.mqtt_port}',
+                'client_id': 'mock-client',
+                'username': 'mock',
+                'password': 'mock',
+                'publish_topic': 'device-server',
+                'keepalive': 240,
+            }
+        else:
+            config['websocket'] = {
+                'url': f'ws://{self.args.host}:{self.args.ws_port}/xiaozhi/v1/',
+                'token': 'mock-token',
+                'version': self.args.ws_version,
+            }
+        return config
+
+    async def handle_http(self, reader, writer):
+        try:
+            request_line = (await reader.readline()).decode(errors='ignore').strip()
+            headers = {}
+            while True:
+                line = (await reader.readline()).decode(errors='ignore').strip()
+                if not line:
+                    break
+                key, _, value = line.partition(':')
+                headers[key.strip().lower()] = value.strip()
+            length = int(headers.get('content-length', '0'))
+            body = await reader.readexactly(length) if length else b''
+            self.recorder.event(None, 'ota_request', request=request_line, device_id=headers.get('device-id'))
+            if '/activate' in request_line:
+                payload = b'{}'
+            else:
+                payload = json.dumps(self.ota_config(body.decode(errors='ignore'))).encode()
+            writer.write(b'HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n'
+                         + f'Content-Length: {len(payload)}\r\nConnection: keep-alive\r\n\r\n'.encode() + payload)
+            await writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            writer.close()
+
+    async def handle_websocket(self, websocket):
+        request = getattr(websocket, 'request', None)
+        headers = request.headers if request is not None else websocket.request_headers
+        version = int(headers.get('Protocol-Version', '1'))
+        transport = WebsocketTransport(websocket, version)
+        session = Session(self, transport)
+        print(f'[{session.session_id}] WebSocket 已连接, 协议版本 v{version}, 设备 {headers.get("Device-Id")}')
+        try:
+            async for message in websocket:
+                if isinstance(message, bytes):
+                    payload, timestamp = transport.parse_audio(message)
+                    await session.on_audio(payload, timestamp)
+                else:
+                    await session.on_text(message)
+        except websockets.ConnectionClosed:
+            pass
+        finally:
+            session.recorder.event(session.session_id, 'disconnected')
+            if session.tts_task and not session.tts_task.done():
+                session.tts_task.cancel()
+
+    async def handle_mqtt(self, reader, writer):
+        session = None
+        try:
+            while True:
+                packet_type, body = await mqtt_read_packet(reader)
+                kind = packet_type >> 4
+                if kind == 1:  # CONNECT
+                    offset = 2 + struct.unpack('>H', body[:2])[0] + 4  # protocol name, level, flags, keepalive
+                    client_id_length = struct.unpack('>H', body[offset:offset + 2])[0]
+                    client_id = body[offset + 2:offset + 2 + client_id_length].decode()
+                    writer.write(bytes([0x20, 0x02, 0x00, 0x00]))
+                    session = Session(self, MqttUdpTransport(self, writer, client_id))
+                    self.mqtt_sessions[id(writer)] = session
+                    print(f'[{session.session_id}] MQTT 已连接, client_id={client_id}')
+                elif kind == 3:  # PUBLISH
+                    qos = (packet_type >> 1) & 0x03
+                    topic_length = struct.unpack('>H', body[:2])[0]
+                    offset = 2 + topic_length
+                    if qos > 0:
+                        packet_id = body[offset:offset + 2]
+                        offset += 2
+                        writer.write(bytes([0x40, 0x02]) + packet_id)
+                    if session is not None:
+                        await session.on_text(body[offset:].decode(errors='ignore'))
+                elif kind == 8:  # SUBSCRIBE
+                    packet_id = body[:2]
+                    writer.write(bytes([0x90, 0x03]) + packet_id + bytes([0x00]))
+                elif kind == 12:  # PINGREQ
+                    writer.write(bytes([0xD0, 0x00]))
+                elif kind == 14:  # DISCONNECT
+                    break
+                await writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            if session is not None:
+                session.recorder.event(session.session_id, 'disconnected')
+                self.mqtt_sessions.pop(id(writer), None)
+                if session.tts_task and not session.tts_task.done():
+                    session.tts_task.cancel()
+            writer.close()
+
+    async def run(self):
+        args = self.args
+        loop = asyncio.get_running_loop()
+        http_server = await asyncio.start_server(self.handle_http, '0.0.0.0', args.ota_port)
+        ws_server = await websockets.serve(self.handle_websocket, '0.0.0.0', args.ws_port, max_size=None)
+        mqtt_server = await asyncio.start_server(self.handle_mqtt, '0.0.0.0', args.mqtt_port)
+        self.udp_transport, _ = await loop.create_datagram_endpoint(
+            lambda: UdpProtocol(self), local_addr=('0.0.0.0', args.udp_port))
+        print(f'OTA 地址: http://{args.host}:{args.ota_port}/xiaozhi/ota/ (传输: {args.transport})')
+        print(f'WebSocket: ws://{args.host}:{args.ws_port}/xiaozhi/v1/  MQTT: {args.host}:{args.mqtt_port}  UDP: {args.udp_port}')
+        try:
+            await asyncio.Event().wait()
+        finally:
+            http_server.close()
+            ws_server.close()
+            mqtt_server.close()
+            self.udp_transport.close()
+
+
+def default_host():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(('10.255.255.255', 1))
+        return s.getsockname()[0]
+    except OSError:
+        return '127.0.0.1'
+    finally:
+        s.close()
+
+
+def main():
+    script_dir = os.path.dirname(os.path.abspath(__file__))
+    default_tts = os.path.join(script_dir, '..', '..', 'main', 'assets', 'zh-CN', 'activation.p3')
+
+    parser = argparse.ArgumentParser(description='小智本地模拟语音服务器 (WebSocket / MQTT+UDP)')
+    parser.add_argument('--host', default=default_host(), help='下发给设备的本机地址 (默认自动检测)')
+    parser.add_argument('--transport', choices=['websocket', 'mqtt'], default='websocket', help='OTA 下发的传输方式')
+    parser.add_argument('--ws-version', type=int, choices=[1, 2, 3], default=1, help='WebSocket 二进制协议版本')
+    parser.add_argument('--ota-port', type=int, default=8002)
+    parser.add_argument('--ws-port', type=int, default=8000)
+    parser.add_argument('--mqtt-port', type=int, default=1883)
+    parser.add_argument('--udp-port', type=int, default=8884)
+    parser.add_argument('--tts-file', default=default_tts, help='下发的 p3 音频文件')
+    parser.add_argument('--sample-rate', type=int, default=16000, help='TTS 音频采样率 (需与 p3 文件一致)')
+    parser.add_argument('--frame-duration', type=int, default=60, help='TTS 帧时长 (ms)')
+    parser.add_argument('--tts-rate', type=float, default=1.0, help='下发速率倍数 (1.0 = 实时)')
+    parser.add_argument('--loss', type=float, default=0.0, help='下行丢包率 (0-1)')
+    parser.add_argument('--jitter-ms', type=float, default=0.0, help='下行抖动幅度 (ms)')
+    parser.add_argument('--reorder', type=float, default=0.0, help='下行乱序概率 (0-1)')
+    parser.add_argument('--vad-ms', type=int, default=3000, help='auto 模式下模拟说话时长 (ms)')
+    parser.add_argument('--think-ms', type=int, default=200, help='模拟服务端处理耗时 (ms)')
+    parser.add_argument('--stt-text', default='你好', help='下发的识别结果')
+    parser.add_argument('--tts-text', default='你好，我是小智', help='下发的 TTS 文本')
+    parser.add_argument('--mcp', action='store_true', help='hello 后发送 MCP initialize 和 tools/list')
+    parser.add_argument('--mcp-call', action='append', default=[], metavar='NAME:JSON',
+                        help='tools/list 之后调用的工具, 例如 self.get_device_status:{}')
+    parser.add_argument('--no-pong', action='store_true', help='不响应 ping, 模拟半开连接')
+    parser.add_argument('--output', default='mock_server_output', help='录音和事件日志的输出目录')
+    parser.add_argument('--seed', type=int, default=None, help='随机种子, 便于复现')
+    args = parser.parse_args()
+
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    server = MockServer(args)
+    try:
+        asyncio.run(server.run())
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.recorder.summary()
+
+
+if __name__ == '__main__':
+    main()